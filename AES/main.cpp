@@ -23,15 +23,25 @@
  */
 
 #include "stdafx.h"
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <iostream>
-#include <fstream>
 #include "opts.h"
 #include "../libcrypto/Mask.h"
 #include "../libcrypto/AES/AES.h"
+#include "../libcrypto/Pipeline.h"
+#include "../libcrypto/Mapping.h"
+#include "../libcrypto/AsyncIO.h"
+
+/** The number of bytes read, transformed and written at a time, so memory use does not grow with the file */
+#define STREAM_CHUNK_SIZE_BYTES (4 * 1024 * 1024)
 
 // Forward-declare so main is at the top as per project spec
 void printHelp();
+int mapped(Options& opts);
+int transform(Options& opts, libcrypto::Mode mode, char* buff, size_t len, libcrypto::aes::aes_block_t& IV);
+uint64_t originalLength(uint64_t stored, uint64_t payload);
 
 int main(int argc, char* argv[])
 {
@@ -48,249 +58,579 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	std::ifstream reader;
-	std::ofstream writer;
+	if (opts.Mapped) return mapped(opts);
+
+	// Both files are read and written unbuffered, with many requests in flight, wherever the disk allows it (and as
+	// streams where it does not)
+	libcrypto::io::Reader reader;
+	libcrypto::io::Writer writer;
 
-	// Open the input file for read in binary mode
-	reader.open(opts.Input, std::ios::binary | std::ios::ate | std::ios::in);
-	if(!reader.good())
+	// Open the input file for read
+	if(!reader.Open(opts.Input))
 	{
 		std::cerr << "unable to open file for read: " << opts.Input << std::endl;
 		return -1;
 	}
 
 	// How big is it?
-	size_t len = reader.tellg();
-	if (len > MASK31)
-	{
-		std::cerr << "Input file too large according to spec. Must be less than 2GiB" << std::endl;
-		return -1;
-	}
-
-	// Seek to the start of the file
-	reader.seekg(0, std::ios::beg);
-	// Open the output file for write in binary mode
-	writer.open(opts.Output, std::ios::binary | std::ios::out);
+	uint64_t len = reader.Size();
 
-	if(!writer.good())
+	// Open the output file for write
+	if(!writer.Open(opts.Output))
 	{
 		std::cerr << "Unable to open file for write: " << opts.Output << std::endl;
-		reader.close();
 		return -1;
 	}
 
-	char* buff;
+	// The file streams through a reader thread, the crypto workers, and a writer, a chunk at a time. CBC encryption chains
+	// every block to the one before, so only decryption (and ECB) can spread chunks across workers
+	auto sequential = opts.Action == libcrypto::Action::ENCRYPT && opts.Mode == libcrypto::Mode::CBC;
+	libcrypto::pipeline::Pipeline pipeline(STREAM_CHUNK_SIZE_BYTES, sequential ? 1 : opts.Workers);
+	std::atomic<int> result(libcrypto::SUCCESS);
+	libcrypto::aes::aes_block_t IV;
+
 	if(opts.Action == libcrypto::Action::ENCRYPT)
 	{
-		// Create the first block containing the length of the file for padding purposes
-		auto headerBlock = libcrypto::aes::random_block();
-		headerBlock[0][3] = (len >> 24) & 0xFF;
-		headerBlock[1][3] = (len >> 16) & 0xFF;
-		headerBlock[2][3] = (len >>  8) & 0xFF;
-		headerBlock[3][3] = len & 0xFF;
-
-		auto needsPadding = len % 16 != 0;
-		auto buffSize = len + 16 + (needsPadding ? 16 - (len % 16) : 0);
-		buff = new char[buffSize]{ 0 };
-
-		// Include the length of the file so we can determine how much padding we used when decrypting
-		libcrypto::aes::buffstuff(buff, 0, headerBlock);
-
-		// If we need padding, fill the last block with random data (it will be overwritten when we read the file)
-		if (needsPadding)
+		// Derive the key from the passphrase with a fresh salt, and store both ahead of the ciphertext
+		if(opts.Passphrase)
 		{
-			auto padding = libcrypto::aes::random_block();
-			libcrypto::aes::buffstuff(buff, buffSize - 16, padding);
-		}
-
-		// Record the start time and read the file
-		auto ioStart = std::chrono::high_resolution_clock::now();
-		reader.read(buff + 16, len);
-		reader.close();
-
-		// Hand off the buffer to the crypto library and record the runtime
-		auto start = std::chrono::high_resolution_clock::now();
-		int result;
-		if(opts.Mode == libcrypto::Mode::ECB)
-		{
-			if(opts.has128BitKey)
-			{
-				result = libcrypto::aes::Encrypt(buff, buffSize, opts.k128);
-			}
-			else if(opts.has192BitKey)
+			char header[PASSPHRASE_HEADER_BYTES];
+			opts.MakeHeader(header);
+			if(!opts.DeriveKey(header))
 			{
-				result = libcrypto::aes::Encrypt(buff, buffSize, opts.k192);
-			}
-			else
-			{
-				result = libcrypto::aes::Encrypt(buff, buffSize, opts.k256);
+				std::cerr << "Unable to derive a key from the passphrase" << std::endl;
+				return -1;
 			}
+
+			writer.Write(header, PASSPHRASE_HEADER_BYTES);
 		}
-		else
+
+		if(opts.Mode == libcrypto::Mode::CBC)
 		{
 			// Create a random IV, encrypt it, and write it to the file
-			auto IV = libcrypto::aes::random_block();
+			auto random = libcrypto::aes::random_block();
+			IV = random;
 			char ivbuff[16]{ 0 };
 			libcrypto::aes::buffstuff(ivbuff, 0, IV);
 
-			// Encrypt using the key and IV
-			if(opts.has128BitKey)
+			result = transform(opts, libcrypto::Mode::ECB, ivbuff, 16, IV);
+
+			writer.Write(ivbuff, 16);
+		}
+
+		auto buffSize = len + 16 + (len % 16 != 0 ? 16 - (len % 16) : 0);
+		uint64_t remaining = len;
+
+		// The output is the header, the IV, then the encrypted file, so it can be sized before anything is written
+		writer.Reserve((opts.Passphrase ? PASSPHRASE_HEADER_BYTES : 0) + (opts.Mode == libcrypto::Mode::CBC ? 16 : 0) + buffSize);
+
+		auto read = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			// The first block holds the length of the file so we can determine how much padding we used when decrypting.
+			// Only the low 32 bits fit, which is enough to recover the rest from the size of the encrypted file
+			size_t filled = 0;
+			if(chunk.Index == 0)
 			{
-				libcrypto::aes::Encrypt(ivbuff, 16, opts.k128);
-				result = libcrypto::aes::Encrypt(buff, buffSize, opts.k128, IV);
+				auto headerBlock = libcrypto::aes::random_block();
+				headerBlock[0][3] = (len >> 24) & 0xFF;
+				headerBlock[1][3] = (len >> 16) & 0xFF;
+				headerBlock[2][3] = (len >>  8) & 0xFF;
+				headerBlock[3][3] = len & 0xFF;
+				libcrypto::aes::buffstuff(chunk.Data, 0, headerBlock);
+				filled = 16;
 			}
-			else if(opts.has192BitKey)
+
+			auto count = static_cast<size_t>(remaining < chunk.Capacity - filled ? remaining : chunk.Capacity - filled);
+			chunk.Length = filled + count;
+			chunk.Last = count == remaining;
+
+			// If the last chunk needs padding, fill its last block with random data (the end of the file overwrites the front)
+			if(chunk.Last && chunk.Length % 16 != 0)
 			{
-				libcrypto::aes::Encrypt(ivbuff, 16, opts.k192);
-				result = libcrypto::aes::Encrypt(buff, buffSize, opts.k192, IV);
+				chunk.Length += 16 - chunk.Length % 16;
+				auto padding = libcrypto::aes::random_block();
+				libcrypto::aes::buffstuff(chunk.Data, chunk.Length - 16, padding);
 			}
-			else
+
+			if(!reader.Read(chunk.Data + filled, count))
 			{
-				libcrypto::aes::Encrypt(ivbuff, 16, opts.k256);
-				result = libcrypto::aes::Encrypt(buff, buffSize, opts.k256, IV);
+				std::cerr << "Unable to read " << opts.Input << std::endl;
+				return false;
 			}
-			writer.write(ivbuff, 16);
-		}
 
-		auto end = std::chrono::high_resolution_clock::now();
-		std::chrono::duration<double, std::milli> duration = end - start;
+			remaining -= count;
+			return true;
+		};
 
-		// If encryption was a success, write the buffer to the output file
-		if(result == libcrypto::SUCCESS)
+		// With CBC there is only one worker, which carries the chain from chunk to chunk in the IV
+		auto encrypt = [&](libcrypto::pipeline::Chunk& chunk)
 		{
-			writer.write(buff, buffSize);
-		}
-		writer.close();
+			auto status = transform(opts, opts.Mode, chunk.Data, chunk.Length, IV);
 
-		// Clean up
-		delete[] buff;
-		auto ioEnd = std::chrono::high_resolution_clock::now();
+			if (status != libcrypto::SUCCESS) result = status;
+			return status == libcrypto::SUCCESS;
+		};
 
-		std::chrono::duration<double, std::milli> ioTime = ioEnd - ioStart - duration;
+		auto write = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			return writer.Write(chunk.Data, chunk.Length);
+		};
+
+		auto ok = result == libcrypto::SUCCESS && pipeline.Run(read, encrypt, write);
+		auto written = writer.Close();
 
 		// Tell the user what happened
 		if(result != libcrypto::SUCCESS)
 		{
 			std::cerr << "AES Failed with result " << result << std::endl;
 		}
+		else if(!written)
+		{
+			std::cerr << "Unable to write " << opts.Output << std::endl;
+			return -1;
+		}
+		else if(!ok)
+		{
+			return -1;
+		}
 		else
 		{
-			std::cout << "Encrypted " << buffSize << " bytes in " << duration.count() << "ms (+" << ioTime.count() << "ms i/o)" << std::endl;
+			std::cout << "Encrypted " << buffSize << " bytes in " << pipeline.Milliseconds() << "ms" << std::endl;
+			pipeline.Report(std::cout);
+			std::cout << "\ti/o:    " << reader.Kind() << " reads, " << writer.Kind() << " writes" << std::endl;
 		}
 	}
 	else if(opts.Action == libcrypto::Action::DECRYPT)
 	{
-		// Valid files are a multiple of 16 bytes
-		if(len % 16 != 0)
+		// Recover the key from the passphrase with the salt, iteration count and key size it was encrypted with
+		if(opts.Passphrase)
+		{
+			char header[PASSPHRASE_HEADER_BYTES];
+			if(len < PASSPHRASE_HEADER_BYTES || !reader.Read(header, PASSPHRASE_HEADER_BYTES) || !opts.DeriveKey(header))
+			{
+				std::cerr << "Missing or corrupt passphrase header. The file was not encrypted with a passphrase" << std::endl;
+				return -1;
+			}
+
+			len -= PASSPHRASE_HEADER_BYTES;
+		}
+
+		// Valid files are a multiple of 16 bytes, with room for the length block (and the IV in CBC mode)
+		if(len % 16 != 0 || len < (opts.Mode == libcrypto::Mode::CBC ? 32u : 16u))
 		{
 			std::cerr << "Input file not a multiple of 16 bytes. The file is corrupt, not complete, or is not an AES Encrypted file" << std::endl;
-			reader.close();
 			return -1;
 		}
 
-		// Record the start time and read the file
-		auto ioStart = std::chrono::high_resolution_clock::now();
-		buff = new char[len];
-		reader.read(buff, len);
-		reader.close();
+		// The ciphertext block before each chunk, starting with the decrypted IV
+		char previous[16]{ 0 };
+		if(opts.Mode == libcrypto::Mode::CBC)
+		{
+			reader.Read(previous, 16);
+			result = transform(opts, libcrypto::Mode::ECB, previous, 16, IV);
+			len -= 16;
+		}
 
-		// Hand off the buffer to the crypto library and record the runtime
-		auto start = std::chrono::high_resolution_clock::now();
-		int result;
-		if(opts.Mode == libcrypto::Mode::ECB)
+		uint64_t remaining = len;
+		uint64_t unwritten = 0;
+
+		auto read = [&](libcrypto::pipeline::Chunk& chunk)
 		{
-			if(opts.has128BitKey)
-			{
-				result = libcrypto::aes::Decrypt(buff, len, opts.k128);
-			}
-			else if(opts.has192BitKey)
+			chunk.Length = static_cast<size_t>(remaining < chunk.Capacity ? remaining : chunk.Capacity);
+			if(!reader.Read(chunk.Data, chunk.Length))
 			{
-				result = libcrypto::aes::Decrypt(buff, len, opts.k192);
+				std::cerr << "Unable to read " << opts.Input << std::endl;
+				return false;
 			}
-			else
+
+			// Each chunk carries the block it chains from, so the chunks can be decrypted in any order
+			memcpy(chunk.Previous, previous, 16);
+			memcpy(previous, chunk.Data + chunk.Length - 16, 16);
+
+			remaining -= chunk.Length;
+			chunk.Last = remaining == 0;
+			return true;
+		};
+
+		auto decrypt = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			auto chain = libcrypto::aes::make_block(chunk.Previous, 0);
+			auto status = transform(opts, opts.Mode, chunk.Data, chunk.Length, chain);
+
+			if (status != libcrypto::SUCCESS) result = status;
+			return status == libcrypto::SUCCESS;
+		};
+
+		auto write = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			// Read the original length from the decrypted file, before writing anything
+			size_t skip = 0;
+			if(chunk.Index == 0)
 			{
-				result = libcrypto::aes::Decrypt(buff, len, opts.k256);
+				auto buff = chunk.Data;
+				auto stored = (buff[12] & 0xFFull) << 24 | (buff[13] & 0xFFull) << 16 | (buff[14] & 0xFFull) << 8 | (buff[15] & 0xFFull);
+				unwritten = originalLength(stored, len - 16);
+
+				// If we didn't decrypt the file successfully, warn the user
+				if(unwritten > len - 16)
+				{
+					std::cerr << "Decrypted length does not match the file (" << stored << " bytes). The file is corrupted or is not an AES file" << std::endl;
+					return false;
+				}
+
+				// Now the length is known, the output can be sized before anything is written
+				writer.Reserve(unwritten);
+				skip = 16;
 			}
+
+			// Write the chunk, excluding the header and padding
+			auto count = static_cast<size_t>(chunk.Length - skip < unwritten ? chunk.Length - skip : unwritten);
+			unwritten -= count;
+			return writer.Write(chunk.Data + skip, count);
+		};
+
+		auto ok = result == libcrypto::SUCCESS && pipeline.Run(read, decrypt, write);
+		auto written = writer.Close();
+
+		// Tell the user what happened
+		if(result != libcrypto::SUCCESS)
+		{
+			std::cerr << "AES Failed with result " << result << std::endl;
+		}
+		else if(!written)
+		{
+			std::cerr << "Unable to write " << opts.Output << std::endl;
+			return -1;
+		}
+		else if(!ok)
+		{
+			return -1;
 		}
 		else
 		{
-			// Decrypt the IV, then the rest of the file
-			if(opts.has128BitKey)
-			{
-				libcrypto::aes::Decrypt(buff, 16, opts.k128);
+			std::cout << "Decrypted " << len << " bytes in " << pipeline.Milliseconds() << "ms" << std::endl;
+			pipeline.Report(std::cout);
+			std::cout << "\ti/o:    " << reader.Kind() << " reads, " << writer.Kind() << " writes" << std::endl;
+		}
+	}
+	else
+	{
+		return -1;
+	}
 
-				auto IV = libcrypto::aes::make_block(buff, 0);
-				buff += 16;
-				len -= 16;
+    return 0;
+}
 
-				result = libcrypto::aes::Decrypt(buff, len, opts.k128, IV);
-			}
-			else if(opts.has192BitKey)
-			{
-				libcrypto::aes::Decrypt(buff, 16, opts.k192);
+/**
+ * Encrypt or decrypt between memory mappings of the input and output files, or within the input's own mapping when they
+ * are the same file. Nothing passes through a staging buffer, and in place there is never a second copy of the file on disk
+ */
+int mapped(Options& opts)
+{
+	auto inPlace = libcrypto::mapping::SameFile(opts.Input, opts.Output);
+	libcrypto::mapping::MappedFile input, output;
+	auto& target = inPlace ? input : output;
+
+	if(!input.Open(opts.Input, inPlace))
+	{
+		std::cerr << "unable to open file for read: " << opts.Input << std::endl;
+		return -1;
+	}
 
-				auto IV = libcrypto::aes::make_block(buff, 0);
-				buff += 16;
-				len -= 16;
+	auto len = input.Size();
+	auto cbc = opts.Mode == libcrypto::Mode::CBC;
+	std::atomic<int> result(libcrypto::SUCCESS);
 
-				result = libcrypto::aes::Decrypt(buff, len, opts.k192, IV);
-			}
-			else
+	// The passphrase header and the IV come first, then the length block, the file, and the padding
+	uint64_t prefix = (opts.Passphrase ? PASSPHRASE_HEADER_BYTES : 0) + (cbc ? 16 : 0);
+	char header[PASSPHRASE_HEADER_BYTES];
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if(opts.Action == libcrypto::Action::ENCRYPT)
+	{
+		// Derive the key from the passphrase with a fresh salt, to be stored ahead of the ciphertext
+		if(opts.Passphrase)
+		{
+			opts.MakeHeader(header);
+			if(!opts.DeriveKey(header))
 			{
-				libcrypto::aes::Decrypt(buff, 16, opts.k256);
+				std::cerr << "Unable to derive a key from the passphrase" << std::endl;
+				return -1;
+			}
+		}
+
+		auto buffSize = len + 16 + (len % 16 != 0 ? 16 - (len % 16) : 0);
+
+		if((!inPlace && !output.Open(opts.Output, true, true)) || !target.Resize(prefix + buffSize))
+		{
+			std::cerr << "Unable to open file for write: " << opts.Output << std::endl;
+			return -1;
+		}
+
+		auto out = target.Map();
+		const char* in = inPlace ? out : input.Map();
+		if(out == nullptr || (in == nullptr && len > 0))
+		{
+			std::cerr << "Unable to map " << opts.Input << " and " << opts.Output << std::endl;
+			return -1;
+		}
 
-				auto IV = libcrypto::aes::make_block(buff, 0);
-				buff += 16;
-				len -= 16;
+		// In place, the file moves up past the headers first
+		auto body = out + prefix;
+		if (inPlace) memmove(body + 16, out, static_cast<size_t>(len));
+		if (opts.Passphrase) memcpy(out, header, PASSPHRASE_HEADER_BYTES);
 
-				result = libcrypto::aes::Decrypt(buff, len, opts.k256, IV);
+		// Create a random IV, encrypt it, and write it to the file
+		char first[16]{ 0 };
+		libcrypto::aes::aes_block_t IV;
+		if(cbc)
+		{
+			auto random = libcrypto::aes::random_block();
+			libcrypto::aes::buffstuff(first, 0, random);
+			memcpy(body - 16, first, 16);
+			result = transform(opts, libcrypto::Mode::ECB, body - 16, 16, IV);
+		}
+
+		// The length block (see main), then random padding after the end of the file
+		auto headerBlock = libcrypto::aes::random_block();
+		headerBlock[0][3] = (len >> 24) & 0xFF;
+		headerBlock[1][3] = (len >> 16) & 0xFF;
+		headerBlock[2][3] = (len >>  8) & 0xFF;
+		headerBlock[3][3] = len & 0xFF;
+		libcrypto::aes::buffstuff(body, 0, headerBlock);
+
+		char padding[16];
+		auto random = libcrypto::aes::random_block();
+		libcrypto::aes::buffstuff(padding, 0, random);
+		memcpy(body + 16 + len, padding, static_cast<size_t>(buffSize - 16 - len));
+
+		auto encrypt = [&](char* data, uint64_t offset, size_t count, const char* previous)
+		{
+			// Copy the part of the file that lands in this chunk across from the input mapping
+			if(!inPlace)
+			{
+				auto from = offset < 16 ? 16 : offset;
+				auto to = offset + count < 16 + len ? offset + count : 16 + len;
+				if (to > from) memcpy(body + from, in + from - 16, static_cast<size_t>(to - from));
 			}
+
+			auto chain = libcrypto::aes::make_block(previous == nullptr ? first : previous, 0);
+			auto status = transform(opts, opts.Mode, data, count, chain);
+
+			if (status != libcrypto::SUCCESS) result = status;
+			return status == libcrypto::SUCCESS;
+		};
+
+		libcrypto::mapping::Region region = { body, buffSize, inPlace ? body : in, cbc ? body : nullptr, first, true };
+		auto transformed = result == libcrypto::SUCCESS && libcrypto::mapping::TransformRegion(region, 16, opts.Workers, encrypt);
+
+		target.Unmap();
+		std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+
+		if(result != libcrypto::SUCCESS)
+		{
+			std::cerr << "AES Failed with result " << result << std::endl;
+			return -1;
 		}
-		auto end = std::chrono::high_resolution_clock::now();
-		std::chrono::duration<double, std::milli> duration = end - start;
 
-		auto originalLength = (buff[12] | 0ull) << 24 | (buff[13] | 0ull) << 16 | (buff[14] | 0ull) << 8 | buff[15];
-		// If we didn't decrypt the file successfully, warn the user
-		if(originalLength > MASK31 || originalLength > len)
+		if(!transformed)
 		{
-			std::cerr << "Decrypted length too large (" << originalLength << " bytes). The file is corrupted or is not an AES file" << std::endl;
-			writer.close();
-			if (opts.Mode == libcrypto::Mode::CBC) buff -= 16;
-			delete[] buff;
+			std::cerr << "Unable to read " << opts.Input << " through its mapping (was it truncated, or did the disk fail?)" << std::endl;
+			return -1;
+		}
 
+		std::cout << "Encrypted " << buffSize << " bytes in " << duration.count() << "ms (mapped" << (inPlace ? ", in place)" : ")") << std::endl;
+	}
+	else if(opts.Action == libcrypto::Action::DECRYPT)
+	{
+		// Valid files are a multiple of 16 bytes after the headers, with room for the length block
+		if(len < prefix + 16 || (len - prefix) % 16 != 0)
+		{
+			std::cerr << "Input file not a multiple of 16 bytes. The file is corrupt, not complete, or is not an AES Encrypted file" << std::endl;
+			return -1;
+		}
+
+		auto in = input.Map();
+		if(in == nullptr)
+		{
+			std::cerr << "Unable to map " << opts.Input << std::endl;
 			return -1;
 		}
 
-		// If we decrypted the file successfully, write the buffer (excluding the header and padding)
-		if(result == libcrypto::SUCCESS)
+		// Recover the key from the passphrase with the salt, iteration count and key size it was encrypted with
+		if(opts.Passphrase)
 		{
-			writer.write(buff + 16, originalLength);
+			memcpy(header, in, PASSPHRASE_HEADER_BYTES);
+			if(!opts.DeriveKey(header))
+			{
+				std::cerr << "Missing or corrupt passphrase header. The file was not encrypted with a passphrase" << std::endl;
+				return -1;
+			}
 		}
-		writer.close();
 
-		// Cleanup
-		if (opts.Mode == libcrypto::Mode::CBC) buff -= 16;
-		delete[] buff;
-		auto ioEnd = std::chrono::high_resolution_clock::now();
+		auto body = in + prefix;
+		auto ciphertext = body + 16;
+		auto payload = len - prefix - 16;
 
-		std::chrono::duration<double, std::milli> ioTime = ioEnd - ioStart - duration;
+		// Decrypt the IV, then the length block with it
+		char block[16];
+		memcpy(block, body, 16);
+		libcrypto::aes::aes_block_t IV;
+		if(cbc)
+		{
+			char iv[16];
+			memcpy(iv, body - 16, 16);
+			result = transform(opts, libcrypto::Mode::ECB, iv, 16, IV);
+
+			auto decrypted = libcrypto::aes::make_block(iv, 0);
+			IV = decrypted;
+		}
+		if (result == libcrypto::SUCCESS) result = transform(opts, opts.Mode, block, 16, IV);
 
-		// Tell the user what happened
 		if(result != libcrypto::SUCCESS)
 		{
 			std::cerr << "AES Failed with result " << result << std::endl;
+			return -1;
+		}
+
+		// If we didn't decrypt the file successfully, warn the user before anything is written
+		auto stored = (block[12] & 0xFFull) << 24 | (block[13] & 0xFFull) << 16 | (block[14] & 0xFFull) << 8 | (block[15] & 0xFFull);
+		auto length = originalLength(stored, payload);
+		if(length > payload)
+		{
+			std::cerr << "Decrypted length does not match the file (" << stored << " bytes). The file is corrupted or is not an AES file" << std::endl;
+			return -1;
+		}
+
+		// The last block is only partly kept, so it is decrypted on its own before any ciphertext is overwritten
+		auto full = length / 16 * 16;
+		if(length > full)
+		{
+			auto chain = libcrypto::aes::make_block(body, static_cast<size_t>(full));
+			memcpy(block, ciphertext + full, 16);
+			result = transform(opts, opts.Mode, block, 16, chain);
+		}
+
+		// Out of place, the file goes to the start of a new one. In place, it is decrypted where it is and moved down after
+		char* out;
+		if(inPlace)
+		{
+			out = body + 16;
 		}
 		else
 		{
-			std::cout << "Decrypted " << len << " bytes in " << duration.count() << "ms (+" << ioTime.count() << "ms i/o)" << std::endl;
+			if(!output.Open(opts.Output, true, true) || !output.Resize(length))
+			{
+				std::cerr << "Unable to open file for write: " << opts.Output << std::endl;
+				return -1;
+			}
+
+			out = output.Map();
+			if(out == nullptr && length > 0)
+			{
+				std::cerr << "Unable to map " << opts.Output << std::endl;
+				return -1;
+			}
+		}
+
+		auto decrypt = [&](char* data, uint64_t offset, size_t count, const char* previous)
+		{
+			if (!inPlace) memcpy(data, ciphertext + offset, count);
+
+			auto chain = libcrypto::aes::make_block(previous == nullptr ? body : previous, 0);
+			auto status = transform(opts, opts.Mode, data, count, chain);
+
+			if (status != libcrypto::SUCCESS) result = status;
+			return status == libcrypto::SUCCESS;
+		};
+
+		// The length block chains into the rest of the file
+		libcrypto::mapping::Region region = { out, full, ciphertext, cbc ? ciphertext : nullptr, body, false };
+		auto transformed = result == libcrypto::SUCCESS && (full == 0 || libcrypto::mapping::TransformRegion(region, 16, opts.Workers, decrypt));
+
+		if(result != libcrypto::SUCCESS)
+		{
+			std::cerr << "AES Failed with result " << result << std::endl;
+			return -1;
+		}
+
+		if(!transformed)
+		{
+			std::cerr << "Unable to read " << opts.Input << " through its mapping (was it truncated, or did the disk fail?)" << std::endl;
+			return -1;
+		}
+
+		if (length > full) memcpy(out + full, block, static_cast<size_t>(length - full));
+
+		// Move the file down over the headers and cut off the padding
+		if(inPlace)
+		{
+			memmove(in, out, static_cast<size_t>(length));
+			input.Unmap();
+			if(!input.Resize(length))
+			{
+				std::cerr << "Unable to truncate " << opts.Input << std::endl;
+				return -1;
+			}
 		}
+		output.Unmap();
+
+		std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+		std::cout << "Decrypted " << len - prefix << " bytes in " << duration.count() << "ms (mapped" << (inPlace ? ", in place)" : ")") << std::endl;
 	}
 	else
 	{
 		return -1;
 	}
 
-    return 0;
+	return 0;
+}
+
+/**
+ * Encrypt or decrypt one chunk in place with the key from the options in the specified mode. In CBC mode the IV is replaced with the
+ * last ciphertext block of the chunk, which chains into the next one
+ */
+int transform(Options& opts, libcrypto::Mode mode, char* buff, size_t len, libcrypto::aes::aes_block_t& IV)
+{
+	auto encrypt = opts.Action == libcrypto::Action::ENCRYPT;
+
+	if(mode == libcrypto::Mode::ECB)
+	{
+		if (opts.has128BitKey) return encrypt ? libcrypto::aes::Encrypt(buff, len, opts.k128) : libcrypto::aes::Decrypt(buff, len, opts.k128);
+		if (opts.has192BitKey) return encrypt ? libcrypto::aes::Encrypt(buff, len, opts.k192) : libcrypto::aes::Decrypt(buff, len, opts.k192);
+		return encrypt ? libcrypto::aes::Encrypt(buff, len, opts.k256) : libcrypto::aes::Decrypt(buff, len, opts.k256);
+	}
+
+	// Decryption needs the last ciphertext block before it is overwritten
+	auto next = libcrypto::aes::make_block(buff, len - 16);
+
+	int result;
+	if (opts.has128BitKey) result = encrypt ? libcrypto::aes::Encrypt(buff, len, opts.k128, IV) : libcrypto::aes::Decrypt(buff, len, opts.k128, IV);
+	else if (opts.has192BitKey) result = encrypt ? libcrypto::aes::Encrypt(buff, len, opts.k192, IV) : libcrypto::aes::Decrypt(buff, len, opts.k192, IV);
+	else result = encrypt ? libcrypto::aes::Encrypt(buff, len, opts.k256, IV) : libcrypto::aes::Decrypt(buff, len, opts.k256, IV);
+
+	if(encrypt)
+	{
+		auto last = libcrypto::aes::make_block(buff, len - 16);
+		IV = last;
+	}
+	else
+	{
+		IV = next;
+	}
+	return result;
+}
+
+/**
+ * Recover the length of the plaintext from the low 32 bits stored in the length block and the number of bytes after it.
+ * Padding is less than a block, so only one length in (payload - 16, payload] matches. Returns a length past the payload
+ * if none does, which means the file is corrupt or the key is wrong
+ */
+uint64_t originalLength(uint64_t stored, uint64_t payload)
+{
+	auto padding = (payload - stored) & MASK32;
+	return padding < 16 && padding <= payload ? payload - padding : payload + 1;
 }
 
 /**
@@ -298,7 +638,7 @@ int main(int argc, char* argv[])
  */
 void printHelp()
 {
-	std::cout << "AES <action> <key> <mode> <in> <out>" << std::endl << std::endl;
+	std::cout << "AES <action> <key> <mode> <in> <out> [-p] [-i iterations] [-b bits] [-j workers] [-m]" << std::endl << std::endl;
 
 	std::cout << "\tAction: -e: encrypt, -d: decrypt" << std::endl;
 	std::cout << "\tKey:    an 16, 24, or 32 byte hex or ascii sequence" << std::endl;
@@ -307,5 +647,14 @@ void printHelp()
 	std::cout << "\tMode:   CBC or ECB" << std::endl;
 	std::cout << "\tIn:     The path to the input file" << std::endl;
 	std::cout << "\tOut:    The path to the output file" << std::endl;
+	std::cout << "\t-p:     Treat the key as a passphrase and derive the key with PBKDF2-HMAC-SHA512" << std::endl;
+	std::cout << "\t        The salt, iteration count and key size are stored at the start of the encrypted file" << std::endl;
+	std::cout << "\t-i:     The number of PBKDF2 iterations when encrypting (default " << DEFAULT_PASSPHRASE_ITERATIONS << ", at most " << MAX_PASSPHRASE_ITERATIONS << ")" << std::endl;
+	std::cout << "\t-b:     The size of the key to derive when encrypting: 128, 192, or 256 bits (default 256)" << std::endl;
+	std::cout << "\t        It is stored with the salt, so it is not needed when decrypting" << std::endl;
+	std::cout << "\t-j:     The number of threads to encrypt or decrypt on (default: one per core)" << std::endl;
+	std::cout << "\t        CBC encryption chains every block to the last, so it always runs on one" << std::endl;
+	std::cout << "\t-m:     Memory-map the files and encrypt from one mapping straight into the other" << std::endl;
+	std::cout << "\t        If In and Out are the same file, it is encrypted in place (and is lost if interrupted)" << std::endl;
 }
 
@@ -23,13 +23,17 @@
  */
 
 #pragma once
+#include <cstring>
 #include <string>
 #include <algorithm>
 #include <iostream>
 #include <regex>
+#include <thread>
 #include "../libcrypto/libcrypto.h"
 #include "../libcrypto/AES/AES.h"
 #include "../libcrypto/AES/Types.h"
+#include "../libcrypto/Hashing/Passphrase.h"
+#include "../libcrypto/Mapping.h"
 
 /** A regular expression that accepts 32, 48, or 64 hex characters (16, 24, or 32 hex bytes) */
 #define REGEX_HEX "^([0-9a-fA-F]{32}|[0-9a-fA-F]{48}|[0-9a-fA-F]{64})$"
@@ -131,6 +135,59 @@ private:
 
 		return true;
 	}
+
+	/** Parse the optional flags that follow the output path */
+	bool parseFlags(int argc, char* argv[])
+	{
+		for(auto i = 6; i < argc; i++)
+		{
+			std::string flag(argv[i]);
+			std::transform(flag.begin(), flag.end(), flag.begin(), ::tolower);
+
+			if(flag == "-p")
+			{
+				Passphrase = true;
+			}
+			else if(flag == "-m")
+			{
+				Mapped = true;
+			}
+			else if(flag == "-i" && i + 1 < argc)
+			{
+				Iterations = strtoul(argv[++i], nullptr, 10);
+				if(Iterations == 0 || Iterations > MAX_PASSPHRASE_ITERATIONS)
+				{
+					std::cerr << "Iterations must be between 1 and " << MAX_PASSPHRASE_ITERATIONS << std::endl;
+					return false;
+				}
+			}
+			else if(flag == "-j" && i + 1 < argc)
+			{
+				Workers = strtoul(argv[++i], nullptr, 10);
+				if(Workers == 0)
+				{
+					std::cerr << "Workers must be a positive number" << std::endl;
+					return false;
+				}
+			}
+			else if(flag == "-b" && i + 1 < argc)
+			{
+				KeyBits = strtoul(argv[++i], nullptr, 10);
+				if(KeyBits != 128 && KeyBits != 192 && KeyBits != 256)
+				{
+					std::cerr << "Key size must be 128, 192, or 256 bits" << std::endl;
+					return false;
+				}
+			}
+			else
+			{
+				std::cerr << "Unknown option " << flag << std::endl;
+				return false;
+			}
+		}
+
+		return true;
+	}
 public:
 	/** The action to perform */
 	libcrypto::Action Action = libcrypto::Action::UNKNOWN_ACTION;
@@ -152,6 +209,19 @@ public:
 	/** True iff a 192-bit key was provided */
 	bool has192BitKey = false;
 
+	/** True iff the key is a passphrase to derive the key from (see DeriveKey) */
+	bool Passphrase = false;
+	/** The passphrase, if Passphrase is set */
+	std::string Secret;
+	/** The number of PBKDF2 iterations when encrypting with a passphrase */
+	uint32_t Iterations = DEFAULT_PASSPHRASE_ITERATIONS;
+	/** The number of threads to encrypt or decrypt on. CBC encryption is sequential, so it always uses one */
+	unsigned int Workers = std::thread::hardware_concurrency();
+	/** True iff the files are memory-mapped and transformed from one mapping into the other (or within one, in place) */
+	bool Mapped = false;
+	/** The size of the key to derive from a passphrase when encrypting (decryption uses the size stored in the header) */
+	size_t KeyBits = 256;
+
 	/** Whether or not errors were encountered */
 	bool Errors = false;
 
@@ -160,7 +230,7 @@ public:
 	 */
 	Options(int argc, char* argv[])
 	{
-		if(argc != 6)
+		if(argc < 6 || !parseFlags(argc, argv))
 		{
 			Errors = true;
 			return;
@@ -185,7 +255,11 @@ public:
 		}
 
 		std::string key(argv[2]);
-		if(!parseKey(key))
+		if(Passphrase)
+		{
+			Secret = key;
+		}
+		else if(!parseKey(key))
 		{
 			std::cerr << "Malformed Key" << std::endl;
 			Errors = true;
@@ -212,5 +286,64 @@ public:
 
 		Input = std::string(argv[4]);
 		Output = std::string(argv[5]);
+
+		// Opening the output would truncate the input before it is read
+		if(!Mapped && libcrypto::mapping::SameFile(Input, Output))
+		{
+			std::cerr << "The input and output are the same file. Use -m to encrypt or decrypt it in place" << std::endl;
+			Errors = true;
+		}
+	}
+
+	/**
+	 * Fill a new passphrase header with a random salt, the iteration count and the key size, to be stored ahead of the
+	 * ciphertext
+	 */
+	void MakeHeader(char* header) const
+	{
+		libcrypto::hashing::Passphrase::MakeHeader(Iterations, KeyBits, header);
+	}
+
+	/**
+	 * Derive the key from the passphrase with the salt, iteration count and key size in the header. Returns false if the
+	 * header is corrupt
+	 */
+	bool DeriveKey(const char* header)
+	{
+		// The key is derived at the size it was encrypted with, whatever -b says
+		uint32_t iterations;
+		size_t keyBits;
+		if(libcrypto::hashing::Passphrase::ParseHeader(header, iterations, keyBits) != libcrypto::SUCCESS || (keyBits != 128 && keyBits != 192 && keyBits != 256))
+		{
+			return false;
+		}
+		KeyBits = keyBits;
+
+		char raw[32];
+		if(libcrypto::hashing::Passphrase::DeriveKey(Secret.c_str(), Secret.length(), header, raw, KeyBits / 8) != libcrypto::SUCCESS)
+		{
+			return false;
+		}
+
+		if(KeyBits == 128)
+		{
+			auto k = libcrypto::aes::make_block(raw, 0);
+			k128 = k;
+			has128BitKey = true;
+		}
+		else if(KeyBits == 192)
+		{
+			auto k = libcrypto::aes::make_key_192(raw);
+			k192 = k;
+			has192BitKey = true;
+		}
+		else
+		{
+			auto k = libcrypto::aes::make_key_256(raw);
+			k256 = k;
+		}
+
+		memset(raw, 0, sizeof(raw));
+		return true;
 	}
 };
@@ -27,12 +27,21 @@
 #include "../libcrypto/libcrypto.h"
 #include "../libcrypto/Mask.h"
 #include "../libcrypto/DES/DES.h"
+#include "../libcrypto/Pipeline.h"
+#include "../libcrypto/Mapping.h"
+#include "../libcrypto/AsyncIO.h"
 #include <iostream>
-#include <fstream>
+#include <atomic>
 #include <chrono>
+#include <cstring>
+
+/** The number of bytes read, transformed and written at a time, so memory use does not grow with the file */
+#define STREAM_CHUNK_SIZE_BYTES (4 * 1024 * 1024)
 
 // Forward-declare so main is at the top as per project spec
 void printHelp();
+int mapped(Options& opts);
+uint64_t originalLength(uint64_t stored, uint64_t payload);
 
 int main(int argc, char* argv[])
 {
@@ -49,188 +58,544 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	std::ifstream reader;
-	std::ofstream writer;
+	if (opts.Mapped) return mapped(opts);
+
+	// Both files are read and written unbuffered, with many requests in flight, wherever the disk allows it (and as
+	// streams where it does not)
+	libcrypto::io::Reader reader;
+	libcrypto::io::Writer writer;
 
-	// Open the input file for read in binary mode
-	reader.open(opts.Input, std::ios::binary | std::ios::ate | std::ios::in);
-	if(!reader.good())
+	// Open the input file for read
+	if(!reader.Open(opts.Input))
 	{
 		std::cerr << "unable to open file for read: " << opts.Input << std::endl;
 		return -1;
 	}
 
 	// How big is it?
-	size_t len = reader.tellg();
-	if (len > MASK31)
-	{
-		std::cerr << "Input file too large according to spec. Must be less than 2GiB" << std::endl;
-		return -1;
-	}
+	uint64_t len = reader.Size();
 
-	// Seek to the start of the file
-	reader.seekg(0, std::ios::beg);
-	// Open the output file for write in binary mode
-	writer.open(opts.Output, std::ios::binary | std::ios::out);
-
-	if(!writer.good())
+	// Open the output file for write
+	if(!writer.Open(opts.Output))
 	{
 		std::cerr << "Unable to open file for write: " << opts.Output << std::endl;
-		reader.close();
 		return -1;
 	}
 
-	char* buff;
+	// The file streams through a reader thread, the crypto workers, and a writer, a chunk at a time. CBC encryption chains
+	// every block to the one before, so only decryption (and ECB) can spread chunks across workers
+	auto sequential = opts.Action == libcrypto::Action::ENCRYPT && opts.Mode == libcrypto::Mode::CBC;
+	libcrypto::pipeline::Pipeline pipeline(STREAM_CHUNK_SIZE_BYTES, sequential ? 1 : opts.Workers);
+	std::atomic<int> result(libcrypto::SUCCESS);
+	uint64_t IV = 0;
 
 	if(opts.Action == libcrypto::Action::ENCRYPT)
 	{
-		// Create the first block containing the length of the file for padding purposes
-		auto headerBlock = libcrypto::Random32() << 32 | len;
-		auto needsPadding = len % 8 != 0;
-		auto buffSize = len + 8 + (needsPadding ? 8 - (len % 8) : 0);
-		buff = new char[buffSize]{ 0 };
+		// Derive the key from the passphrase with a fresh salt, and store both ahead of the ciphertext
+		if(opts.Passphrase)
+		{
+			char header[PASSPHRASE_HEADER_BYTES];
+			opts.MakeHeader(header);
+			if(!opts.DeriveKey(header))
+			{
+				std::cerr << "Unable to derive a key from the passphrase" << std::endl;
+				return -1;
+			}
+
+			writer.Write(header, PASSPHRASE_HEADER_BYTES);
+		}
 
-		// Include the length of the file so we can determine how much padding we used when decrypting
-		libcrypto::buffStuff64(buff, 0, headerBlock);
+		auto schedule = libcrypto::des::BuildSchedule(opts.Key);
 
-		// If we need padding, fill the last block with random data (it will be overwritten when we read the file)
-		if(needsPadding)
+		if(opts.Mode == libcrypto::Mode::CBC)
 		{
-			auto padding = libcrypto::Random64();
-			libcrypto::buffStuff64(buff, buffSize - 8, padding);
+			// Create a random IV, encrypt it, and write it to the file
+			IV = libcrypto::Random64();
+			char ivbuff[8]{0};
+			libcrypto::buffStuff64(ivbuff, 0, IV);
+			result = libcrypto::des::Encrypt(ivbuff, 8, schedule);
+			writer.Write(ivbuff, 8);
 		}
 
-		// Record the start time and read the file
-		auto ioStart = std::chrono::high_resolution_clock::now();
-		reader.read(buff + 8, len);
-		reader.close();
+		auto buffSize = len + 8 + (len % 8 != 0 ? 8 - (len % 8) : 0);
+		uint64_t remaining = len;
+
+		// The output is the header, the IV, then the encrypted file, so it can be sized before anything is written
+		writer.Reserve((opts.Passphrase ? PASSPHRASE_HEADER_BYTES : 0) + (opts.Mode == libcrypto::Mode::CBC ? 8 : 0) + buffSize);
 
-		// Hand off the buffer to the crypto library and record the runtime
-		auto start = std::chrono::high_resolution_clock::now();
-		int result;
-		if(opts.Mode == libcrypto::Mode::ECB)
+		auto read = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			// The first block holds the length of the file so we can determine how much padding we used when decrypting.
+			// Only the low 32 bits fit, which is enough to recover the rest from the size of the encrypted file
+			size_t filled = 0;
+			if(chunk.Index == 0)
+			{
+				libcrypto::buffStuff64(chunk.Data, 0, libcrypto::Random32() << 32 | (len & MASK32));
+				filled = 8;
+			}
+
+			auto count = static_cast<size_t>(remaining < chunk.Capacity - filled ? remaining : chunk.Capacity - filled);
+			chunk.Length = filled + count;
+			chunk.Last = count == remaining;
+
+			// If the last chunk needs padding, fill its last block with random data (the end of the file overwrites the front)
+			if(chunk.Last && chunk.Length % 8 != 0)
+			{
+				chunk.Length += 8 - chunk.Length % 8;
+				libcrypto::buffStuff64(chunk.Data, chunk.Length - 8, libcrypto::Random64());
+			}
+
+			if(!reader.Read(chunk.Data + filled, count))
+			{
+				std::cerr << "Unable to read " << opts.Input << std::endl;
+				return false;
+			}
+
+			remaining -= count;
+			return true;
+		};
+
+		auto transform = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			int status;
+			if(opts.Mode == libcrypto::Mode::ECB)
+			{
+				status = libcrypto::des::Encrypt(chunk.Data, chunk.Length, schedule);
+			}
+			else
+			{
+				// The last ciphertext block chains into the next chunk
+				status = libcrypto::des::Encrypt(chunk.Data, chunk.Length, schedule, IV);
+				IV = _byteswap_uint64(reinterpret_cast<uint64_t*>(chunk.Data)[chunk.Length / 8 - 1]);
+			}
+
+			if (status != libcrypto::SUCCESS) result = status;
+			return status == libcrypto::SUCCESS;
+		};
+
+		auto write = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			return writer.Write(chunk.Data, chunk.Length);
+		};
+
+		auto ok = result == libcrypto::SUCCESS && pipeline.Run(read, transform, write);
+		auto written = writer.Close();
+
+		// Tell the user what happened
+		if(result != libcrypto::SUCCESS)
 		{
-			result = libcrypto::des::Encrypt(buff, buffSize, opts.Key);
+			std::cerr << "DES Failed with result " << result << std::endl;
+		}
+		else if(!written)
+		{
+			std::cerr << "Unable to write " << opts.Output << std::endl;
+			return -1;
+		}
+		else if(!ok)
+		{
+			return -1;
 		}
 		else
 		{
-			// Create a random IV, encrypt it, and write it to the file
-			auto IV = libcrypto::Random64();
-			char ivbuff[8]{0};
-			libcrypto::buffStuff64(ivbuff, 0, IV);
-			libcrypto::des::Encrypt(ivbuff, 8, opts.Key);
-			writer.write(ivbuff, 8);
+			std::cout << "Encrypted " << buffSize << " bytes in " << pipeline.Milliseconds() << "ms" << std::endl;
+			pipeline.Report(std::cout);
+			std::cout << "\ti/o:    " << reader.Kind() << " reads, " << writer.Kind() << " writes" << std::endl;
+		}
+	}
+	else if(opts.Action == libcrypto::Action::DECRYPT)
+	{
+		// Recover the key from the passphrase with the salt and iteration count it was encrypted with
+		if(opts.Passphrase)
+		{
+			char header[PASSPHRASE_HEADER_BYTES];
+			if(len < PASSPHRASE_HEADER_BYTES || !reader.Read(header, PASSPHRASE_HEADER_BYTES) || !opts.DeriveKey(header))
+			{
+				std::cerr << "Missing or corrupt passphrase header. The file was not encrypted with a passphrase" << std::endl;
+				return -1;
+			}
+
+			len -= PASSPHRASE_HEADER_BYTES;
+		}
 
-			// Encrypt using our IV
-			result = libcrypto::des::Encrypt(buff, buffSize, opts.Key, IV);
+		// Valid files are a multiple of 8 bytes, with room for the length block (and the IV in CBC mode)
+		if(len % 8 != 0 || len < (opts.Mode == libcrypto::Mode::CBC ? 16u : 8u))
+		{
+			std::cerr << "Input file not a multiple of 8 bytes. The file is corrupt, not complete, or is not a DES Encrypted file" << std::endl;
+			return -1;
 		}
-		auto end = std::chrono::high_resolution_clock::now();
-		std::chrono::duration<double, std::milli> duration = end - start;
 
-		// If encryption was a success, write the buffer to the output file
-		if(result == libcrypto::SUCCESS)
+		auto schedule = libcrypto::des::BuildSchedule(opts.Key);
+
+		// The ciphertext block before each chunk, starting with the decrypted IV
+		char previous[8]{0};
+		if(opts.Mode == libcrypto::Mode::CBC)
 		{
-			writer.write(buff, buffSize);
+			reader.Read(previous, 8);
+			result = libcrypto::des::Decrypt(previous, 8, schedule);
+			len -= 8;
 		}
-		writer.close();
 
-		// Clean up
-		delete[] buff;
-		auto ioEnd = std::chrono::high_resolution_clock::now();
+		uint64_t remaining = len;
+		uint64_t unwritten = 0;
 
-		std::chrono::duration<double, std::milli> ioTime = ioEnd - ioStart - duration;
+		auto read = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			chunk.Length = static_cast<size_t>(remaining < chunk.Capacity ? remaining : chunk.Capacity);
+			if(!reader.Read(chunk.Data, chunk.Length))
+			{
+				std::cerr << "Unable to read " << opts.Input << std::endl;
+				return false;
+			}
+
+			// Each chunk carries the block it chains from, so the chunks can be decrypted in any order
+			memcpy(chunk.Previous, previous, 8);
+			memcpy(previous, chunk.Data + chunk.Length - 8, 8);
+
+			remaining -= chunk.Length;
+			chunk.Last = remaining == 0;
+			return true;
+		};
+
+		auto transform = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			int status;
+			if(opts.Mode == libcrypto::Mode::ECB)
+			{
+				status = libcrypto::des::Decrypt(chunk.Data, chunk.Length, schedule);
+			}
+			else
+			{
+				auto chain = _byteswap_uint64(reinterpret_cast<uint64_t*>(chunk.Previous)[0]);
+				status = libcrypto::des::Decrypt(chunk.Data, chunk.Length, schedule, chain);
+			}
+
+			if (status != libcrypto::SUCCESS) result = status;
+			return status == libcrypto::SUCCESS;
+		};
+
+		auto write = [&](libcrypto::pipeline::Chunk& chunk)
+		{
+			// Read the original length from the decrypted file, before writing anything
+			size_t skip = 0;
+			if(chunk.Index == 0)
+			{
+				unwritten = originalLength(_byteswap_uint64(reinterpret_cast<uint64_t*>(chunk.Data)[0]) & MASK32, len - 8);
+
+				// If we didn't decrypt the file successfully, warn the user
+				if(unwritten > len - 8)
+				{
+					std::cerr << "Decrypted length does not match the file. The file is corrupted or is not a DES file" << std::endl;
+					return false;
+				}
+
+				// Now the length is known, the output can be sized before anything is written
+				writer.Reserve(unwritten);
+				skip = 8;
+			}
+
+			// Write the chunk, excluding the header and padding
+			auto count = static_cast<size_t>(chunk.Length - skip < unwritten ? chunk.Length - skip : unwritten);
+			unwritten -= count;
+			return writer.Write(chunk.Data + skip, count);
+		};
+
+		auto ok = result == libcrypto::SUCCESS && pipeline.Run(read, transform, write);
+		auto written = writer.Close();
 
 		// Tell the user what happened
 		if(result != libcrypto::SUCCESS)
 		{
 			std::cerr << "DES Failed with result " << result << std::endl;
 		}
+		else if(!written)
+		{
+			std::cerr << "Unable to write " << opts.Output << std::endl;
+			return -1;
+		}
+		else if(!ok)
+		{
+			return -1;
+		}
 		else
 		{
-			std::cout << "Encrypted " << buffSize << " bytes in " << duration.count() << "ms (+" << ioTime.count() << "ms i/o)" << std::endl;
+			std::cout << "Decrypted " << len << " bytes in " << pipeline.Milliseconds() << "ms" << std::endl;
+			pipeline.Report(std::cout);
+			std::cout << "\ti/o:    " << reader.Kind() << " reads, " << writer.Kind() << " writes" << std::endl;
 		}
 	}
-	else if(opts.Action == libcrypto::Action::DECRYPT)
+	else
 	{
-		// Valid files are a multiple of 8 bytes
-		if(len % 8 != 0)
+		return -1;
+	}
+}
+
+/**
+ * Encrypt or decrypt between memory mappings of the input and output files, or within the input's own mapping when they
+ * are the same file. Nothing passes through a staging buffer, and in place there is never a second copy of the file on disk
+ */
+int mapped(Options& opts)
+{
+	auto inPlace = libcrypto::mapping::SameFile(opts.Input, opts.Output);
+	libcrypto::mapping::MappedFile input, output;
+	auto& target = inPlace ? input : output;
+
+	if(!input.Open(opts.Input, inPlace))
+	{
+		std::cerr << "unable to open file for read: " << opts.Input << std::endl;
+		return -1;
+	}
+
+	auto len = input.Size();
+	auto cbc = opts.Mode == libcrypto::Mode::CBC;
+	std::atomic<int> result(libcrypto::SUCCESS);
+
+	// The passphrase header and the IV come first, then the length block, the file, and the padding
+	uint64_t prefix = (opts.Passphrase ? PASSPHRASE_HEADER_BYTES : 0) + (cbc ? 8 : 0);
+	char header[PASSPHRASE_HEADER_BYTES];
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if(opts.Action == libcrypto::Action::ENCRYPT)
+	{
+		// Derive the key from the passphrase with a fresh salt, to be stored ahead of the ciphertext
+		if(opts.Passphrase)
 		{
-			std::cerr << "Input file not a multiple of 8 bytes. The file is corrupt, not complete, or is not a DES Encrypted file" << std::endl;
-			reader.close();
+			opts.MakeHeader(header);
+			if(!opts.DeriveKey(header))
+			{
+				std::cerr << "Unable to derive a key from the passphrase" << std::endl;
+				return -1;
+			}
+		}
+
+		auto schedule = libcrypto::des::BuildSchedule(opts.Key);
+		auto buffSize = len + 8 + (len % 8 != 0 ? 8 - (len % 8) : 0);
+
+		if((!inPlace && !output.Open(opts.Output, true, true)) || !target.Resize(prefix + buffSize))
+		{
+			std::cerr << "Unable to open file for write: " << opts.Output << std::endl;
 			return -1;
 		}
 
-		// Record the start time and read the file
-		auto ioStart = std::chrono::high_resolution_clock::now();
-		buff = new char[len];
-		reader.read(buff, len);
-		reader.close();
+		auto out = target.Map();
+		const char* in = inPlace ? out : input.Map();
+		if(out == nullptr || (in == nullptr && len > 0))
+		{
+			std::cerr << "Unable to map " << opts.Input << " and " << opts.Output << std::endl;
+			return -1;
+		}
+
+		// In place, the file moves up past the headers first
+		auto body = out + prefix;
+		if (inPlace) memmove(body + 8, out, static_cast<size_t>(len));
+		if (opts.Passphrase) memcpy(out, header, PASSPHRASE_HEADER_BYTES);
 
-		// Hand off the buffer to the crypto library and record the runtime
-		auto start = std::chrono::high_resolution_clock::now();
-		int result;
-		if(opts.Mode == libcrypto::Mode::ECB)
+		// Create a random IV, encrypt it, and write it to the file
+		char first[8]{0};
+		if(cbc)
 		{
-			result = libcrypto::des::Decrypt(buff, len, opts.Key);
+			libcrypto::buffStuff64(first, 0, libcrypto::Random64());
+			memcpy(body - 8, first, 8);
+			result = libcrypto::des::Encrypt(body - 8, 8, schedule);
 		}
-		else
+
+		// The length block (see main), then random padding after the end of the file
+		libcrypto::buffStuff64(body, 0, libcrypto::Random32() << 32 | (len & MASK32));
+		auto padding = libcrypto::Random64();
+		memcpy(body + 8 + len, &padding, static_cast<size_t>(buffSize - 8 - len));
+
+		auto transform = [&](char* data, uint64_t offset, size_t count, const char* previous)
 		{
-			// Decrypt the IV
-			libcrypto::des::Decrypt(buff, 8, opts.Key);
+			// Copy the part of the file that lands in this chunk across from the input mapping
+			if(!inPlace)
+			{
+				auto from = offset < 8 ? 8 : offset;
+				auto to = offset + count < 8 + len ? offset + count : 8 + len;
+				if (to > from) memcpy(body + from, in + from - 8, static_cast<size_t>(to - from));
+			}
 
-			auto IV = _byteswap_uint64(reinterpret_cast<uint64_t*>(buff)[0]);
+			auto status = previous == nullptr
+				? libcrypto::des::Encrypt(data, count, schedule)
+				: libcrypto::des::Encrypt(data, count, schedule, extract64FromBuff(previous, 0));
 
-			buff += 8;
-			len -= 8;
+			if (status != libcrypto::SUCCESS) result = status;
+			return status == libcrypto::SUCCESS;
+		};
+
+		libcrypto::mapping::Region region = { body, buffSize, inPlace ? body : in, cbc ? body : nullptr, first, true };
+		auto transformed = result == libcrypto::SUCCESS && libcrypto::mapping::TransformRegion(region, 8, opts.Workers, transform);
 
-			// Decrypt the rest of the file using the decrypted IV
-			result = libcrypto::des::Decrypt(buff, len, opts.Key, IV);
+		target.Unmap();
+		std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+
+		if(result != libcrypto::SUCCESS)
+		{
+			std::cerr << "DES Failed with result " << result << std::endl;
+			return -1;
 		}
-		auto end = std::chrono::high_resolution_clock::now();
-		std::chrono::duration<double, std::milli> duration = end - start;
 
-		// Read the original length from the decrypted file
-		auto originalLength = _byteswap_uint64(reinterpret_cast<uint64_t*>(buff)[0]) & MASK32;
+		if(!transformed)
+		{
+			std::cerr << "Unable to read " << opts.Input << " through its mapping (was it truncated, or did the disk fail?)" << std::endl;
+			return -1;
+		}
 
-		// If we didn't decrypt the file successfully, warn the user
-		if(originalLength > MASK31 || originalLength > len)
+		std::cout << "Encrypted " << buffSize << " bytes in " << duration.count() << "ms (mapped" << (inPlace ? ", in place)" : ")") << std::endl;
+	}
+	else if(opts.Action == libcrypto::Action::DECRYPT)
+	{
+		// Valid files are a multiple of 8 bytes after the headers, with room for the length block
+		if(len < prefix + 8 || (len - prefix) % 8 != 0)
 		{
-			std::cerr << "Decrypted length too large. The file is corrupted or is not a DES file" << std::endl;
-			writer.close();
-			if (opts.Mode == libcrypto::Mode::CBC) buff -= 8;
-			delete[] buff;
+			std::cerr << "Input file not a multiple of 8 bytes. The file is corrupt, not complete, or is not a DES Encrypted file" << std::endl;
+			return -1;
+		}
 
+		auto in = input.Map();
+		if(in == nullptr)
+		{
+			std::cerr << "Unable to map " << opts.Input << std::endl;
 			return -1;
 		}
 
-		// If we decrypted the file successfully, write the buffer (excluding the header and padding)
-		if(result == libcrypto::SUCCESS)
+		// Recover the key from the passphrase with the salt and iteration count it was encrypted with
+		if(opts.Passphrase)
 		{
-			writer.write(buff + 8, originalLength);
+			memcpy(header, in, PASSPHRASE_HEADER_BYTES);
+			if(!opts.DeriveKey(header))
+			{
+				std::cerr << "Missing or corrupt passphrase header. The file was not encrypted with a passphrase" << std::endl;
+				return -1;
+			}
 		}
-		writer.close();
-		
-		// Cleanup
-		if (opts.Mode == libcrypto::Mode::CBC) buff -= 8;
-		delete[] buff;
-		auto ioEnd = std::chrono::high_resolution_clock::now();
 
-		std::chrono::duration<double, std::milli> ioTime = ioEnd - ioStart - duration;
+		auto schedule = libcrypto::des::BuildSchedule(opts.Key);
+		auto body = in + prefix;
+		auto ciphertext = body + 8;
+		auto payload = len - prefix - 8;
+
+		// Decrypt the IV, then the length block with it
+		char block[8];
+		memcpy(block, body, 8);
+		if(cbc)
+		{
+			char iv[8];
+			memcpy(iv, body - 8, 8);
+			result = libcrypto::des::Decrypt(iv, 8, schedule);
+			if (result == libcrypto::SUCCESS) result = libcrypto::des::Decrypt(block, 8, schedule, extract64FromBuff(iv, 0));
+		}
+		else
+		{
+			result = libcrypto::des::Decrypt(block, 8, schedule);
+		}
 
-		// Tell the user what happened
 		if(result != libcrypto::SUCCESS)
 		{
 			std::cerr << "DES Failed with result " << result << std::endl;
+			return -1;
+		}
+
+		// If we didn't decrypt the file successfully, warn the user before anything is written
+		auto length = originalLength(extract64FromBuff(block, 0) & MASK32, payload);
+		if(length > payload)
+		{
+			std::cerr << "Decrypted length does not match the file. The file is corrupted or is not a DES file" << std::endl;
+			return -1;
+		}
+
+		// The last block is only partly kept, so it is decrypted on its own before any ciphertext is overwritten
+		auto full = length / 8 * 8;
+		if(length > full)
+		{
+			memcpy(block, ciphertext + full, 8);
+			result = cbc ? libcrypto::des::Decrypt(block, 8, schedule, extract64FromBuff(body, static_cast<size_t>(full))) : libcrypto::des::Decrypt(block, 8, schedule);
+		}
+
+		// Out of place, the file goes to the start of a new one. In place, it is decrypted where it is and moved down after
+		char* out;
+		if(inPlace)
+		{
+			out = body + 8;
 		}
 		else
 		{
-			std::cout << "Decrypted " << len << " bytes in " << duration.count() << "ms (+" << ioTime.count() << "ms i/o)" << std::endl;
+			if(!output.Open(opts.Output, true, true) || !output.Resize(length))
+			{
+				std::cerr << "Unable to open file for write: " << opts.Output << std::endl;
+				return -1;
+			}
+
+			out = output.Map();
+			if(out == nullptr && length > 0)
+			{
+				std::cerr << "Unable to map " << opts.Output << std::endl;
+				return -1;
+			}
 		}
+
+		auto transform = [&](char* data, uint64_t offset, size_t count, const char* previous)
+		{
+			if (!inPlace) memcpy(data, ciphertext + offset, count);
+
+			auto status = previous == nullptr
+				? libcrypto::des::Decrypt(data, count, schedule)
+				: libcrypto::des::Decrypt(data, count, schedule, extract64FromBuff(previous, 0));
+
+			if (status != libcrypto::SUCCESS) result = status;
+			return status == libcrypto::SUCCESS;
+		};
+
+		// The length block chains into the rest of the file
+		libcrypto::mapping::Region region = { out, full, ciphertext, cbc ? ciphertext : nullptr, body, false };
+		auto transformed = result == libcrypto::SUCCESS && (full == 0 || libcrypto::mapping::TransformRegion(region, 8, opts.Workers, transform));
+
+		if(result != libcrypto::SUCCESS)
+		{
+			std::cerr << "DES Failed with result " << result << std::endl;
+			return -1;
+		}
+
+		if(!transformed)
+		{
+			std::cerr << "Unable to read " << opts.Input << " through its mapping (was it truncated, or did the disk fail?)" << std::endl;
+			return -1;
+		}
+
+		if (length > full) memcpy(out + full, block, static_cast<size_t>(length - full));
+
+		// Move the file down over the headers and cut off the padding
+		if(inPlace)
+		{
+			memmove(in, out, static_cast<size_t>(length));
+			input.Unmap();
+			if(!input.Resize(length))
+			{
+				std::cerr << "Unable to truncate " << opts.Input << std::endl;
+				return -1;
+			}
+		}
+		output.Unmap();
+
+		std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+		std::cout << "Decrypted " << len - prefix << " bytes in " << duration.count() << "ms (mapped" << (inPlace ? ", in place)" : ")") << std::endl;
 	}
 	else
 	{
 		return -1;
 	}
+
+	return 0;
+}
+
+/**
+ * Recover the length of the plaintext from the low 32 bits stored in the length block and the number of bytes after it.
+ * Padding is less than a block, so only one length in (payload - 8, payload] matches. Returns a length past the payload
+ * if none does, which means the file is corrupt or the key is wrong
+ */
+uint64_t originalLength(uint64_t stored, uint64_t payload)
+{
+	auto padding = (payload - stored) & MASK32;
+	return padding < 8 && padding <= payload ? payload - padding : payload + 1;
 }
 
 /**
@@ -238,7 +603,7 @@ int main(int argc, char* argv[])
  */
 void printHelp()
 {
-	std::cout << "DES <action> <key> <mode> <in> <out>" << std::endl << std::endl;
+	std::cout << "DES <action> <key> <mode> <in> <out> [-p] [-i iterations] [-j workers] [-m]" << std::endl << std::endl;
 
 	std::cout << "\tAction: -e: encrypt, -d: decrypt" << std::endl;
 	std::cout << "\tKey:    an 8-byte hex or ascii sequence (16 hex digits or 8 characters)" << std::endl;
@@ -247,5 +612,12 @@ void printHelp()
 	std::cout << "\tMode:   CBC or ECB" << std::endl;
 	std::cout << "\tIn:     The path to the input file" << std::endl;
 	std::cout << "\tOut:    The path to the output file" << std::endl;
+	std::cout << "\t-p:     Treat the key as a passphrase and derive the key with PBKDF2-HMAC-SHA512" << std::endl;
+	std::cout << "\t        The salt, iteration count and key size are stored at the start of the encrypted file" << std::endl;
+	std::cout << "\t-i:     The number of PBKDF2 iterations when encrypting (default " << DEFAULT_PASSPHRASE_ITERATIONS << ", at most " << MAX_PASSPHRASE_ITERATIONS << ")" << std::endl;
+	std::cout << "\t-j:     The number of threads to encrypt or decrypt on (default: one per core)" << std::endl;
+	std::cout << "\t        CBC encryption chains every block to the last, so it always runs on one" << std::endl;
+	std::cout << "\t-m:     Memory-map the files and encrypt from one mapping straight into the other" << std::endl;
+	std::cout << "\t        If In and Out are the same file, it is encrypted in place (and is lost if interrupted)" << std::endl;
 }
 
@@ -24,18 +24,66 @@
 
 #pragma once
 #include <stdlib.h>
+#include <cstring>
 #include <string>
 #include <algorithm>
 #include <iostream>
 #include <regex>
+#include <thread>
 #include "../libcrypto/libcrypto.h"
 #include "../libcrypto/Util.h"
+#include "../libcrypto/Hashing/Passphrase.h"
+#include "../libcrypto/Mapping.h"
 
 /**
  * A class for parsing command-line options
  */
 class Options
 {
+private:
+	/** Parse the optional flags that follow the output path */
+	bool parseFlags(int argc, char* argv[])
+	{
+		for(auto i = 6; i < argc; i++)
+		{
+			std::string flag(argv[i]);
+			std::transform(flag.begin(), flag.end(), flag.begin(), ::tolower);
+
+			if(flag == "-p")
+			{
+				Passphrase = true;
+			}
+			else if(flag == "-m")
+			{
+				Mapped = true;
+			}
+			else if(flag == "-i" && i + 1 < argc)
+			{
+				Iterations = strtoul(argv[++i], nullptr, 10);
+				if(Iterations == 0 || Iterations > MAX_PASSPHRASE_ITERATIONS)
+				{
+					std::cerr << "Iterations must be between 1 and " << MAX_PASSPHRASE_ITERATIONS << std::endl;
+					return false;
+				}
+			}
+			else if(flag == "-j" && i + 1 < argc)
+			{
+				Workers = strtoul(argv[++i], nullptr, 10);
+				if(Workers == 0)
+				{
+					std::cerr << "Workers must be a positive number" << std::endl;
+					return false;
+				}
+			}
+			else
+			{
+				std::cerr << "Unknown option " << flag << std::endl;
+				return false;
+			}
+		}
+
+		return true;
+	}
 public:
 	/** The action to perform */
 	libcrypto::Action Action = libcrypto::Action::UNKNOWN_ACTION;
@@ -49,6 +97,17 @@ public:
 	/** The path to the output file */
 	std::string Output;
 
+	/** True iff the key is a passphrase to derive the key from (see DeriveKey) */
+	bool Passphrase = false;
+	/** The passphrase, if Passphrase is set */
+	std::string Secret;
+	/** The number of PBKDF2 iterations when encrypting with a passphrase */
+	uint32_t Iterations = DEFAULT_PASSPHRASE_ITERATIONS;
+	/** The number of threads to encrypt or decrypt on. CBC encryption is sequential, so it always uses one */
+	unsigned int Workers = std::thread::hardware_concurrency();
+	/** True iff the files are memory-mapped and transformed from one mapping into the other (or within one, in place) */
+	bool Mapped = false;
+
 	/** Whether or not errors were encountered */
 	bool Errors = false;
 
@@ -57,7 +116,7 @@ public:
 	 */
 	Options(int argc, char* argv[])
 	{
-		if(argc != 6)
+		if(argc < 6 || !parseFlags(argc, argv))
 		{
 			Errors = true;
 			return;
@@ -82,7 +141,11 @@ public:
 		}
 
 		std::string key(argv[2]);
-		if(key.length() == 16 && std::regex_match(key, std::regex("^[0-9a-fA-F]{16}$")))
+		if(Passphrase)
+		{
+			Secret = key;
+		}
+		else if(key.length() == 16 && std::regex_match(key, std::regex("^[0-9a-fA-F]{16}$")))
 		{
 			// Hex Digits
 			Key = strtoull(key.c_str(), static_cast<char **>(nullptr), 16);
@@ -143,5 +206,43 @@ public:
 
 		Input = std::string(argv[4]);
 		Output = std::string(argv[5]);
+
+		// Opening the output would truncate the input before it is read
+		if(!Mapped && libcrypto::mapping::SameFile(Input, Output))
+		{
+			std::cerr << "The input and output are the same file. Use -m to encrypt or decrypt it in place" << std::endl;
+			Errors = true;
+		}
+	}
+
+	/**
+	 * Fill a new passphrase header with a random salt, the iteration count and the key size, to be stored ahead of the
+	 * ciphertext
+	 */
+	void MakeHeader(char* header) const
+	{
+		libcrypto::hashing::Passphrase::MakeHeader(Iterations, sizeof(Key) * 8, header);
+	}
+
+	/**
+	 * Derive the key from the passphrase with the salt and iteration count in the header. Returns false if the header is
+	 * corrupt or for a key that isn't 64 bits
+	 */
+	bool DeriveKey(const char* header)
+	{
+		char raw[8];
+		if(libcrypto::hashing::Passphrase::DeriveKey(Secret.c_str(), Secret.length(), header, raw, sizeof(raw)) != libcrypto::SUCCESS)
+		{
+			return false;
+		}
+
+		Key = 0;
+		for(auto i = 0; i < 8; i++)
+		{
+			Key = Key << 8 | charToUnsigned64(raw[i]);
+		}
+
+		memset(raw, 0, sizeof(raw));
+		return true;
 	}
 };
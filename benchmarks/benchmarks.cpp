@@ -29,8 +29,12 @@
 #include <iostream>
 #include <ctime>
 #include <chrono>
+#include <intrin.h>
 #include "../libcrypto/AES/AES.h"
+#include "../libcrypto/Allocations.h"
 #include "../libcrypto/Hashing/SHA512.h"
+#include "../libcrypto/Hashing/SHA512Simd.h"
+#include "../libcrypto/Hashing/BLAKE2b.h"
 
 
 /** The minimum size in bytes to benchmark for DES */
@@ -51,6 +55,16 @@
 #define SHA512_MAX_SIZE 256 * 1024 * 1024
 #define SHA512_STEP_SIZE (SHA512_MAX_SIZE - SHA512_MIN_SIZE)/63
 
+/** The number of messages hashed per data point in the SHA512 batch benchmark */
+#define SHA512_BATCH_COUNT 1024 * 1024
+/** The message sizes in bytes to benchmark for SHA512 batches (small object IDs up to a few blocks) */
+const size_t SHA512_BATCH_SIZES[] = { 16, 64, 111, 112, 128, 256, 1024 };
+
+/** The message sizes in bytes to compare the 64-bit hashes on, from a few blocks to far bigger than the caches */
+const size_t HASH_COMPARE_SIZES[] = { 256, 4 * 1024, 64 * 1024, 1024 * 1024, 64 * 1024 * 1024 };
+/** The number of bytes hashed per data point when comparing the 64-bit hashes (messages are repeated up to this) */
+#define HASH_COMPARE_BYTES (256 * 1024 * 1024)
+
 /**
  * Fill the specified buffer with random bytes
  */
@@ -67,7 +81,7 @@ void fillbuff(std::mt19937_64& random, char* buff, size_t len)
 }
 
 /**
- * Benchmark the performance of DES (both ECB and CBC Mode)
+ * Benchmark the performance of DES (ECB, CBC, CTR, and OFB Mode)
  */
 void benchmarkDES()
 {
@@ -75,9 +89,10 @@ void benchmarkDES()
 	std::cout << "Initializing data" << std::endl;
 	std::mt19937_64 random;
 	auto buff = new char[DES_MAX_SIZE];
+	auto keystream = new char[DES_MAX_SIZE];
 	fillbuff(random, buff, DES_MAX_SIZE);
 
-	std::cout << "bytes\tECB Encrypt\tECB Decrypt\tCBC Encrypt\tCBC Decrypt" << std::endl;
+	std::cout << "bytes\tECB Encrypt\tECB Decrypt\tCBC Encrypt\tCBC Decrypt\tCTR\tOFB\tCTR Keystream\tKeystream XOR" << std::endl;
 	for(auto i = DES_MIN_SIZE; i <= DES_MAX_SIZE; i += DES_STEP_SIZE)
 	{
 		auto key = random();
@@ -104,9 +119,33 @@ void benchmarkDES()
 		std::chrono::duration<double, std::milli> cbc_enc = cbc_enc_end - cbc_enc_start;
 		std::chrono::duration<double, std::milli> cbc_dec = cbc_dec_end - cbc_dec_start;
 
-		std::cout << i << "\t" << ecb_enc.count() << "\t" << ecb_dec.count() << "\t" << cbc_enc.count() << "\t" << cbc_dec.count() << std::endl;
+		auto ctr_start = std::chrono::high_resolution_clock::now();
+		libcrypto::des::Encrypt(buff, i, key, iv, libcrypto::Mode::CTR);
+		auto ctr_end = std::chrono::high_resolution_clock::now();
+
+		auto ofb_start = std::chrono::high_resolution_clock::now();
+		libcrypto::des::Encrypt(buff, i, key, iv, libcrypto::Mode::OFB);
+		auto ofb_end = std::chrono::high_resolution_clock::now();
+
+		// Precomputing the keystream moves the cipher off the critical path, leaving only the XOR once data arrives
+		auto keystream_start = std::chrono::high_resolution_clock::now();
+		libcrypto::des::Keystream(keystream, i, libcrypto::des::BuildSchedule(key), iv, libcrypto::Mode::CTR);
+		auto keystream_end = std::chrono::high_resolution_clock::now();
+
+		auto xor_start = std::chrono::high_resolution_clock::now();
+		libcrypto::des::ApplyKeystream(buff, i, keystream);
+		auto xor_end = std::chrono::high_resolution_clock::now();
+
+		std::chrono::duration<double, std::milli> ctr = ctr_end - ctr_start;
+		std::chrono::duration<double, std::milli> ofb = ofb_end - ofb_start;
+		std::chrono::duration<double, std::milli> ctr_keystream = keystream_end - keystream_start;
+		std::chrono::duration<double, std::milli> keystream_xor = xor_end - xor_start;
+
+		std::cout << i << "\t" << ecb_enc.count() << "\t" << ecb_dec.count() << "\t" << cbc_enc.count() << "\t" << cbc_dec.count()
+			<< "\t" << ctr.count() << "\t" << ofb.count() << "\t" << ctr_keystream.count() << "\t" << keystream_xor.count() << std::endl;
 	}
 
+	delete[] keystream;
 	delete[] buff;
 }
 
@@ -268,17 +307,208 @@ void benchmarkSHA512()
 	auto buff = new char[SHA512_MAX_SIZE];
 	fillbuff(random, buff, SHA512_MAX_SIZE);
 
-	std::cout << "bytes\ttime" << std::endl;
+	std::cout << "bytes\tScalar\tAVX2" << std::endl;
 	for (auto i = SHA512_MIN_SIZE; i <= SHA512_MAX_SIZE; i += SHA512_STEP_SIZE)
 	{
+		// Force the scalar compression function first, then let it dispatch to AVX2 if the processor has it
+		libcrypto::hashing::simd::SetEnabled(false);
+		auto start = std::chrono::high_resolution_clock::now();
+		char digest[SHA512_DIGEST_SIZE_BYTES];
+		libcrypto::hashing::SHA512::ComputeHash(buff, i, digest);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::chrono::duration<double, std::milli> scalar = end - start;
+		std::cout << i << "\t" << scalar.count() << "\t";
+
+		libcrypto::hashing::simd::SetEnabled(true);
+		if(libcrypto::hashing::simd::Supported())
+		{
+			start = std::chrono::high_resolution_clock::now();
+			libcrypto::hashing::SHA512::ComputeHash(buff, i, digest);
+			end = std::chrono::high_resolution_clock::now();
+
+			std::chrono::duration<double, std::milli> vectorized = end - start;
+			std::cout << vectorized.count();
+		}
+		else
+		{
+			std::cout << "-";
+		}
+
+		std::cout << std::endl;
+	}
+
+	delete[] buff;
+}
+
+/**
+ * Benchmark hashing many small messages one at a time against hashing them as a multi-buffer batch
+ */
+void benchmarkSHA512Batch()
+{
+	std::cout << std::endl << std::endl << "Benchmarking sha512 batches" << std::endl << "----------------" << std::endl;
+	std::cout << "Initializing data" << std::endl;
+	std::mt19937_64 random;
+	auto maxSize = SHA512_BATCH_SIZES[sizeof(SHA512_BATCH_SIZES) / sizeof(size_t) - 1];
+	auto buff = new char[SHA512_BATCH_COUNT * maxSize];
+	fillbuff(random, buff, SHA512_BATCH_COUNT * maxSize);
+
+	auto messages = new const char*[SHA512_BATCH_COUNT];
+	auto lengths = new size_t[SHA512_BATCH_COUNT];
+	auto digests = new char[SHA512_BATCH_COUNT * SHA512_DIGEST_SIZE_BYTES];
+
+	std::cout << SHA512_BATCH_COUNT << " messages per size, " << libcrypto::hashing::simd::Lanes() << " lanes" << std::endl;
+	std::cout << "bytes\tOne at a time\tBatch" << std::endl;
+	for(auto size : SHA512_BATCH_SIZES)
+	{
+		for(auto i = 0; i < SHA512_BATCH_COUNT; i++)
+		{
+			messages[i] = buff + i * size;
+			lengths[i] = size;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for(auto i = 0; i < SHA512_BATCH_COUNT; i++)
+		{
+			libcrypto::hashing::Sha512 hasher;
+			hasher.Update(messages[i], lengths[i]);
+			hasher.Final(digests + i * SHA512_DIGEST_SIZE_BYTES);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double, std::milli> single = end - start;
+
+		start = std::chrono::high_resolution_clock::now();
+		libcrypto::hashing::SHA512::ComputeHashes(messages, lengths, digests, SHA512_BATCH_COUNT);
+		end = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double, std::milli> batch = end - start;
+
+		std::cout << size << "\t" << single.count() << "\t" << batch.count() << std::endl;
+	}
+
+	delete[] digests;
+	delete[] lengths;
+	delete[] messages;
+	delete[] buff;
+}
+
+/**
+ * Benchmark hashing small messages one at a time through the overload that returns a new digest against the one that
+ * writes into the caller's buffer, counting the heap allocations per hash in debug builds. Returns false if the first
+ * does not allocate its digest, or the second allocates anything
+ */
+bool benchmarkSHA512Small()
+{
+	std::cout << std::endl << std::endl << "Benchmarking sha512 small messages" << std::endl << "----------------" << std::endl;
+	std::cout << "Initializing data" << std::endl;
+	std::mt19937_64 random;
+	auto maxSize = SHA512_BATCH_SIZES[sizeof(SHA512_BATCH_SIZES) / sizeof(size_t) - 1];
+	auto buff = new char[SHA512_BATCH_COUNT * maxSize];
+	fillbuff(random, buff, SHA512_BATCH_COUNT * maxSize);
+
+	const double count = SHA512_BATCH_COUNT;
+	std::cout << SHA512_BATCH_COUNT << " messages per size" << std::endl;
+	auto counting = libcrypto::allocations::Count();
+	if (!counting) std::cout << "Allocations are only counted in debug builds" << std::endl;
+	std::cout << "bytes\tNew digest (ns/hash)\tAllocations/hash\tCaller buffer (ns/hash)\tAllocations/hash" << std::endl;
+	for(auto size : SHA512_BATCH_SIZES)
+	{
+		// Touch every digest so none of the hashing can be optimized away
+		volatile char sink = 0;
+
+		auto before = libcrypto::allocations::HeapAllocations();
 		auto start = std::chrono::high_resolution_clock::now();
-		auto digest = libcrypto::hashing::SHA512::ComputeHash(buff, i);
+		for(auto i = 0; i < SHA512_BATCH_COUNT; i++)
+		{
+			auto digest = libcrypto::hashing::SHA512::ComputeHash(buff + i * size, size);
+			sink ^= digest[0];
+			delete[] digest;
+		}
 		auto end = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double, std::nano> allocating = end - start;
+		auto allocatingCount = libcrypto::allocations::HeapAllocations() - before;
+
+		before = libcrypto::allocations::HeapAllocations();
+		start = std::chrono::high_resolution_clock::now();
+		for(auto i = 0; i < SHA512_BATCH_COUNT; i++)
+		{
+			char digest[SHA512_DIGEST_SIZE_BYTES];
+			libcrypto::hashing::SHA512::ComputeHash(buff + i * size, size, digest);
+			sink ^= digest[0];
+		}
+		end = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double, std::nano> direct = end - start;
+		auto directCount = libcrypto::allocations::HeapAllocations() - before;
 
-		std::chrono::duration<double, std::milli> duration = end - start;
-		std::cout << i << "\t" << duration.count() << std::endl;
+		std::cout << size << "\t" << allocating.count() / count << "\t" << allocatingCount / count
+			<< "\t" << direct.count() / count << "\t" << directCount / count << std::endl;
 
-		delete[] digest;
+		if(counting && (allocatingCount < SHA512_BATCH_COUNT || directCount != 0))
+		{
+			std::cerr << "Expected at least one allocation per new digest and none with the caller's buffer" << std::endl;
+			delete[] buff;
+			return false;
+		}
+	}
+
+	delete[] buff;
+	return true;
+}
+
+/**
+ * The number of TSC cycles per byte it takes the hash function to hash the message repeatedly, HASH_COMPARE_BYTES in all.
+ * The TSC ticks at a fixed rate, which is close to the core clock unless it turbos
+ */
+template<typename Hash> double cyclesPerByte(const char* buff, size_t size, Hash hash)
+{
+	auto repeats = HASH_COMPARE_BYTES / size;
+	char digest[SHA512_DIGEST_SIZE_BYTES];
+
+	auto start = __rdtsc();
+	for(size_t i = 0; i < repeats; i++)
+	{
+		hash(buff, size, digest);
+	}
+	auto end = __rdtsc();
+
+	return static_cast<double>(end - start) / (repeats * size);
+}
+
+/**
+ * Compare SHA512 against BLAKE2b and BLAKE2bp in cycles per byte, with the scalar implementations and then with AVX2 (if
+ * the processor has it)
+ */
+void benchmarkBLAKE2b()
+{
+	std::cout << std::endl << std::endl << "Benchmarking blake2b" << std::endl << "----------------" << std::endl;
+	std::cout << "Initializing data" << std::endl;
+	std::mt19937_64 random;
+	auto maxSize = HASH_COMPARE_SIZES[sizeof(HASH_COMPARE_SIZES) / sizeof(size_t) - 1];
+	auto buff = new char[maxSize];
+	fillbuff(random, buff, maxSize);
+
+	auto sha512 = [](const char* m, size_t len, char* digest) { libcrypto::hashing::SHA512::ComputeHash(m, len, digest); };
+	auto blake2b = [](const char* m, size_t len, char* digest) { libcrypto::hashing::BLAKE2b::ComputeHash(m, len, digest); };
+	auto blake2bp = [](const char* m, size_t len, char* digest) { libcrypto::hashing::BLAKE2b::ComputeParallelHash(m, len, digest); };
+
+	std::cout << "cycles/byte" << std::endl;
+	std::cout << "bytes\tSHA512\tBLAKE2b\tBLAKE2bp\tSHA512 AVX2\tBLAKE2bp AVX2" << std::endl;
+	for(auto size : HASH_COMPARE_SIZES)
+	{
+		// BLAKE2b has no vectorized path of its own, so it only runs once
+		libcrypto::hashing::simd::SetEnabled(false);
+		std::cout << size << "\t" << cyclesPerByte(buff, size, sha512) << "\t" << cyclesPerByte(buff, size, blake2b) << "\t" << cyclesPerByte(buff, size, blake2bp) << "\t";
+
+		libcrypto::hashing::simd::SetEnabled(true);
+		if(libcrypto::hashing::simd::Supported())
+		{
+			std::cout << cyclesPerByte(buff, size, sha512) << "\t" << cyclesPerByte(buff, size, blake2bp);
+		}
+		else
+		{
+			std::cout << "-\t-";
+		}
+
+		std::cout << std::endl;
 	}
 
 	delete[] buff;
@@ -287,6 +517,7 @@ void benchmarkSHA512()
 int main(int argc, char* argv[])
 {
 	srand(time(nullptr));
+	auto failed = false;
 
 	for(auto i = 0; i < argc; i++)
 	{
@@ -311,8 +542,20 @@ int main(int argc, char* argv[])
 		{
 			benchmarkSHA512();
 		}
+		else if(arg == "sha512batch")
+		{
+			benchmarkSHA512Batch();
+		}
+		else if(arg == "sha512small")
+		{
+			failed |= !benchmarkSHA512Small();
+		}
+		else if(arg == "blake2b")
+		{
+			benchmarkBLAKE2b();
+		}
 	}
 
-    return 0;
+    return failed ? -1 : 0;
 }
 
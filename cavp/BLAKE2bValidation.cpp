@@ -0,0 +1,48 @@
+#include "stdafx.h"
+#include "ValidationTests.h"
+#include "../libcrypto/Hashing/BLAKE2b.h"
+#include "../libcrypto/Hashing/SHA512Simd.h"
+
+/** Hash the message all at once, then in uneven pieces (twice, to check Init), and compare against the expected digest */
+template<typename Hasher> int blake2_check(char* key, size_t keyLen, char* message, size_t len, char* expected, size_t digestLen,
+	void (*computeHash)(const char*, size_t, char*, size_t, const char*, size_t))
+{
+	char digest[BLAKE2B_DIGEST_SIZE_BYTES + 1];
+	digest[digestLen] = 0x5a;
+	computeHash(message, len, digest, digestLen * 8, key, keyLen);
+	if (!check(digest, expected, digestLen) || digest[digestLen] != 0x5a) return -28;
+
+	Hasher hasher(digestLen * 8, key, keyLen);
+	for(auto pass = 0; pass < 2; pass++)
+	{
+		hasher.Init();
+		for(size_t off = 0, piece = 1; off < len; off += piece, piece = piece * 5 % 523 + 1)
+		{
+			hasher.Update(message + off, piece < len - off ? piece : len - off);
+		}
+		hasher.Final(digest);
+		if (!check(digest, expected, digestLen)) return -28;
+	}
+
+	return 0;
+}
+
+int blake2_digest(bool parallel, char* key, size_t keyLen, char* message, size_t len, char* expected, size_t digestLen)
+{
+	return on_each_path(libcrypto::hashing::simd::SetEnabled, libcrypto::hashing::simd::Supported, [&]
+	{
+		return parallel
+			? blake2_check<libcrypto::hashing::Blake2bp>(key, keyLen, message, len, expected, digestLen, libcrypto::hashing::BLAKE2b::ComputeParallelHash)
+			: blake2_check<libcrypto::hashing::Blake2b>(key, keyLen, message, len, expected, digestLen, libcrypto::hashing::BLAKE2b::ComputeHash);
+	});
+}
+
+int blake2b_digest(char* key, size_t keyLen, char* message, size_t len, char* expected, size_t digestLen)
+{
+	return blake2_digest(false, key, keyLen, message, len, expected, digestLen);
+}
+
+int blake2bp_digest(char* key, size_t keyLen, char* message, size_t len, char* expected, size_t digestLen)
+{
+	return blake2_digest(true, key, keyLen, message, len, expected, digestLen);
+}
@@ -0,0 +1,102 @@
+#include "stdafx.h"
+#include <vector>
+#include "ValidationTests.h"
+#include "../libcrypto/DES/DES.h"
+#include "../libcrypto/DES/Simd.h"
+#include "../libcrypto/Util.h"
+
+/**
+ * Check a CTR or OFB known answer beyond the one-shot calls: the message through keystream precomputed with Keystream and
+ * applied with ApplyKeystream, split at every block boundary with the next IV handed from the first half to the second
+ */
+int des_keystream(libcrypto::Mode mode, const libcrypto::des::des_key_schedule_t& schedule, uint64_t iv, char* plaintext, char* expected, size_t len)
+{
+	std::vector<char> data(len);
+	std::vector<char> keystream(len + DES_BLOCK_SIZE_BYTES);
+	for(size_t split = 0; split <= len; split += DES_BLOCK_SIZE_BYTES)
+	{
+		uint64_t next = 0;
+		auto result = libcrypto::des::Keystream(keystream.data(), split, schedule, iv, mode, &next);
+		if (result == 0) result = libcrypto::des::Keystream(keystream.data() + split, len - split, schedule, next, mode);
+		if (result != 0) return result;
+
+		data.assign(plaintext, plaintext + len);
+		libcrypto::des::ApplyKeystream(data.data(), split, keystream.data());
+		libcrypto::des::ApplyKeystream(data.data() + split, len - split, keystream.data() + split);
+		if (!check(data.data(), expected, len)) return -22;
+	}
+
+	return 0;
+}
+
+/**
+ * Check an ECB or CBC known answer beyond the one-shot calls: the message encrypted and decrypted in two parts, split at
+ * every block boundary, with the last ciphertext block of the first part chaining into the second in CBC mode. The parts
+ * start and end part way through the groups of blocks the AVX2 implementation works on
+ */
+int des_split(libcrypto::Mode mode, const libcrypto::des::des_key_schedule_t& schedule, uint64_t iv, char* plaintext, char* expected, size_t len)
+{
+	std::vector<char> data(len);
+	for(size_t split = DES_BLOCK_SIZE_BYTES; split < len; split += DES_BLOCK_SIZE_BYTES)
+	{
+		auto next = mode == libcrypto::Mode::CBC ? extract64FromBuff(expected, split - DES_BLOCK_SIZE_BYTES) : iv;
+
+		data.assign(plaintext, plaintext + len);
+		auto result = libcrypto::des::Encrypt(data.data(), split, schedule, iv, mode);
+		if (result == 0) result = libcrypto::des::Encrypt(data.data() + split, len - split, schedule, next, mode);
+		if (result != 0) return result;
+		if (!check(data.data(), expected, len)) return -22;
+
+		result = libcrypto::des::Decrypt(data.data(), split, schedule, iv, mode);
+		if (result == 0) result = libcrypto::des::Decrypt(data.data() + split, len - split, schedule, next, mode);
+		if (result != 0) return result;
+		if (!check(data.data(), plaintext, len)) return -22;
+	}
+
+	return 0;
+}
+
+/** Check a known answer in any mode: the one-shot encryption and decryption, then the mode's own ways of splitting it up */
+int des_check(libcrypto::Mode mode, char* key, char* iv, char* plaintext, char* expected, size_t len)
+{
+	auto k = extract64FromBuff(key, 0);
+	auto i = extract64FromBuff(iv, 0);
+	auto schedule = libcrypto::des::BuildSchedule(k);
+
+	std::vector<char> data(plaintext, plaintext + len);
+	auto result = libcrypto::des::Encrypt(data.data(), len, k, i, mode);
+	if (result != 0) return result;
+	if (!check(data.data(), expected, len)) return -22;
+
+	result = libcrypto::des::Decrypt(data.data(), len, k, i, mode);
+	if (result != 0) return result;
+	if (!check(data.data(), plaintext, len)) return -22;
+
+	if (mode == libcrypto::Mode::CTR || mode == libcrypto::Mode::OFB) return des_keystream(mode, schedule, i, plaintext, expected, len);
+	return des_split(mode, schedule, i, plaintext, expected, len);
+}
+
+int des_validate(libcrypto::Mode mode, char* key, char* iv, char* plaintext, char* expected, size_t len)
+{
+	return on_each_path(libcrypto::des::simd::SetEnabled, libcrypto::des::simd::Supported, [&] { return des_check(mode, key, iv, plaintext, expected, len); });
+}
+
+int des_encrypt_ecb(char* key, char* iv, char* data, char* expected, size_t len)
+{
+	return des_validate(libcrypto::Mode::ECB, key, iv, data, expected, len);
+}
+
+int des_encrypt_cbc(char* key, char* iv, char* data, char* expected, size_t len)
+{
+	return des_validate(libcrypto::Mode::CBC, key, iv, data, expected, len);
+}
+
+int des_encrypt_ctr(char* key, char* iv, char* data, char* expected, size_t len)
+{
+	return des_validate(libcrypto::Mode::CTR, key, iv, data, expected, len);
+}
+
+int des_encrypt_ofb(char* key, char* iv, char* data, char* expected, size_t len)
+{
+	return des_validate(libcrypto::Mode::OFB, key, iv, data, expected, len);
+}
@@ -0,0 +1,50 @@
+#include "stdafx.h"
+#include <vector>
+#include "ValidationTests.h"
+#include "../libcrypto/Hashing/FastCDC.h"
+#include "../libcrypto/Hashing/SHA512Simd.h"
+
+/** Check the chunk lengths (comma separated) and the digest over the chunk digests */
+int fastcdc_compare(const std::vector<libcrypto::hashing::Chunk>& chunks, const char* lengths, char* expected)
+{
+	std::string cut;
+	std::vector<char> digests;
+	for(auto& chunk : chunks)
+	{
+		cut += (cut.empty() ? "" : ",") + std::to_string(chunk.Length);
+		digests.insert(digests.end(), chunk.Digest, chunk.Digest + SHA512_DIGEST_SIZE_BYTES);
+	}
+
+	if (cut != lengths) return -26;
+
+	char digest[SHA512_DIGEST_SIZE_BYTES];
+	libcrypto::hashing::SHA512::ComputeHash(digests.data(), digests.size(), digest);
+
+	return check(digest, expected, SHA512_DIGEST_SIZE_BYTES) ? 0 : -27;
+}
+
+int fastcdc_check(size_t averageSize, char* message, size_t len, const char* lengths, char* expected)
+{
+	// All at once, then in uneven pieces so chunks are carried over between calls to Update
+	libcrypto::hashing::FastCdc chunker(averageSize, 1);
+	std::vector<libcrypto::hashing::Chunk> chunks;
+	chunker.Update(message, len, chunks);
+	chunker.Final(chunks);
+
+	auto result = fastcdc_compare(chunks, lengths, expected);
+	if (result != 0) return result;
+
+	chunks.clear();
+	for(size_t off = 0, piece = 1; off < len; off += piece, piece = piece * 7 % 1021 + 1)
+	{
+		chunker.Update(message + off, piece < len - off ? piece : len - off, chunks);
+	}
+	chunker.Final(chunks);
+
+	return fastcdc_compare(chunks, lengths, expected);
+}
+
+int fastcdc_sha512_chunks(size_t averageSize, char* message, size_t len, const char* lengths, char* expected)
+{
+	return on_each_path(libcrypto::hashing::simd::SetEnabled, libcrypto::hashing::simd::Supported, [&] { return fastcdc_check(averageSize, message, len, lengths, expected); });
+}
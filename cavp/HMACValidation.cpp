@@ -0,0 +1,39 @@
+#include "stdafx.h"
+#include "ValidationTests.h"
+#include "../libcrypto/Hashing/HMAC.h"
+#include "../libcrypto/Hashing/SHA512Simd.h"
+
+int hmac_check(char* key, size_t keyLen, char* message, size_t len, char* expected, size_t macLen)
+{
+	libcrypto::hashing::HmacSha512 hmac(key, keyLen);
+	char mac[HMAC_SHA512_MAC_SIZE_BYTES];
+
+	// The response files may truncate the tag, so only compare the leading macLen bytes
+	hmac.ComputeMac(message, len, mac);
+	if (!check(mac, expected, macLen)) return -22;
+
+	// Incrementally, in two pieces
+	hmac.Init();
+	hmac.Update(message, len / 2);
+	hmac.Update(message + len / 2, len - len / 2);
+	hmac.Final(mac);
+	if (!check(mac, expected, macLen)) return -22;
+
+	// And as a batch so the midstates go through the multi-buffer lanes
+	const char* messages[] = { message, message, message };
+	size_t lengths[] = { len, len, len };
+	char batch[3 * HMAC_SHA512_MAC_SIZE_BYTES];
+	hmac.ComputeMacs(messages, lengths, batch, 3);
+
+	for(auto i = 0; i < 3; i++)
+	{
+		if (!check(batch + i * HMAC_SHA512_MAC_SIZE_BYTES, expected, macLen)) return -22;
+	}
+
+	return 0;
+}
+
+int hmac_sha512_mac(char* key, size_t keyLen, char* message, size_t len, char* expected, size_t macLen)
+{
+	return on_each_path(libcrypto::hashing::simd::SetEnabled, libcrypto::hashing::simd::Supported, [&] { return hmac_check(key, keyLen, message, len, expected, macLen); });
+}
@@ -0,0 +1,42 @@
+#include "stdafx.h"
+#include "ValidationTests.h"
+#include "../libcrypto/Hashing/MerkleTree.h"
+#include "../libcrypto/Hashing/SHA512Simd.h"
+
+int merkle_check(size_t leafSize, char* message, size_t len, char* expected)
+{
+	// One leaf at a time through the buffering, then all at once so the leaves go through the lanes
+	libcrypto::hashing::MerkleTree tree(leafSize, 1);
+	char root[SHA512_DIGEST_SIZE_BYTES];
+	for(size_t offset = 0; offset < len; offset += leafSize)
+	{
+		tree.Update(message + offset, len - offset < leafSize ? len - offset : leafSize);
+	}
+	tree.Final(root);
+	if (!check(root, expected, SHA512_DIGEST_SIZE_BYTES)) return -24;
+
+	tree.Init();
+	tree.Update(message, len);
+	tree.Final(root);
+	if (!check(root, expected, SHA512_DIGEST_SIZE_BYTES)) return -24;
+
+	// Every leaf, and the whole message, should verify against the root with its proof
+	char proof[MERKLE_MAX_PROOF_DIGESTS * SHA512_DIGEST_SIZE_BYTES];
+	auto leaves = tree.LeafCount();
+	for(size_t leaf = 0; leaf < leaves; leaf++)
+	{
+		auto offset = leaf * leafSize;
+		auto digests = tree.Proof(leaf, leaf, proof);
+		if (!libcrypto::hashing::MerkleTree::Verify(message + offset, len - offset < leafSize ? len - offset : leafSize, offset, len, leafSize, proof, digests, expected)) return -25;
+	}
+
+	auto digests = tree.Proof(0, leaves - 1, proof);
+	if (!libcrypto::hashing::MerkleTree::Verify(message, len, 0, len, leafSize, proof, digests, expected)) return -25;
+
+	return 0;
+}
+
+int merkle_sha512_root(size_t leafSize, char* message, size_t len, char* expected)
+{
+	return on_each_path(libcrypto::hashing::simd::SetEnabled, libcrypto::hashing::simd::Supported, [&] { return merkle_check(leafSize, message, len, expected); });
+}
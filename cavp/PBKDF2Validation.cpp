@@ -0,0 +1,20 @@
+#include "stdafx.h"
+#include "ValidationTests.h"
+#include "../libcrypto/libcrypto.h"
+#include "../libcrypto/Hashing/PBKDF2.h"
+#include "../libcrypto/Hashing/SHA512Simd.h"
+
+int pbkdf2_check(char* password, size_t passwordLen, char* salt, size_t saltLen, uint32_t iterations, char* expected, size_t keyLen)
+{
+	auto key = new char[keyLen];
+	auto result = libcrypto::hashing::PBKDF2::DeriveKey(password, passwordLen, salt, saltLen, iterations, key, keyLen);
+	auto matches = result == libcrypto::SUCCESS && check(key, expected, keyLen);
+	delete[] key;
+
+	return matches ? 0 : -23;
+}
+
+int pbkdf2_sha512(char* password, size_t passwordLen, char* salt, size_t saltLen, uint32_t iterations, char* expected, size_t keyLen)
+{
+	return on_each_path(libcrypto::hashing::simd::SetEnabled, libcrypto::hashing::simd::Supported, [&] { return pbkdf2_check(password, passwordLen, salt, saltLen, iterations, expected, keyLen); });
+}
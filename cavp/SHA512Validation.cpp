@@ -1,13 +1,101 @@
 #include "stdafx.h"
 #include "ValidationTests.h"
 #include "../libcrypto/Hashing/SHA512.h"
+#include "../libcrypto/Hashing/SHA512Simd.h"
+#include "../libcrypto/Allocations.h"
 
-int sha512_digest(char* message, char* expected, size_t len)
+/** Check the one-shot (allocating and into a buffer), streaming, and batch digests of the message against the expected digest */
+int sha_check(char* message, char* expected, size_t len, size_t digestBits)
 {
-	auto digest = libcrypto::hashing::SHA512::ComputeHash(message, len);
+	auto size = digestBits / 8;
+
+	// Allocations can only be counted under the debug CRT
+	auto counting = libcrypto::allocations::Count();
+
+	if(digestBits == 512)
+	{
+		// The returned digest is allocated in the library
+		auto before = libcrypto::allocations::HeapAllocations();
+		auto digest = libcrypto::hashing::SHA512::ComputeHash(message, len);
+		if (counting && libcrypto::allocations::HeapAllocations() == before) return -23;
+
+		auto result = check(digest, expected, size) ? 0 : -22;
+		delete[] digest;
+		if (result != 0) return result;
+	}
+
+	// The response files encode the empty message as a single zero byte
+	if (len == 1 && message[0] == 0) len = 0;
+
+	auto digest = libcrypto::hashing::SHA512::ComputeHash(message, len, digestBits);
 
-	auto result = check(digest, expected, 64) ? 0 : -22;
+	auto result = check(digest, expected, size) ? 0 : -22;
 	delete[] digest;
+	if (result != 0) return result;
+
+	// Into a caller's buffer, with nothing past the digest written and nothing allocated
+	char direct[SHA512_DIGEST_SIZE_BYTES + 1];
+	direct[size] = 0x5a;
+	auto before = libcrypto::allocations::HeapAllocations();
+	libcrypto::hashing::SHA512::ComputeHash(message, len, direct, digestBits);
+	if (counting && libcrypto::allocations::HeapAllocations() != before) return -23;
+	if (!check(direct, expected, size) || direct[size] != 0x5a) return -22;
+
+	// Feed the streaming hasher uneven pieces so the partial block buffering is exercised too
+	libcrypto::hashing::Sha512 hasher(digestBits);
+	for(size_t off = 0, piece = 1; off < len; off += piece, piece = piece * 3 % 191 + 1)
+	{
+		hasher.Update(message + off, piece < len - off ? piece : len - off);
+	}
+
+	// Carry the state, partial block and all, over to a fresh hasher through a checkpoint before finishing
+	char checkpoint[SHA512_CHECKPOINT_SIZE_BYTES];
+	hasher.Save(checkpoint);
+	libcrypto::hashing::Sha512 resumed(digestBits);
+	resumed.Load(checkpoint);
+
+	char streamed[SHA512_DIGEST_SIZE_BYTES];
+	hasher.Final(streamed);
+	if (!check(streamed, expected, size)) return -22;
+
+	resumed.Final(streamed);
+	if (!check(streamed, expected, size)) return -22;
+
+	// Hash a few copies as a batch so the message goes through the multi-buffer lanes
+	const char* messages[] = { message, message, message };
+	size_t lengths[] = { len, len, len };
+	char batch[3 * SHA512_DIGEST_SIZE_BYTES];
+	libcrypto::hashing::SHA512::ComputeHashes(messages, lengths, batch, 3, digestBits);
 
-	return result;
-}
\ No newline at end of file
+	for(auto i = 0; i < 3; i++)
+	{
+		if (!check(batch + i * size, expected, size)) return -22;
+	}
+
+	return 0;
+}
+
+int sha_digest(char* message, char* expected, size_t len, size_t digestBits)
+{
+	return on_each_path(libcrypto::hashing::simd::SetEnabled, libcrypto::hashing::simd::Supported, [&] { return sha_check(message, expected, len, digestBits); });
+}
+
+int sha512_digest(char* message, char* expected, size_t len)
+{
+	return sha_digest(message, expected, len, 512);
+}
+
+int sha384_digest(char* message, char* expected, size_t len)
+{
+	return sha_digest(message, expected, len, 384);
+}
+
+int sha512_224_digest(char* message, char* expected, size_t len)
+{
+	return sha_digest(message, expected, len, 224);
+}
+
+int sha512_256_digest(char* message, char* expected, size_t len)
+{
+	return sha_digest(message, expected, len, 256);
+}
@@ -11,6 +11,23 @@ inline bool check(char* a, char* b, size_t len)
     return true;
 }
 
+/**
+ * Run the check on every implementation the library can dispatch to: first with its SIMD implementation turned off
+ * through setEnabled, then again with it back on if the processor supports it. The library always picks AVX2 when it
+ * can, so without this the scalar implementation would go unvalidated on exactly the machines that run the validation.
+ * Returns the result of the first run that fails, or 0
+ */
+template<typename Run> int on_each_path(void (*setEnabled)(bool), bool (*supported)(), const Run& run)
+{
+    setEnabled(false);
+    auto result = run();
+    setEnabled(true);
+
+    if (result != 0 || !supported()) return result;
+
+    return run();
+}
+
 int aes_encrypt_ecb_128(char* key, char* data, char* expected, size_t len);
 int aes_encrypt_cbc_128(char* key, char* iv, char* data, char* expected, size_t len);
 
@@ -29,4 +46,23 @@ int aes_decrypt_cbc_192(char* key, char* iv, char* data, char* expected, size_t
 int aes_decrypt_ecb_256(char* key, char* data, char* expected, size_t len);
 int aes_decrypt_cbc_256(char* key, char* iv, char* data, char* expected, size_t len);
 
-int sha512_digest(char* message, char* expected, size_t len);
\ No newline at end of file
+int des_encrypt_ecb(char* key, char* iv, char* data, char* expected, size_t len);
+int des_encrypt_cbc(char* key, char* iv, char* data, char* expected, size_t len);
+int des_encrypt_ctr(char* key, char* iv, char* data, char* expected, size_t len);
+int des_encrypt_ofb(char* key, char* iv, char* data, char* expected, size_t len);
+
+int sha512_digest(char* message, char* expected, size_t len);
+int sha384_digest(char* message, char* expected, size_t len);
+int sha512_224_digest(char* message, char* expected, size_t len);
+int sha512_256_digest(char* message, char* expected, size_t len);
+
+int hmac_sha512_mac(char* key, size_t keyLen, char* message, size_t len, char* expected, size_t macLen);
+
+int pbkdf2_sha512(char* password, size_t passwordLen, char* salt, size_t saltLen, uint32_t iterations, char* expected, size_t keyLen);
+
+int merkle_sha512_root(size_t leafSize, char* message, size_t len, char* expected);
+
+int fastcdc_sha512_chunks(size_t averageSize, char* message, size_t len, const char* lengths, char* expected);
+
+int blake2b_digest(char* key, size_t keyLen, char* message, size_t len, char* expected, size_t digestLen);
+int blake2bp_digest(char* key, size_t keyLen, char* message, size_t len, char* expected, size_t digestLen);
\ No newline at end of file
@@ -53,6 +53,18 @@ int main(int argc, char* argv[])
 		{
 			result = sha512_digest(message, digest, strlen(argv[2]) / 2);
 		}
+		else if(strcmp(argv[1], "sha384") == 0)
+		{
+			result = sha384_digest(message, digest, strlen(argv[2]) / 2);
+		}
+		else if(strcmp(argv[1], "sha512_224") == 0)
+		{
+			result = sha512_224_digest(message, digest, strlen(argv[2]) / 2);
+		}
+		else if(strcmp(argv[1], "sha512_256") == 0)
+		{
+			result = sha512_256_digest(message, digest, strlen(argv[2]) / 2);
+		}
 		else
 		{
 			printf("Unknown hash algorithm\n");
@@ -63,9 +75,137 @@ int main(int argc, char* argv[])
 		return result;
 	}
 
+	if(argc == 5 && strcmp(argv[1], "merkle_sha512") == 0)
+	{
+		auto message = new char[strlen(argv[3]) / 2 + 1]{ 0 };
+		auto root = new char[64];
+
+		fromHex(argv[3], message);
+		fromHex(argv[4], root);
+
+		result = merkle_sha512_root(strtoul(argv[2], nullptr, 10), message, strlen(argv[3]) / 2, root);
+
+		delete[] root;
+		delete[] message;
+		return result;
+	}
+
+	if(argc == 5)
+	{
+		auto key = new char[strlen(argv[2]) / 2]{ 0 };
+		auto message = new char[strlen(argv[3]) / 2]{ 0 };
+		auto mac = new char[strlen(argv[4]) / 2]{ 0 };
+
+		fromHex(argv[2], key);
+		fromHex(argv[3], message);
+		fromHex(argv[4], mac);
+
+		if(strcmp(argv[1], "hmac_sha512") == 0)
+		{
+			result = hmac_sha512_mac(key, strlen(argv[2]) / 2, message, strlen(argv[3]) / 2, mac, strlen(argv[4]) / 2);
+		}
+		else
+		{
+			printf("Unknown MAC algorithm\n");
+			result = -1;
+		}
+
+		delete[] mac;
+		delete[] message;
+		delete[] key;
+		return result;
+	}
+
+	if(argc == 6 && strcmp(argv[1], "pbkdf2_sha512") == 0)
+	{
+		auto password = new char[strlen(argv[2]) / 2 + 1]{ 0 };
+		auto salt = new char[strlen(argv[3]) / 2 + 1]{ 0 };
+		auto key = new char[strlen(argv[5]) / 2]{ 0 };
+
+		fromHex(argv[2], password);
+		fromHex(argv[3], salt);
+		fromHex(argv[5], key);
+
+		result = pbkdf2_sha512(password, strlen(argv[2]) / 2, salt, strlen(argv[3]) / 2, strtoul(argv[4], nullptr, 10), key, strlen(argv[5]) / 2);
+
+		delete[] key;
+		delete[] salt;
+		delete[] password;
+		return result;
+	}
+
+	if(argc == 6 && strcmp(argv[1], "fastcdc_sha512") == 0)
+	{
+		auto message = new char[strlen(argv[3]) / 2 + 1]{ 0 };
+		auto digest = new char[64];
+
+		fromHex(argv[3], message);
+		fromHex(argv[5], digest);
+
+		result = fastcdc_sha512_chunks(strtoul(argv[2], nullptr, 10), message, strlen(argv[3]) / 2, argv[4], digest);
+
+		delete[] digest;
+		delete[] message;
+		return result;
+	}
+
+	if(argc == 7 && (strcmp(argv[1], "blake2b") == 0 || strcmp(argv[1], "blake2bp") == 0))
+	{
+		// The lengths are given, as an empty key or message is written as 00
+		auto keyLen = strtoul(argv[2], nullptr, 10);
+		auto len = strtoul(argv[4], nullptr, 10);
+		auto key = new char[strlen(argv[3]) / 2 + 1]{ 0 };
+		auto message = new char[strlen(argv[5]) / 2 + 1]{ 0 };
+		auto digest = new char[strlen(argv[6]) / 2 + 1]{ 0 };
+
+		fromHex(argv[3], key);
+		fromHex(argv[5], message);
+		fromHex(argv[6], digest);
+
+		if (strcmp(argv[1], "blake2b") == 0) result = blake2b_digest(key, keyLen, message, len, digest, strlen(argv[6]) / 2);
+		else result = blake2bp_digest(key, keyLen, message, len, digest, strlen(argv[6]) / 2);
+
+		delete[] digest;
+		delete[] message;
+		delete[] key;
+		return result;
+	}
+
+	if(argc == 6 && strncmp(argv[1], "des_", 4) == 0)
+	{
+		// Each known answer is checked in both directions. ECB ignores the IV, and only the stream modes take lengths that
+		// aren't a whole number of blocks
+		auto key = new char[8]{ 0 };
+		auto iv = new char[8]{ 0 };
+		auto data = new char[strlen(argv[4]) / 2 + 1]{ 0 };
+		auto expected = new char[strlen(argv[5]) / 2 + 1]{ 0 };
+
+		fromHex(argv[2], key);
+		fromHex(argv[3], iv);
+		fromHex(argv[4], data);
+		fromHex(argv[5], expected);
+
+		auto len = strlen(argv[4]) / 2;
+		if (strcmp(argv[1], "des_ecb") == 0) result = des_encrypt_ecb(key, iv, data, expected, len);
+		else if (strcmp(argv[1], "des_cbc") == 0) result = des_encrypt_cbc(key, iv, data, expected, len);
+		else if (strcmp(argv[1], "des_ctr") == 0) result = des_encrypt_ctr(key, iv, data, expected, len);
+		else if (strcmp(argv[1], "des_ofb") == 0) result = des_encrypt_ofb(key, iv, data, expected, len);
+		else
+		{
+			printf("Unknown DES mode\n");
+			result = -1;
+		}
+
+		delete[] expected;
+		delete[] data;
+		delete[] iv;
+		delete[] key;
+		return result;
+	}
+
 	if(argc < 6 || argc > 7)
 	{
-		printf("Incorrect number of arguments (got %lu). Syntax: cavp <sha512 <message> <digest>> | <aes128|aes192|aes256 <e|d> <key> <data> <expected> [iv]>\n", argc);
+		printf("Incorrect number of arguments (got %lu). Syntax: cavp <sha512|sha384|sha512_224|sha512_256 <message> <digest>> | <hmac_sha512 <key> <message> <mac>> | <merkle_sha512 <leafSize> <message> <root>> | <fastcdc_sha512 <averageSize> <message> <chunks> <digest>> | <blake2b|blake2bp <keyLen> <key> <len> <message> <digest>> | <pbkdf2_sha512 <password> <salt> <iterations> <key>> | <des_ecb|des_cbc|des_ctr|des_ofb <key> <iv> <plaintext> <ciphertext>> | <aes128|aes192|aes256 <e|d> <key> <data> <expected> [iv]>\n", argc);
 		return -1;
 	}
 
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ * main.cpp - Known-plaintext DES key search using bitsliced DES on all cores
+ */
+
+#include "stdafx.h"
+#include "opts.h"
+#include "../libcrypto/DES/DES.h"
+#include "../libcrypto/DES/Bitslice.h"
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <csignal>
+#include <windows.h>
+
+/** The first line of a checkpoint file */
+#define CHECKPOINT_MAGIC "deskeysearch-checkpoint-2"
+
+/**
+ * A contiguous range of 64-key blocks searched by a single thread
+ */
+typedef struct
+{
+	/** The next block to test (everything before it has been searched) */
+	std::atomic<uint64_t> Next;
+	/** One past the last block in the slice */
+	uint64_t End;
+} Slice;
+
+/** Set when the search should stop (key found or interrupted) */
+std::atomic<bool> Stop(false);
+/** The keys found so far */
+std::vector<uint64_t> Found;
+/** Guards Found */
+std::mutex FoundLock;
+
+// Forward-declare so main is at the top as per project spec
+void printHelp();
+void search(const Options& opts, Slice* slice);
+bool loadCheckpoint(const Options& opts, std::vector<Slice>& slices);
+void saveCheckpoint(const Options& opts, std::vector<Slice>& slices);
+uint64_t remaining(std::vector<Slice>& slices);
+void onInterrupt(int);
+const char* strengthName(libcrypto::des::KeyStrength strength);
+
+int main(int argc, char* argv[])
+{
+	// Parse Options
+	Options opts(argc, argv);
+
+	// Parse errors?
+	if(opts.Errors)
+	{
+		printHelp();
+		return -1;
+	}
+
+	// Resume from the checkpoint if there is one, otherwise partition the range evenly across the threads
+	std::vector<Slice> slices;
+	if(!opts.Checkpoint.empty() && loadCheckpoint(opts, slices))
+	{
+		std::cout << "Resuming from " << opts.Checkpoint << " with " << slices.size() << " threads" << std::endl;
+
+		// Without -a a key from the previous run already answers the question
+		if (!opts.FindAll && !Found.empty()) Stop = true;
+	}
+	else
+	{
+		auto first = opts.First / DES_BITSLICE_LANES;
+		auto last = opts.Last / DES_BITSLICE_LANES;
+		auto total = last - first + 1;
+		auto threads = total < opts.Threads ? static_cast<unsigned int>(total) : opts.Threads;
+
+		slices = std::vector<Slice>(threads);
+		for(size_t i = 0; i < threads; i++)
+		{
+			slices[i].Next = first + total * i / threads;
+			slices[i].End = first + total * (i + 1) / threads;
+		}
+	}
+
+	auto initialBlocks = remaining(slices);
+	std::cout << "Searching " << initialBlocks * DES_BITSLICE_LANES << " keys on " << slices.size() << " threads" << std::endl;
+
+	// Save progress if we get interrupted
+	signal(SIGINT, onInterrupt);
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::thread> workers;
+	for(auto& slice : slices)
+	{
+		workers.emplace_back(search, std::cref(opts), &slice);
+	}
+
+	// Report progress and checkpoint periodically until every slice is exhausted or we are told to stop
+	while(!Stop && remaining(slices) > 0)
+	{
+		for(auto waited = 0u; waited < opts.Interval * 10 && !Stop && remaining(slices) > 0; waited++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		auto searched = initialBlocks - remaining(slices);
+		std::cout << "\r" << std::fixed << std::setprecision(2) << 100.0 * searched / initialBlocks << "% ("
+			<< std::setprecision(0) << searched * DES_BITSLICE_LANES / elapsed.count() << " keys/s)   " << std::flush;
+
+		if (!opts.Checkpoint.empty()) saveCheckpoint(opts, slices);
+	}
+
+	for(auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+	auto searched = (initialBlocks - remaining(slices)) * DES_BITSLICE_LANES;
+
+	std::cout << std::endl << "Searched " << searched << " keys in " << std::setprecision(3) << duration.count() << "s ("
+		<< std::setprecision(0) << searched / duration.count() << " keys/s)" << std::endl;
+
+	// The checkpoint is only useful if there is still something left to search, and without -a a key ends the search
+	if(!opts.Checkpoint.empty())
+	{
+		if (remaining(slices) > 0 && (opts.FindAll || Found.empty())) saveCheckpoint(opts, slices);
+		else std::remove(opts.Checkpoint.c_str());
+	}
+
+	for(auto key : Found)
+	{
+		std::cout << "Found key " << std::hex << std::setw(16) << std::setfill('0') << key << std::dec
+			<< " (" << strengthName(libcrypto::des::CheckKey(key)) << ")" << std::endl;
+	}
+
+	return Found.empty() ? 1 : 0;
+}
+
+/**
+ * Test every block in the slice, stopping early if another thread finds the key
+ */
+void search(const Options& opts, Slice* slice)
+{
+	auto firstBlock = opts.First / DES_BITSLICE_LANES;
+	auto lastBlock = opts.Last / DES_BITSLICE_LANES;
+
+	for(auto block = slice->Next.load(); block < slice->End && !Stop; slice->Next = ++block)
+	{
+		auto matches = libcrypto::des::bitslice::TestKeys(opts.Plaintext, opts.Ciphertext, block);
+
+		// The first and last blocks may only be partially inside the requested range
+		if (block == firstBlock) matches &= ~0ull << (opts.First % DES_BITSLICE_LANES);
+		if (block == lastBlock) matches &= ~0ull >> (DES_BITSLICE_LANES - 1 - opts.Last % DES_BITSLICE_LANES);
+
+		if(matches != 0)
+		{
+			std::lock_guard<std::mutex> lock(FoundLock);
+			for(auto lane = 0; lane < DES_BITSLICE_LANES; lane++)
+			{
+				if (!(matches >> lane & 1)) continue;
+
+				// A checkpoint taken just before Next advanced past this block may already hold the key
+				auto key = libcrypto::des::bitslice::KeyFromIndex(block * DES_BITSLICE_LANES + lane);
+				if (std::find(Found.begin(), Found.end(), key) == Found.end()) Found.push_back(key);
+			}
+
+			if (!opts.FindAll) Stop = true;
+		}
+	}
+}
+
+/**
+ * Load the slices and the keys found so far from the checkpoint file. Returns false if there is no usable checkpoint
+ */
+bool loadCheckpoint(const Options& opts, std::vector<Slice>& slices)
+{
+	std::ifstream reader(opts.Checkpoint);
+	if (!reader.good()) return false;
+
+	std::string magic;
+	uint64_t plaintext, ciphertext, first, last;
+	size_t count;
+	reader >> magic >> std::hex >> plaintext >> ciphertext >> first >> last >> std::dec >> count;
+
+	if(!reader.good() || magic != CHECKPOINT_MAGIC)
+	{
+		std::cerr << "Ignoring malformed checkpoint " << opts.Checkpoint << std::endl;
+		return false;
+	}
+
+	if(plaintext != opts.Plaintext || ciphertext != opts.Ciphertext || first != opts.First || last != opts.Last)
+	{
+		std::cerr << "Ignoring checkpoint " << opts.Checkpoint << " for a different search" << std::endl;
+		return false;
+	}
+
+	slices = std::vector<Slice>(count);
+	for(auto& slice : slices)
+	{
+		uint64_t next;
+		reader >> std::hex >> next >> slice.End;
+		slice.Next = next;
+	}
+
+	size_t found;
+	reader >> std::dec >> found;
+	std::vector<uint64_t> keys(reader.good() ? found : 0);
+	for(auto& key : keys)
+	{
+		reader >> std::hex >> key;
+	}
+
+	if(reader.fail())
+	{
+		std::cerr << "Ignoring truncated checkpoint " << opts.Checkpoint << std::endl;
+		return false;
+	}
+
+	Found = keys;
+	return true;
+}
+
+/**
+ * Write the current position of every slice and the keys found so far to the checkpoint file
+ */
+void saveCheckpoint(const Options& opts, std::vector<Slice>& slices)
+{
+	// Write to a temporary file first so an interruption can't leave a half-written checkpoint behind
+	auto temp = opts.Checkpoint + ".tmp";
+	std::ofstream writer(temp, std::ios::out | std::ios::trunc);
+	if(!writer.good())
+	{
+		std::cerr << "Unable to open checkpoint for write: " << temp << std::endl;
+		return;
+	}
+
+	writer << CHECKPOINT_MAGIC << std::endl << std::hex
+		<< opts.Plaintext << " " << opts.Ciphertext << std::endl
+		<< opts.First << " " << opts.Last << std::endl
+		<< std::dec << slices.size() << std::endl << std::hex;
+
+	for(auto& slice : slices)
+	{
+		writer << slice.Next.load() << " " << slice.End << std::endl;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(FoundLock);
+		writer << std::dec << Found.size() << std::endl << std::hex;
+		for(auto key : Found)
+		{
+			writer << key << std::endl;
+		}
+	}
+	writer.close();
+
+	if(writer.fail() || !MoveFileExA(temp.c_str(), opts.Checkpoint.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		std::cerr << "Unable to save checkpoint: " << opts.Checkpoint << std::endl;
+	}
+}
+
+/**
+ * The number of blocks that have not been searched yet
+ */
+uint64_t remaining(std::vector<Slice>& slices)
+{
+	uint64_t total = 0;
+	for(auto& slice : slices)
+	{
+		auto next = slice.Next.load();
+		total += next < slice.End ? slice.End - next : 0;
+	}
+
+	return total;
+}
+
+void onInterrupt(int)
+{
+	Stop = true;
+}
+
+const char* strengthName(libcrypto::des::KeyStrength strength)
+{
+	switch(strength)
+	{
+		case libcrypto::des::WEAK: return "weak";
+		case libcrypto::des::SEMI_WEAK: return "semi-weak";
+		case libcrypto::des::POSSIBLY_WEAK: return "possibly weak";
+		default: return "not weak";
+	}
+}
+
+void printHelp()
+{
+	std::cout << "deskeysearch <plaintext> <ciphertext> [-t threads] [-f first] [-l last] [-c checkpoint] [-i seconds] [-a]" << std::endl;
+	std::cout << "\tplaintext, ciphertext: a known 8-byte block and its encryption, as 16 hex digits" << std::endl;
+	std::cout << "\t-t: the number of threads to use (default: all cores)" << std::endl;
+	std::cout << "\t-f, -l: the first and last 56-bit key indices (PC-1 output) to search, as hex" << std::endl;
+	std::cout << "\t-c: save progress to (and resume from) the specified checkpoint file" << std::endl;
+	std::cout << "\t-i: how often to report progress and save the checkpoint (default: 10s)" << std::endl;
+	std::cout << "\t-a: find all matching keys instead of stopping at the first one" << std::endl;
+}
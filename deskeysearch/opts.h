@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ * opts.h - Command Line Options
+ */
+
+#pragma once
+#include <stdlib.h>
+#include <cstdint>
+#include <string>
+#include <iostream>
+#include <regex>
+#include <thread>
+#include "../libcrypto/DES/Bitslice.h"
+
+/** The largest key index in the DES keyspace */
+#define MAX_KEY_INDEX ((1ull << DES_KEYSPACE_BITS) - 1)
+
+/**
+ * A class for parsing command-line options
+ */
+class Options
+{
+public:
+	/** The known plaintext block */
+	uint64_t Plaintext = 0;
+	/** The ciphertext block produced by encrypting Plaintext with the unknown key */
+	uint64_t Ciphertext = 0;
+
+	/** The first key index to search (inclusive) */
+	uint64_t First = 0;
+	/** The last key index to search (inclusive) */
+	uint64_t Last = MAX_KEY_INDEX;
+
+	/** The number of worker threads */
+	unsigned int Threads = std::thread::hardware_concurrency();
+	/** The path to the checkpoint file, if checkpointing is enabled */
+	std::string Checkpoint;
+	/** How often to write the checkpoint and print progress, in seconds */
+	unsigned int Interval = 10;
+	/** Whether or not to keep searching after the first key is found */
+	bool FindAll = false;
+
+	/** Whether or not errors were encountered */
+	bool Errors = false;
+
+	/**
+	 * Construct the options using the specified arguments
+	 */
+	Options(int argc, char* argv[])
+	{
+		if(argc < 3)
+		{
+			Errors = true;
+			return;
+		}
+
+		if(!parseHex(argv[1], 16, Plaintext) || !parseHex(argv[2], 16, Ciphertext))
+		{
+			std::cerr << "The plaintext and ciphertext must be 16 hex digits" << std::endl;
+			Errors = true;
+			return;
+		}
+
+		for(auto i = 3; i < argc; i++)
+		{
+			std::string flag(argv[i]);
+
+			if(flag == "-a")
+			{
+				FindAll = true;
+				continue;
+			}
+
+			// Everything else takes a value
+			if(i + 1 >= argc)
+			{
+				std::cerr << "Missing value for " << flag << std::endl;
+				Errors = true;
+				return;
+			}
+
+			std::string value(argv[++i]);
+			if(flag == "-t")
+			{
+				Threads = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+			}
+			else if(flag == "-i")
+			{
+				Interval = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+			}
+			else if(flag == "-c")
+			{
+				Checkpoint = value;
+			}
+			else if(flag == "-f")
+			{
+				if (!parseHex(value, 14, First)) Errors = true;
+			}
+			else if(flag == "-l")
+			{
+				if (!parseHex(value, 14, Last)) Errors = true;
+			}
+			else
+			{
+				std::cerr << "Unknown option " << flag << std::endl;
+				Errors = true;
+			}
+
+			if(Errors) return;
+		}
+
+		if(Threads == 0) Threads = 1;
+		if(Interval == 0) Interval = 1;
+
+		if(First > MAX_KEY_INDEX || Last > MAX_KEY_INDEX || First > Last)
+		{
+			std::cerr << "Key index range must be within [0, " << std::hex << MAX_KEY_INDEX << std::dec << "] and non-empty" << std::endl;
+			Errors = true;
+		}
+	}
+
+private:
+	/** Parse up to maxDigits hex digits into result */
+	static bool parseHex(const std::string& str, size_t maxDigits, uint64_t& result)
+	{
+		if (str.empty() || str.length() > maxDigits || !std::regex_match(str, std::regex("^[0-9a-fA-F]+$"))) return false;
+
+		result = strtoull(str.c_str(), static_cast<char **>(nullptr), 16);
+		return true;
+	}
+};
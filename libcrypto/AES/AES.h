@@ -49,7 +49,7 @@ namespace libcrypto
 		}
 
 		/** Create the a block from the buffer at the specified offset */
-		inline aes_block_t make_block(char* buff, size_t offset)
+		inline aes_block_t make_block(const char* buff, size_t offset)
 		{
 			aes_block_t block;
 
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Allocations.h - Counting heap allocations from tests and benchmarks
+ *
+ * This is compiled into the tool that includes it, not into libcrypto. It hooks the debug CRT heap, which the debug
+ * builds of the tools and the library share, so it sees what the library allocates without the library paying for it.
+ * Release builds use the regular CRT, which has no hook, so nothing is counted there.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <crtdbg.h>
+
+namespace libcrypto
+{
+	namespace allocations
+	{
+		/** The allocations seen by the hook so far */
+		inline std::atomic<uint64_t>& counter()
+		{
+			static std::atomic<uint64_t> count(0);
+			return count;
+		}
+
+#ifdef _DEBUG
+		/** Counts every allocation on the debug heap, skipping the CRT's own bookkeeping blocks */
+		inline int __cdecl countingHook(int allocType, void*, size_t, int blockType, long, const unsigned char*, int)
+		{
+			if (allocType == _HOOK_ALLOC && blockType != _CRT_BLOCK) counter().fetch_add(1, std::memory_order_relaxed);
+
+			// Let the allocation go ahead
+			return 1;
+		}
+#endif
+
+		/**
+		 * Start counting heap allocations, made by this process and by libcrypto, on every thread. Returns false if
+		 * this build can't count them (release CRT), in which case HeapAllocations always returns 0
+		 */
+		inline bool Count()
+		{
+#ifdef _DEBUG
+			static auto installed = (_CrtSetAllocHook(countingHook), true);
+			return installed;
+#else
+			return false;
+#endif
+		}
+
+		/** The number of heap allocations made since Count was first called */
+		inline uint64_t HeapAllocations()
+		{
+			return counter().load(std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * AsyncIO.h - Unbuffered, overlapped file reads and writes with many requests in flight
+ */
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <windows.h>
+
+/** The alignment of the buffers, offsets and lengths of unbuffered requests (a multiple of any common sector size) */
+#define ASYNC_IO_ALIGNMENT 4096
+/** The size of each request, unless given */
+#define ASYNC_IO_REQUEST_BYTES (1024 * 1024)
+/** The number of requests kept in flight, unless given */
+#define ASYNC_IO_QUEUE_DEPTH 16
+
+namespace libcrypto
+{
+	namespace io
+	{
+		/**
+		 * A file opened for unbuffered, overlapped i/o, and the ring of requests kept in flight on it. Each request has its
+		 * own aligned buffer and event, allocated once when the file is opened and reused for every request after that.
+		 * Unbuffered i/o skips the file cache, so offsets and lengths must be multiples of ASYNC_IO_ALIGNMENT
+		 */
+		class Queue
+		{
+		public:
+			Queue(const Queue&) = delete;
+			Queue& operator=(const Queue&) = delete;
+
+			/** True iff the file was opened unbuffered, rather than as a stream */
+			bool Unbuffered() const { return unbuffered; }
+
+			/** How the file is being read or written ("unbuffered" or "stream") */
+			const char* Kind() const { return Unbuffered() ? "unbuffered" : "stream"; }
+
+			/** True iff a request failed */
+			bool Failed() const { return failed; }
+
+		protected:
+			/** One request, and the buffer it reads into or writes from */
+			struct Request
+			{
+				OVERLAPPED Overlapped;
+				char* Buffer;
+				/** Where in the file the request starts, and how many bytes it asked for */
+				uint64_t Offset;
+				DWORD Length;
+				/** True from when the request is issued until its result is collected */
+				bool Pending;
+			};
+
+			Queue(size_t requestBytes, unsigned int depth) : requestBytes((requestBytes + ASYNC_IO_ALIGNMENT - 1) / ASYNC_IO_ALIGNMENT * ASYNC_IO_ALIGNMENT),
+				requests(depth < 1 ? 1 : depth)
+			{
+				if (this->requestBytes == 0) this->requestBytes = ASYNC_IO_ALIGNMENT;
+			}
+
+			~Queue()
+			{
+				close();
+			}
+
+			/**
+			 * Open the file for unbuffered, overlapped reads, or create it for writes. Returns false if it cannot be opened
+			 * that way: it is not on a disk, or the disk's sectors do not divide ASYNC_IO_ALIGNMENT
+			 */
+			bool open(const std::string& path, bool writing)
+			{
+				file = CreateFileA(path.c_str(), writing ? GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+					writing ? CREATE_ALWAYS : OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING, nullptr);
+				if (file == INVALID_HANDLE_VALUE) return false;
+
+				// Older systems cannot say, and every disk they run on has 512 or 4096 byte sectors
+				FILE_STORAGE_INFO storage;
+				auto aligned = GetFileType(file) == FILE_TYPE_DISK && (!GetFileInformationByHandleEx(file, FileStorageInfo, &storage, sizeof(storage))
+					|| (storage.LogicalBytesPerSector > 0 && ASYNC_IO_ALIGNMENT % storage.LogicalBytesPerSector == 0));
+
+				for(auto& request : requests)
+				{
+					if (!aligned) break;
+
+					memset(&request.Overlapped, 0, sizeof(request.Overlapped));
+					request.Overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+					request.Buffer = static_cast<char*>(_aligned_malloc(requestBytes, ASYNC_IO_ALIGNMENT));
+					request.Pending = false;
+					allocated++;
+
+					aligned = request.Overlapped.hEvent != nullptr && request.Buffer != nullptr;
+				}
+
+				if (!aligned) close();
+				unbuffered = aligned;
+				return aligned;
+			}
+
+			/** Start reading or writing the request's buffer at offset. Returns false if it could not be issued */
+			bool issue(Request& request, uint64_t offset, size_t len, bool writing)
+			{
+				request.Offset = offset;
+				request.Length = static_cast<DWORD>(len);
+				request.Overlapped.Offset = static_cast<DWORD>(offset);
+				request.Overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+				auto started = writing ? WriteFile(file, request.Buffer, request.Length, nullptr, &request.Overlapped)
+					: ReadFile(file, request.Buffer, request.Length, nullptr, &request.Overlapped);
+				if(!started && GetLastError() != ERROR_IO_PENDING)
+				{
+					failed = true;
+					return false;
+				}
+
+				request.Pending = true;
+				return true;
+			}
+
+			/** Wait for the request to finish, and get the number of bytes it read or wrote. Returns false if it failed */
+			bool complete(Request& request, DWORD& transferred)
+			{
+				request.Pending = false;
+				if (GetOverlappedResult(file, &request.Overlapped, &transferred, TRUE)) return true;
+
+				failed = true;
+				return false;
+			}
+
+			/** Cancel the requests still in flight, and close the file */
+			void close()
+			{
+				for(size_t i = 0; i < allocated; i++)
+				{
+					auto& request = requests[i];
+					if(request.Pending)
+					{
+						// The buffer belongs to the request until it has finished, even once cancelled
+						DWORD transferred;
+						CancelIoEx(file, &request.Overlapped);
+						GetOverlappedResult(file, &request.Overlapped, &transferred, TRUE);
+						request.Pending = false;
+					}
+
+					if (request.Overlapped.hEvent != nullptr) CloseHandle(request.Overlapped.hEvent);
+					_aligned_free(request.Buffer);
+				}
+
+				allocated = 0;
+				if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+
+			HANDLE file = INVALID_HANDLE_VALUE;
+			size_t requestBytes;
+			std::vector<Request> requests;
+			/** The number of requests with an event and a buffer */
+			size_t allocated = 0;
+			bool unbuffered = false;
+			bool failed = false;
+		};
+
+		/**
+		 * Reads a file front to back, with up to depth reads of requestBytes each in flight ahead of the one being used. Files
+		 * that cannot be read unbuffered (on a network share, or a pipe) are read with a std::ifstream instead
+		 */
+		class Reader : public Queue
+		{
+		public:
+			explicit Reader(size_t requestBytes = ASYNC_IO_REQUEST_BYTES, unsigned int depth = ASYNC_IO_QUEUE_DEPTH) : Queue(requestBytes, depth) {}
+
+			/**
+			 * Open the file at path, starting offset bytes in, and start reading it. If it cannot be read unbuffered, open it
+			 * as a stream if fallback is set. Returns false if it cannot be opened, or is shorter than offset
+			 */
+			bool Open(const std::string& path, uint64_t offset = 0, bool fallback = true)
+			{
+				LARGE_INTEGER length;
+				if(open(path, false) && GetFileSizeEx(file, &length) && static_cast<uint64_t>(length.QuadPart) >= offset)
+				{
+					size = static_cast<uint64_t>(length.QuadPart);
+
+					// Reads start on an aligned offset, so the first one may begin with bytes before the offset to skip
+					next = offset / ASYNC_IO_ALIGNMENT * ASYNC_IO_ALIGNMENT;
+					skip = static_cast<size_t>(offset - next);
+
+					for (auto& request : requests) readAhead(request);
+					return !failed;
+				}
+
+				close();
+				unbuffered = false;
+				if (!fallback) return false;
+
+				stream.open(path, std::ios::binary | std::ios::ate | std::ios::in);
+				if (!stream.good()) return false;
+
+				size = stream.tellg();
+				if (size < offset) return false;
+
+				return static_cast<bool>(stream.seekg(offset, std::ios::beg));
+			}
+
+			/** The size of the file */
+			uint64_t Size() const { return size; }
+
+			/**
+			 * Get the next run of the file, up to requestBytes long, which stays valid until the next call. Returns false at
+			 * the end of the file, or if a read failed (see Failed). Not to be mixed with Read
+			 */
+			bool Next(const char*& data, size_t& len)
+			{
+				if(!Unbuffered())
+				{
+					buffer.resize(requestBytes);
+					stream.read(buffer.data(), requestBytes);
+					len = static_cast<size_t>(stream.gcount());
+					data = buffer.data();
+
+					if (stream.bad()) failed = true;
+					return len > 0 && !failed;
+				}
+
+				// The buffer handed out last time is done with, so it goes back in the ring for the next read
+				if(released != nullptr)
+				{
+					readAhead(*released);
+					released = nullptr;
+				}
+
+				auto& request = requests[head];
+				if (!request.Pending || failed) return false;
+
+				// A short read means the file was truncated while we read it
+				DWORD transferred;
+				auto expected = size - request.Offset < request.Length ? size - request.Offset : request.Length;
+				if (!complete(request, transferred)) return false;
+				if(transferred < expected)
+				{
+					failed = true;
+					return false;
+				}
+
+				data = request.Buffer + skip;
+				len = static_cast<size_t>(expected) - skip;
+				skip = 0;
+
+				released = &request;
+				head = (head + 1) % requests.size();
+				return true;
+			}
+
+			/**
+			 * Read exactly len bytes of the file into data. Returns false if the file ends first, or a read failed
+			 */
+			bool Read(char* data, size_t len)
+			{
+				if (!Unbuffered()) return static_cast<bool>(stream.read(data, len));
+
+				while(len > 0)
+				{
+					if (available == 0 && !Next(current, available)) return false;
+
+					auto take = len < available ? len : available;
+					memcpy(data, current, take);
+					current += take;
+					available -= take;
+					data += take;
+					len -= take;
+				}
+
+				return true;
+			}
+
+		private:
+			/** Issue the request for the next run of the file, if there is any of it left to read */
+			void readAhead(Request& request)
+			{
+				if (next >= size || failed) return;
+
+				// Only whole sectors can be read, so the last read asks for more than there is
+				if (issue(request, next, requestBytes, false)) next += requestBytes;
+			}
+
+			uint64_t size = 0;
+			/** Where the next read is issued from */
+			uint64_t next = 0;
+			/** The bytes to skip at the start of the first read, before the offset the file was opened at */
+			size_t skip = 0;
+
+			/** The request Next collects next, and the one whose buffer it handed out last */
+			size_t head = 0;
+			Request* released = nullptr;
+
+			/** What Read has not used yet of the last run Next handed it */
+			const char* current = nullptr;
+			size_t available = 0;
+
+			std::ifstream stream;
+			std::vector<char> buffer;
+		};
+
+		/**
+		 * Writes a file front to back, gathering the bytes into requestBytes requests and keeping up to depth of them in
+		 * flight. Files that cannot be written unbuffered are written with a std::ofstream instead. The file is only
+		 * complete once Close returns true
+		 */
+		class Writer : public Queue
+		{
+		public:
+			explicit Writer(size_t requestBytes = ASYNC_IO_REQUEST_BYTES, unsigned int depth = ASYNC_IO_QUEUE_DEPTH) : Queue(requestBytes, depth) {}
+
+			/**
+			 * Create (or truncate) the file at path for writing. If it cannot be written unbuffered, open it as a stream if
+			 * fallback is set. Returns false if it cannot be opened
+			 */
+			bool Open(const std::string& path, bool fallback = true)
+			{
+				if (open(path, true)) return true;
+				if (!fallback) return false;
+
+				stream.open(path, std::ios::binary | std::ios::out);
+				return stream.good();
+			}
+
+			/**
+			 * Say how long the file will be once written, so an unbuffered file can be sized before the first write is issued:
+			 * NTFS completes writes that extend a file synchronously, which would leave only one of them in flight at a time.
+			 * Call it before writing more than requestBytes. Close still cuts the file to the length actually written
+			 */
+			void Reserve(uint64_t size)
+			{
+				reserved = size;
+			}
+
+			/** Append len bytes to the file. Returns false if a write failed */
+			bool Write(const char* data, size_t len)
+			{
+				if (!Unbuffered()) return static_cast<bool>(stream.write(data, len));
+
+				while(len > 0 && !failed)
+				{
+					auto& request = requests[head];
+					auto take = len < requestBytes - filled ? len : requestBytes - filled;
+					memcpy(request.Buffer + filled, data, take);
+					filled += take;
+					data += take;
+					len -= take;
+
+					// Send the full buffer off, and wait for the oldest write to be done with the next one
+					if(filled == requestBytes)
+					{
+						// Size the file before the first write. Round up so the padded last write doesn't extend it either
+						if(written == 0 && reserved > 0)
+						{
+							auto size = (reserved + ASYNC_IO_ALIGNMENT - 1) / ASYNC_IO_ALIGNMENT * ASYNC_IO_ALIGNMENT;
+							if (!resize(size)) return false;
+						}
+
+						if (!issue(request, written, requestBytes, true)) return false;
+						written += requestBytes;
+						filled = 0;
+
+						head = (head + 1) % requests.size();
+						if (!finish(requests[head])) return false;
+					}
+				}
+
+				return !failed;
+			}
+
+			/**
+			 * Write out what is left, wait for every write to finish, and close the file. Returns true iff all of it was
+			 * written
+			 */
+			bool Close()
+			{
+				if(!Unbuffered())
+				{
+					stream.close();
+					return !stream.fail();
+				}
+
+				// Only whole sectors can be written, so the last one is padded out and the file cut back to length after
+				auto length = written + filled;
+				if(filled > 0 && !failed)
+				{
+					auto& request = requests[head];
+					auto padded = (filled + ASYNC_IO_ALIGNMENT - 1) / ASYNC_IO_ALIGNMENT * ASYNC_IO_ALIGNMENT;
+					memset(request.Buffer + filled, 0, padded - filled);
+					issue(request, written, padded, true);
+				}
+
+				for (auto& request : requests) finish(request);
+				if (!failed) resize(length);
+
+				close();
+				return !failed;
+			}
+
+		private:
+			/** Move the end of the file to size bytes. Returns false if it could not be moved */
+			bool resize(uint64_t size)
+			{
+				FILE_END_OF_FILE_INFO end;
+				end.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+				if (!SetFileInformationByHandle(file, FileEndOfFileInfo, &end, sizeof(end))) failed = true;
+
+				return !failed;
+			}
+
+			/** Wait for the request's write, if it has one in flight. Returns false if it failed */
+			bool finish(Request& request)
+			{
+				if (!request.Pending) return true;
+
+				DWORD transferred;
+				if (!complete(request, transferred)) return false;
+				if (transferred < request.Length) failed = true;
+
+				return !failed;
+			}
+
+			/** The number of bytes sent off in requests, and the number gathered in the buffer of the next */
+			uint64_t written = 0;
+			size_t filled = 0;
+			/** The request being filled */
+			size_t head = 0;
+			/** The length the file will end up, if known (see Reserve) */
+			uint64_t reserved = 0;
+
+			std::ofstream stream;
+		};
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ * Cpu.h - Runtime detection of optional instruction set extensions
+ */
+
+#pragma once
+#include <intrin.h>
+
+namespace libcrypto
+{
+	namespace cpu
+	{
+		/**
+		 * Query cpuid and xgetbv for AVX2 support. The OS must also save the upper halves of the ymm registers
+		 */
+		inline bool detectAVX2()
+		{
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+
+			// OSXSAVE (bit 27) and AVX (bit 28)
+			__cpuid(info, 1);
+			if ((info[2] & (3 << 27)) != (3 << 27)) return false;
+
+			// XMM and YMM state enabled by the OS
+			if ((_xgetbv(0) & 6) != 6) return false;
+
+			// AVX2 (leaf 7, ebx bit 5)
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+		}
+
+		/**
+		 * Query cpuid for SSE2 support (leaf 1, edx bit 26)
+		 */
+		inline bool detectSSE2()
+		{
+			int info[4];
+			__cpuid(info, 1);
+			return (info[3] & (1 << 26)) != 0;
+		}
+
+		/**
+		 * Whether or not the processor supports SSE2. Detected once and cached
+		 */
+		inline bool HasSSE2()
+		{
+			static const auto supported = detectSSE2();
+			return supported;
+		}
+
+		/**
+		 * Whether or not the processor (and OS) support AVX2. Detected once and cached
+		 */
+		inline bool HasAVX2()
+		{
+			static const auto supported = detectAVX2();
+			return supported;
+		}
+	}
+}
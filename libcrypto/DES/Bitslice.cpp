@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Bitslice.cpp - Bitsliced DES implementation for known-plaintext key search
+ *
+ * In bitsliced form every bit of the cipher state is stored in its own uint64_t, with bit i of each
+ * variable belonging to the i'th of 64 independent DES instances. Permutations become free (they only
+ * rename variables) and the S-boxes are evaluated as boolean functions on all 64 instances at once.
+ */
+#include "Bitslice.h"
+#include "Boxes.h"
+#include "Math.h"
+#include "Schedule.h"
+
+/** The number of S-box inputs that form a leaf pair in the S-box mux tree (2^6 inputs / 2) */
+#define SBOX_PAIRS 32
+
+namespace libcrypto
+{
+	namespace des
+	{
+		namespace bitslice
+		{
+			/** The lane patterns for the 6 key index bits that differ between the 64 keys in a pass */
+			const uint64_t LANE_PATTERNS[] = {
+				0xAAAAAAAAAAAAAAAA, 0xCCCCCCCCCCCCCCCC, 0xF0F0F0F0F0F0F0F0,
+				0xFF00FF00FF00FF00, 0xFFFF0000FFFF0000, 0xFFFFFFFF00000000
+			};
+
+			/**
+			 * Bit routing tables, derived once from the permutations in Boxes.h by probing each one bit at a time
+			 *
+			 *   E[i]           - the bit of R that feeds bit i of the expanded 48-bit half block
+			 *   P[i]           - the bit of the S-box output that feeds bit i of the permuted output
+			 *   RoundKey[r][i] - the bit of the PC-1 output (key index) that feeds bit i of round key r
+			 *   PC1Inverse[i]  - the bit of the 64-bit key that feeds bit i of the PC-1 output
+			 *   Leaves[s][p][o]- the truth table of output bit o of S-box s for inputs 2p and 2p+1, encoded
+			 *                    as (S(2p) << 1 | S(2p+1)) to select from { 0, x, ~x, 1 } at the bottom of the mux tree
+			 */
+			typedef struct BitsliceTables
+			{
+				uint8_t E[48];
+				uint8_t P[32];
+				uint8_t RoundKey[DES_ROUNDS][48];
+				uint8_t PC1Inverse[DES_KEYSPACE_BITS];
+				uint8_t Leaves[8][SBOX_PAIRS][4];
+
+				BitsliceTables()
+				{
+					for(auto bit = 0; bit < 32; bit++)
+					{
+						auto expanded = BlockPE32To48(1ull << bit);
+						for(auto i = 0; i < 48; i++)
+						{
+							if (expanded >> i & 1) E[i] = bit;
+						}
+
+						auto permuted = BlockP32(1ull << bit);
+						for(auto i = 0; i < 32; i++)
+						{
+							if (permuted >> i & 1) P[i] = bit;
+						}
+					}
+
+					for(auto bit = 0; bit < DES_KEYSPACE_BITS; bit++)
+					{
+						uint64_t c, d;
+						split56(1ull << bit, c, d);
+
+						for(auto r = 0; r < DES_ROUNDS; r++)
+						{
+							rotL28(c, RotationSchedule[r]);
+							rotL28(d, RotationSchedule[r]);
+
+							// PC-2 discards 8 bits, so not every key bit appears in every round
+							auto roundKey = KeyPC56To48(join56(c, d));
+							for(auto i = 0; i < 48; i++)
+							{
+								if (roundKey >> i & 1) RoundKey[r][i] = bit;
+							}
+						}
+					}
+
+					for(auto bit = 0; bit < 64; bit++)
+					{
+						// The parity bits do not make it through PC-1
+						auto compressed = KeyPC64To56(1ull << bit);
+						for(auto i = 0; i < DES_KEYSPACE_BITS; i++)
+						{
+							if (compressed >> i & 1) PC1Inverse[i] = bit;
+						}
+					}
+
+					const uint64_t* boxes[] = { S0, S1, S2, S3, S4, S5, S6, S7 };
+					for(auto s = 0; s < 8; s++)
+					{
+						// The S-boxes are pre-shifted into their position in the 32-bit output
+						auto shift = 28 - 4 * s;
+						for(auto p = 0; p < SBOX_PAIRS; p++)
+						{
+							for(auto o = 0; o < 4; o++)
+							{
+								auto even = boxes[s][2 * p] >> (shift + o) & 1;
+								auto odd = boxes[s][2 * p + 1] >> (shift + o) & 1;
+								Leaves[s][p][o] = static_cast<uint8_t>(even << 1 | odd);
+							}
+						}
+					}
+				}
+			} BitsliceTables;
+
+			/** The bit routing tables, built once when the library is loaded */
+			static const BitsliceTables Tables;
+
+			/** Spread the bits of a 32 or 64-bit constant into bitsliced variables (all lanes share the value) */
+			inline void broadcast(uint64_t value, uint64_t* out, size_t bits)
+			{
+				for(size_t i = 0; i < bits; i++)
+				{
+					out[i] = 0ull - (value >> i & 1);
+				}
+			}
+
+			/**
+			 * Evaluate the specified S-box on 64 lanes at once as a tree of multiplexers over its 6 input bits
+			 */
+			inline void substitute(const uint8_t leaves[SBOX_PAIRS][4], const uint64_t in[6], uint64_t out[4])
+			{
+				uint64_t node[SBOX_PAIRS][4];
+
+				// Leaves: each pair of inputs that differ only in the lowest bit is one of 0, x, ~x or 1
+				const uint64_t select[] = { 0, in[0], ~in[0], ~0ull };
+				for(auto p = 0; p < SBOX_PAIRS; p++)
+				{
+					node[p][0] = select[leaves[p][0]];
+					node[p][1] = select[leaves[p][1]];
+					node[p][2] = select[leaves[p][2]];
+					node[p][3] = select[leaves[p][3]];
+				}
+
+				// Each level up the tree multiplexes pairs of nodes on the next input bit
+				for(auto level = 1, width = SBOX_PAIRS / 2; level < 6; level++, width /= 2)
+				{
+					auto x = in[level];
+					for(auto p = 0; p < width; p++)
+					{
+						node[p][0] = node[2 * p][0] ^ ((node[2 * p][0] ^ node[2 * p + 1][0]) & x);
+						node[p][1] = node[2 * p][1] ^ ((node[2 * p][1] ^ node[2 * p + 1][1]) & x);
+						node[p][2] = node[2 * p][2] ^ ((node[2 * p][2] ^ node[2 * p + 1][2]) & x);
+						node[p][3] = node[2 * p][3] ^ ((node[2 * p][3] ^ node[2 * p + 1][3]) & x);
+					}
+				}
+
+				out[0] = node[0][0];
+				out[1] = node[0][1];
+				out[2] = node[0][2];
+				out[3] = node[0][3];
+			}
+
+			/**
+			 * A single fistel round: left ^= P(S(E(right) ^ roundKey))
+			 */
+			inline void round(const uint64_t* key, size_t r, uint64_t* left, const uint64_t* right)
+			{
+				uint64_t substituted[32];
+
+				for(auto s = 0; s < 8; s++)
+				{
+					// S-box s reads bits [6 * (7 - s), 6 * (7 - s) + 5] of the expanded half block
+					auto base = 6 * (7 - s);
+
+					uint64_t in[6];
+					for(auto b = 0; b < 6; b++)
+					{
+						in[b] = right[Tables.E[base + b]] ^ key[Tables.RoundKey[r][base + b]];
+					}
+
+					substitute(Tables.Leaves[s], in, substituted + 28 - 4 * s);
+				}
+
+				for(auto i = 0; i < 32; i++)
+				{
+					left[i] ^= substituted[Tables.P[i]];
+				}
+			}
+
+			LIBCRYPTO_PUB uint64_t TestKeys(uint64_t plaintext, uint64_t ciphertext, uint64_t block)
+			{
+				// The plaintext is the same in every lane, and the final permutation is the inverse of the
+				// initial permutation, so run the ciphertext back through IP to get the expected halves
+				uint64_t left[32], right[32], expectedLeft, expectedRight;
+				split64(InitialBlockPermutation(plaintext), expectedLeft, expectedRight);
+				broadcast(expectedLeft, left, 32);
+				broadcast(expectedRight, right, 32);
+				split64(InitialBlockPermutation(ciphertext), expectedRight, expectedLeft);
+
+				// The low 6 bits of the key index vary across lanes, the rest come from the block number
+				uint64_t key[DES_KEYSPACE_BITS];
+				for(auto i = 0; i < 6; i++)
+				{
+					key[i] = LANE_PATTERNS[i];
+				}
+				broadcast(block, key + 6, DES_KEYSPACE_BITS - 6);
+
+				// The halves swap every round, so alternate which one is updated instead of moving them
+				for(auto r = 0; r < DES_ROUNDS; r += 2)
+				{
+					round(key, r, left, right);
+					round(key, r + 1, right, left);
+				}
+
+				// After an even number of rounds the last swap is undone, so compare left against R16
+				uint64_t mismatch = 0;
+				for(auto i = 0; i < 32; i++)
+				{
+					mismatch |= left[i] ^ (0ull - (expectedLeft >> i & 1));
+					mismatch |= right[i] ^ (0ull - (expectedRight >> i & 1));
+				}
+
+				return ~mismatch;
+			}
+
+			LIBCRYPTO_PUB uint64_t KeyFromIndex(uint64_t index)
+			{
+				uint64_t key = 0;
+				for(auto i = 0; i < DES_KEYSPACE_BITS; i++)
+				{
+					key |= (index >> i & 1) << Tables.PC1Inverse[i];
+				}
+
+				// Set the least significant bit of each byte so every byte has odd parity
+				for(auto b = 0; b < 64; b += 8)
+				{
+					auto byte = key >> b & 0xFE;
+					byte ^= byte >> 4;
+					byte ^= byte >> 2;
+					byte ^= byte >> 1;
+					key |= (~byte & 1) << b;
+				}
+
+				return key;
+			}
+
+			LIBCRYPTO_PUB uint64_t IndexFromKey(uint64_t key)
+			{
+				return KeyPC64To56(key);
+			}
+		}
+	}
+}
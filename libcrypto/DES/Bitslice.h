@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Bitslice.h - Bitsliced DES for testing 64 keys at a time
+ */
+#pragma once
+#include <cstdint>
+#include "../export.h"
+
+/** The number of keys tested in a single bitsliced pass (one per bit of a uint64_t) */
+#define DES_BITSLICE_LANES 64
+/** The number of effective key bits in DES (the size of the keyspace is 2^56) */
+#define DES_KEYSPACE_BITS 56
+
+namespace libcrypto
+{
+	namespace des
+	{
+		namespace bitslice
+		{
+			/**
+			 * Test the 64 keys with indices [block * 64, block * 64 + 63] against the known plaintext / ciphertext pair.
+			 *
+			 * A key index is the 56-bit output of the PC-1 permutation for that key (see KeyFromIndex). Returns a mask
+			 * where bit i is set iff the key with index block * 64 + i encrypts plaintext to ciphertext
+			 */
+			LIBCRYPTO_PUB uint64_t TestKeys(uint64_t plaintext, uint64_t ciphertext, uint64_t block);
+
+			/**
+			 * Convert a 56-bit key index back into a 64-bit DES key (the inverse of KeyPC64To56) with odd parity
+			 */
+			LIBCRYPTO_PUB uint64_t KeyFromIndex(uint64_t index);
+
+			/**
+			 * Convert a 64-bit DES key into its 56-bit key index (parity bits are ignored)
+			 */
+			LIBCRYPTO_PUB uint64_t IndexFromKey(uint64_t key);
+		}
+	}
+}
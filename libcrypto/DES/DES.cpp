@@ -26,8 +26,15 @@
 #include "../Util.h"
 #include "DES.h"
 #include "Math.h"
+#include "Schedule.h"
+#include "Simd.h"
+#include "Tables.h"
+#include <atomic>
 #include <iostream>
 
+/** The size of the keystream buffer used when encrypting in CTR or OFB mode (4KiB) */
+#define KEYSTREAM_CHUNK_SIZE 4096
+
 namespace libcrypto
 {
 	namespace des
@@ -47,76 +54,79 @@ namespace libcrypto
 		} Context;
 
 		/**
-		* Runs the specified block through the substitution boxes
-		*/
-		inline uint64_t substitute(uint64_t in)
+		 * The index of the round key to use in the specified round. Decryption runs the schedule backwards
+		 */
+		template<Action action>
+		constexpr size_t keyIndex(size_t round)
 		{
-			return S0[extract6(in, 1)] |
-				S1[extract6(in, 2)] |
-				S2[extract6(in, 3)] |
-				S3[extract6(in, 4)] |
-				S4[extract6(in, 5)] |
-				S5[extract6(in, 6)] |
-				S6[extract6(in, 7)] |
-				S7[extract6(in, 8)];
+			return action == ENCRYPT ? round : DES_ROUNDS - 1 - round;
 		}
 
 		/**
-		 * Transforms the block using the specified key schedule
+		 * Two fistel rounds starting at the specified round. Rather than swapping the halves after each round,
+		 * the second round updates the other half
 		 */
-		uint64_t TransformBlock(Context* ctx, uint64_t block)
+		template<Action action, size_t round>
+		inline void roundPair(const uint64_t* roundKeys, uint64_t& left, uint64_t& right)
 		{
-			// Perform the initial permutation on the plaintext
-			auto permutedBlock = InitialBlockPermutation(block);
-
-			// Split the plaintext into 32 bit left and right halves
-			uint64_t left, right;
+			left ^= feistel(right, roundKeys[keyIndex<action>(round)]);
+			right ^= feistel(left, roundKeys[keyIndex<action>(round + 1)]);
+		}
 
-			// Perform the initial permutation
-			split64(permutedBlock, left, right);
+		/**
+		 * Transforms the block (in memory order) using the round keys (in encryption order). The direction is chosen at compile time
+		 */
+		template<Action action>
+		inline uint64_t transformBlock(const uint64_t* roundKeys, uint64_t block)
+		{
+			// Perform the initial permutation and split the block into 32 bit left and right halves
+			auto permutedBlock = permute(CipherTables.IP, block);
+			auto left = duplicate(permutedBlock >> 32);
+			auto right = duplicate(permutedBlock & MASK32);
 
 			// 16 fistel rounds
-			for(auto i = 0; i < 16; i++)
-			{
-				// Expand and permute the right half of the block to 48 bits
-				auto expandedRightHalf = BlockPE32To48(right);
-
-				// XOR with the round key
-				// Important note: The correct round key (different order for encrypt vs. decyrpt) is taken care of when initializing the DES Context
-				auto roundKey = ctx->RoundKeys[i];
-				expandedRightHalf ^= roundKey;
-
-				// Substitute via S-Boxes
-				auto substituted = substitute(expandedRightHalf);
-
-				// Perform the final permutation
-				auto ciphertext = BlockP32(substituted);
-
-				// XOR with the left half
-				ciphertext ^= left;
+			roundPair<action,  0>(roundKeys, left, right);
+			roundPair<action,  2>(roundKeys, left, right);
+			roundPair<action,  4>(roundKeys, left, right);
+			roundPair<action,  6>(roundKeys, left, right);
+			roundPair<action,  8>(roundKeys, left, right);
+			roundPair<action, 10>(roundKeys, left, right);
+			roundPair<action, 12>(roundKeys, left, right);
+			roundPair<action, 14>(roundKeys, left, right);
+
+			// After an even number of rounds right holds R16 and left holds L16. The final permutation is applied to R16 || L16
+			return permute(CipherTables.FP, right << 32 | (left & MASK32));
+		}
 
-				// Swap the half-blocks for the next round
-				left = right;
-				right = ciphertext;
-			}
+		/**
+		 * True the first time it is called with a key, and false after that until it is called with a different one. Files
+		 * are streamed through Encrypt and Decrypt a chunk at a time, so the key is checked once per chunk
+		 */
+		bool firstCheck(uint64_t key)
+		{
+			static std::atomic<uint64_t> lastKey(0);
+			static std::atomic<bool> checked(false);
 
-			auto finalBlock = join64(right, left);
-			return FinalBlockPermutation(finalBlock);
+			auto previous = lastKey.exchange(key);
+			return !checked.exchange(true) || previous != key;
 		}
 
 		/**
-		 * Check the key against known weak, semi-weak, and potentially weak keys
+		 * Check the key against known weak, semi-weak, and potentially weak keys, warning about it once (see firstCheck)
 		 */
 		int __check_key_internal(uint64_t key)
 		{
 			auto strength = CheckKey(key);
+			if (strength == NOT_WEAK) return SUCCESS;
+
+			auto warn = firstCheck(key);
 
 #if !defined(NOENFORCE_WEAK_KEYS)
 			if(strength == WEAK)
 			{
-				std::cerr << "WARNING: Weak Key specified" << std::endl;
+				if (warn) std::cerr << "WARNING: Weak Key specified" << std::endl;
 #if defined(ENFORCE_NO_WEAK_KEYS)
-				std::cerr << "Recompile with WARN_WEAK_KEYS or NOENFORCE_WEAK_KEYS to allow weak keys" << std::endl;
+				if (warn) std::cerr << "Recompile with WARN_WEAK_KEYS or NOENFORCE_WEAK_KEYS to allow weak keys" << std::endl;
 				return ERR_KEY_TOO_WEAK;
 #endif
 			}
@@ -125,9 +135,9 @@ namespace libcrypto
 #if !defined(NOENFORCE_SEMI_WEAK_KEYS)
 			if(strength == SEMI_WEAK)
 			{
-				std::cerr << "WARNING: Semi-Weak Key specified" << std::endl;
+				if (warn) std::cerr << "WARNING: Semi-Weak Key specified" << std::endl;
 #if defined(ENFORCE_NO_SEMI_WEAK_KEYS)
-				std::cerr << "Recompile with WARN_SEMI_WEAK_KEYS or NOENFORCE_SEMI_WEAK_KEYS to allow semi-weak keys" << std::endl;
+				if (warn) std::cerr << "Recompile with WARN_SEMI_WEAK_KEYS or NOENFORCE_SEMI_WEAK_KEYS to allow semi-weak keys" << std::endl;
 				return ERR_KEY_TOO_WEAK;
 #endif
 			}
@@ -136,9 +146,9 @@ namespace libcrypto
 #if !defined(NOENFORCE_POSSIBLY_WEAK_KEYS)
 			if(strength == POSSIBLY_WEAK)
 			{
-				std::cerr << "WARNING: Possibly-weak Key specified" << std::endl;
+				if (warn) std::cerr << "WARNING: Possibly-weak Key specified" << std::endl;
 #if defined(ENFORCE_NO_POSSIBLY_WEAK_KEYS)
-				std::cerr << "Recompile with WARN_POSSIBLY_WEAK_KEYS or NOENFORCE_POSSIBLY_WEAK_KEYS to allow possibly-weak keys" << std::endl;
+				if (warn) std::cerr << "Recompile with WARN_POSSIBLY_WEAK_KEYS or NOENFORCE_POSSIBLY_WEAK_KEYS to allow possibly-weak keys" << std::endl;
 				return ERR_KEY_TOO_WEAK;
 #endif
 			}
@@ -162,9 +172,22 @@ namespace libcrypto
 		}
 
 		/**
-		 * Initialize the DES Context using the specified key
+		 * Load the round keys from the schedule into the context. They are always kept in encryption order
 		 */
-		Context* init(uint64_t key, char* data, size_t len, libcrypto::Action action, int& result)
+		inline void loadKeys(Context* ctx, des_key_schedule_t& schedule, libcrypto::Action action)
+		{
+			ctx->Action = action;
+
+			for(auto i = 0; i < DES_ROUNDS; i++)
+			{
+				ctx->RoundKeys[i] = schedule[i];
+			}
+		}
+
+		/**
+		 * Initialize the DES Context using the specified key schedule
+		 */
+		Context* init(des_key_schedule_t& schedule, char* data, size_t len, libcrypto::Action action, int& result)
 		{
 			// Check for valid input sizes
 			if (!checkSize(len))
@@ -174,7 +197,7 @@ namespace libcrypto
 			}
 
 			// Check the key strength (if enabled at compilation time)
-			auto keyCheck = __check_key_internal(key);
+			auto keyCheck = __check_key_internal(schedule.Key);
 			if (keyCheck != SUCCESS)
 			{
 				result = keyCheck;
@@ -182,21 +205,7 @@ namespace libcrypto
 			}
 
 			auto ctx = new Context;
-			ctx->Action = action;
-
-			// Initialize the key
-			//   1. Compress and Permute the key into 56 bits
-			//   2. Split the key into two 28 bit halves
-			uint64_t keyLeft, keyRight;
-			split56(KeyPC64To56(key), keyLeft, keyRight);
-
-			for(auto i = 0; i < 16; i++)
-			{
-				rotL28(keyLeft, RotationSchedule[i]);
-				rotL28(keyRight, RotationSchedule[i]);
-
-				ctx->RoundKeys[action == ENCRYPT ? i : 15-i] = KeyPC56To48(join56(keyLeft, keyRight));
-			}
+			loadKeys(ctx, schedule, action);
 
 			ctx->blocks = reinterpret_cast<uint64_t*>(data);
 			ctx->blockCount = len / 8;
@@ -205,20 +214,19 @@ namespace libcrypto
 			return ctx;
 		}
 
-		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, uint64_t key)
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, des_key_schedule_t schedule)
 		{
 			// Initialize the crypto context
 			int initStatus;
-			auto ctx = init(key, data, len, ENCRYPT, initStatus);
+			auto ctx = init(schedule, data, len, ENCRYPT, initStatus);
 			if (initStatus != SUCCESS) return initStatus;
 
-			// Encrypt all the things
+			// Encrypt all the things, 4 blocks at a time if the processor supports it
 			size_t i = 0;
-			while(i < ctx->blockCount)
+			if (simd::Enabled()) i = simd::TransformBlocks(ctx->RoundKeys, ENCRYPT, ctx->blocks, ctx->blockCount);
+			for(; i < ctx->blockCount; i++)
 			{
-				auto block = _byteswap_uint64(ctx->blocks[i]);
-				auto encrypted = TransformBlock(ctx, block);
-				ctx->blocks[i++] = _byteswap_uint64(encrypted);
+				ctx->blocks[i] = transformBlock<ENCRYPT>(ctx->RoundKeys, ctx->blocks[i]);
 			}
 
 			// Free the crypto context and return success
@@ -226,24 +234,21 @@ namespace libcrypto
 			return SUCCESS;
 		}
 
-		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, uint64_t key, uint64_t iv)
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, des_key_schedule_t schedule, uint64_t iv)
 		{
 			// Initialize the crypto context
 			int initStatus;
-			auto ctx = init(key, data, len, ENCRYPT, initStatus);
+			auto ctx = init(schedule, data, len, ENCRYPT, initStatus);
 			if (initStatus != SUCCESS) return initStatus;
 
-			auto previousBlock = iv;
+			// XOR commutes with the byte swap, so the chaining can happen in memory order
+			auto previousBlock = _byteswap_uint64(iv);
 
 			// Encrypt all the things
-			size_t i = 0;
-			while(i < ctx->blockCount)
+			for(size_t i = 0; i < ctx->blockCount; i++)
 			{
-				auto block = _byteswap_uint64(ctx->blocks[i]);
-				block ^= previousBlock;
-				auto encrypted = TransformBlock(ctx, block);
-				previousBlock = encrypted;
-				ctx->blocks[i++] = _byteswap_uint64(encrypted);
+				previousBlock = transformBlock<ENCRYPT>(ctx->RoundKeys, ctx->blocks[i] ^ previousBlock);
+				ctx->blocks[i] = previousBlock;
 			}
 
 			// Free the crypto context and return success
@@ -251,20 +256,19 @@ namespace libcrypto
 			return SUCCESS;
 		}
 
-		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, uint64_t key)
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, des_key_schedule_t schedule)
 		{
 			// Initialize the crypto context
 			int initStatus;
-			auto ctx = init(key, data, len, DECRYPT, initStatus);
+			auto ctx = init(schedule, data, len, DECRYPT, initStatus);
 			if (initStatus != SUCCESS) return initStatus;
 
-			// Decrypt all the things
+			// Decrypt all the things, 4 blocks at a time if the processor supports it
 			size_t i = 0;
-			while(i < ctx->blockCount)
+			if (simd::Enabled()) i = simd::TransformBlocks(ctx->RoundKeys, DECRYPT, ctx->blocks, ctx->blockCount);
+			for(; i < ctx->blockCount; i++)
 			{
-				auto block = _byteswap_uint64(ctx->blocks[i]);
-				auto decrypted = TransformBlock(ctx, block);
-				ctx->blocks[i++] = _byteswap_uint64(decrypted);
+				ctx->blocks[i] = transformBlock<DECRYPT>(ctx->RoundKeys, ctx->blocks[i]);
 			}
 
 			// Free the crypto context and return success
@@ -272,29 +276,184 @@ namespace libcrypto
 			return SUCCESS;
 		}
 
-		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, uint64_t key, uint64_t iv)
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, des_key_schedule_t schedule, uint64_t iv)
 		{
 			// Initialize the crypto context
 			int initStatus;
-			auto ctx = init(key, data, len, DECRYPT, initStatus);
+			auto ctx = init(schedule, data, len, DECRYPT, initStatus);
 			if (initStatus != SUCCESS) return initStatus;
 
-			auto previousBlock = iv;
+			// XOR commutes with the byte swap, so the chaining can happen in memory order
+			auto previousBlock = _byteswap_uint64(iv);
 
-			// Decrypt all the things
+			// Decrypt all the things. Unlike encryption, CBC decryption doesn't depend on the previous result, so the
+			// blocks can be decrypted 4 at a time if the processor supports it
 			size_t i = 0;
-			while(i < ctx->blockCount)
+			if (simd::Enabled()) i = simd::DecryptBlocksCBC(ctx->RoundKeys, ctx->blocks, ctx->blockCount, previousBlock);
+			for(; i < ctx->blockCount; i++)
 			{
-				auto block = _byteswap_uint64(ctx->blocks[i]);
-				auto decrypted = TransformBlock(ctx, block);
-				decrypted ^= previousBlock;
+				auto block = ctx->blocks[i];
+				ctx->blocks[i] = transformBlock<DECRYPT>(ctx->RoundKeys, block) ^ previousBlock;
 				previousBlock = block;
-				ctx->blocks[i++] = _byteswap_uint64(decrypted);
 			}
 
 			// Free the crypto context and return success
 			delete ctx;
 			return SUCCESS;
 		}
+
+		/**
+		 * Produce the next keystream block (in memory order), advancing the counter (CTR) or feedback (OFB)
+		 *
+		 * CTR encrypts successive counter blocks, which are independent of each other. OFB feeds each keystream block
+		 * back in as the input for the next one, so it is inherently serial but still independent of the data
+		 */
+		inline uint64_t nextKeystreamBlock(Context* ctx, Mode mode, uint64_t& counter, uint64_t& feedback)
+		{
+			auto input = mode == CTR ? _byteswap_uint64(counter++) : feedback;
+			feedback = transformBlock<ENCRYPT>(ctx->RoundKeys, input);
+			return feedback;
+		}
+
+		/**
+		 * Fill the buffer with keystream blocks, returning the IV that continues the stream
+		 */
+		uint64_t generateKeystream(Context* ctx, char* keystream, size_t len, uint64_t iv, Mode mode)
+		{
+			auto blocks = reinterpret_cast<uint64_t*>(keystream);
+			auto fullBlocks = len / DES_BLOCK_SIZE_BYTES;
+
+			auto counter = iv;
+			auto feedback = _byteswap_uint64(iv);
+
+			for(size_t i = 0; i < fullBlocks; i++)
+			{
+				blocks[i] = nextKeystreamBlock(ctx, mode, counter, feedback);
+			}
+
+			// Only the leading bytes of the final block are needed for a partial block
+			auto remainder = len % DES_BLOCK_SIZE_BYTES;
+			if(remainder != 0)
+			{
+				auto output = nextKeystreamBlock(ctx, mode, counter, feedback);
+				for(size_t b = 0; b < remainder; b++)
+				{
+					keystream[fullBlocks * DES_BLOCK_SIZE_BYTES + b] = static_cast<char>(output >> (8 * b));
+				}
+			}
+
+			return mode == CTR ? counter : _byteswap_uint64(feedback);
+		}
+
+		LIBCRYPTO_PUB int Keystream(char* keystream, size_t len, des_key_schedule_t schedule, uint64_t iv, Mode mode, uint64_t* next)
+		{
+			if (mode != CTR && mode != OFB) return ERR_MODE;
+
+			auto keyCheck = __check_key_internal(schedule.Key);
+			if (keyCheck != SUCCESS) return keyCheck;
+
+			// The keystream is always produced by the forward cipher, regardless of direction
+			Context ctx;
+			loadKeys(&ctx, schedule, ENCRYPT);
+
+			auto continuation = generateKeystream(&ctx, keystream, len, iv, mode);
+			if (next != nullptr) *next = continuation;
+
+			return SUCCESS;
+		}
+
+		LIBCRYPTO_PUB void ApplyKeystream(char* data, size_t len, const char* keystream)
+		{
+			auto blocks = reinterpret_cast<uint64_t*>(data);
+			auto stream = reinterpret_cast<const uint64_t*>(keystream);
+			auto fullBlocks = len / DES_BLOCK_SIZE_BYTES;
+
+			for(size_t i = 0; i < fullBlocks; i++)
+			{
+				blocks[i] ^= stream[i];
+			}
+
+			for(auto i = fullBlocks * DES_BLOCK_SIZE_BYTES; i < len; i++)
+			{
+				data[i] ^= keystream[i];
+			}
+		}
+
+		/**
+		 * Encrypt or decrypt the buffer in CTR or OFB mode (the two directions are identical)
+		 */
+		int streamCipher(char* data, size_t len, des_key_schedule_t& schedule, uint64_t iv, Mode mode)
+		{
+			auto keyCheck = __check_key_internal(schedule.Key);
+			if (keyCheck != SUCCESS) return keyCheck;
+
+			Context ctx;
+			loadKeys(&ctx, schedule, ENCRYPT);
+
+			// Generate the keystream a chunk at a time so the whole buffer never needs to be duplicated
+			char keystream[KEYSTREAM_CHUNK_SIZE];
+			for(size_t offset = 0; offset < len; offset += KEYSTREAM_CHUNK_SIZE)
+			{
+				auto chunk = len - offset < KEYSTREAM_CHUNK_SIZE ? len - offset : KEYSTREAM_CHUNK_SIZE;
+				iv = generateKeystream(&ctx, keystream, chunk, iv, mode);
+				ApplyKeystream(data + offset, chunk, keystream);
+			}
+
+			return SUCCESS;
+		}
+
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, des_key_schedule_t schedule, uint64_t iv, Mode mode)
+		{
+			switch(mode)
+			{
+				case ECB: return Encrypt(data, len, schedule);
+				case CBC: return Encrypt(data, len, schedule, iv);
+				case CTR:
+				case OFB: return streamCipher(data, len, schedule, iv, mode);
+				default: return ERR_MODE;
+			}
+		}
+
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, des_key_schedule_t schedule, uint64_t iv, Mode mode)
+		{
+			switch(mode)
+			{
+				case ECB: return Decrypt(data, len, schedule);
+				case CBC: return Decrypt(data, len, schedule, iv);
+				case CTR:
+				case OFB: return streamCipher(data, len, schedule, iv, mode);
+				default: return ERR_MODE;
+			}
+		}
+
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, uint64_t key)
+		{
+			return Encrypt(data, len, BuildSchedule(key));
+		}
+
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, uint64_t key, uint64_t iv)
+		{
+			return Encrypt(data, len, BuildSchedule(key), iv);
+		}
+
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, uint64_t key)
+		{
+			return Decrypt(data, len, BuildSchedule(key));
+		}
+
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, uint64_t key, uint64_t iv)
+		{
+			return Decrypt(data, len, BuildSchedule(key), iv);
+		}
+
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, uint64_t key, uint64_t iv, Mode mode)
+		{
+			return Encrypt(data, len, BuildSchedule(key), iv, mode);
+		}
+
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, uint64_t key, uint64_t iv, Mode mode)
+		{
+			return Decrypt(data, len, BuildSchedule(key), iv, mode);
+		}
 	}
 }
@@ -23,7 +23,9 @@
  */
 #pragma once
 #include "Boxes.h"
+#include "Schedule.h"
 #include "../export.h"
+#include "../libcrypto.h"
 
 #define DES_BLOCK_SIZE_BYTES 8
 
@@ -71,5 +73,56 @@ namespace libcrypto
 		 * Encrypt the buffer of the specified length using the provided key and initialization vector in CBC mode. The buffer must be a multiple of 8 bytes
 		 */
 		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, uint64_t key, uint64_t IV);
+
+		/**
+		 * Encrypt the buffer of the specified length using the provided key schedule in ECB mode. The buffer must be a multiple of 8 bytes
+		 */
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, des_key_schedule_t schedule);
+		/**
+		 * Encrypt the buffer of the specified length using the provided key schedule and initialization vector in CBC mode. The buffer must be a multiple of 8 bytes
+		 */
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, des_key_schedule_t schedule, uint64_t IV);
+
+		/**
+		 * Decrypt the buffer of the specified length using the provided key schedule in ECB mode. The buffer must be a multiple of 8 bytes
+		 */
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, des_key_schedule_t schedule);
+		/**
+		 * Decrypt the buffer of the specified length using the provided key schedule and initialization vector in CBC mode. The buffer must be a multiple of 8 bytes
+		 */
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, des_key_schedule_t schedule, uint64_t IV);
+
+		/**
+		 * Encrypt the buffer of the specified length using the provided key and IV in the specified mode. ECB and CBC require a multiple
+		 * of 8 bytes, CTR and OFB accept any length. For CTR, the IV is the initial 64-bit counter block
+		 */
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, uint64_t key, uint64_t IV, Mode mode);
+		/**
+		 * Decrypt the buffer of the specified length using the provided key and IV in the specified mode. ECB and CBC require a multiple
+		 * of 8 bytes, CTR and OFB accept any length. For CTR, the IV is the initial 64-bit counter block
+		 */
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, uint64_t key, uint64_t IV, Mode mode);
+		/**
+		 * Encrypt the buffer of the specified length using the provided key schedule and IV in the specified mode
+		 */
+		LIBCRYPTO_PUB int Encrypt(char* data, size_t len, des_key_schedule_t schedule, uint64_t IV, Mode mode);
+		/**
+		 * Decrypt the buffer of the specified length using the provided key schedule and IV in the specified mode
+		 */
+		LIBCRYPTO_PUB int Decrypt(char* data, size_t len, des_key_schedule_t schedule, uint64_t IV, Mode mode);
+
+		/**
+		 * Generate len bytes of CTR or OFB keystream ahead of time so only ApplyKeystream is left once the data arrives.
+		 *
+		 * If next is provided, it receives the IV to pass to the following call to continue the same stream (len must be
+		 * a multiple of 8 bytes to continue). CTR keystream can be generated out of order by advancing the counter by the
+		 * number of blocks to skip
+		 */
+		LIBCRYPTO_PUB int Keystream(char* keystream, size_t len, des_key_schedule_t schedule, uint64_t IV, Mode mode, uint64_t* next = nullptr);
+
+		/**
+		 * XOR the keystream into the buffer of the specified length (encrypts and decrypts in CTR and OFB modes)
+		 */
+		LIBCRYPTO_PUB void ApplyKeystream(char* data, size_t len, const char* keystream);
 	}
 }
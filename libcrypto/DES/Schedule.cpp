@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Schedule.cpp - Table-driven key schedule implementation for DES
+ */
+#include "Schedule.h"
+#include "Boxes.h"
+#include "Math.h"
+
+/** The number of bits in each group used to index the PC-2 tables (28-bit halves split 4 ways) */
+#define PC2_GROUP_BITS 7
+/** The number of groups each 28-bit half is split into */
+#define PC2_GROUPS 4
+/** A 7-bit mask */
+#define MASK7 0x7F
+
+namespace libcrypto
+{
+	namespace des
+	{
+		/**
+		 * Precomputed permutation tables for the key schedule
+		 *
+		 * Both PC-1 and (rotation + PC-2) are fixed bit permutations, so they can be split into
+		 * independent lookups that are OR'd together:
+		 *   PC1[byte][value]         - the PC-1 output bits contributed by one byte of the 64-bit key
+		 *   C[round][group][value]   - the left 24 bits of the round key contributed by 7 bits of C
+		 *   D[round][group][value]   - the right 24 bits of the round key contributed by 7 bits of D
+		 *
+		 * PC-2 draws its left half exclusively from C and its right half exclusively from D, so the
+		 * round tables only need to be 32 bits wide (64KiB total for all 16 rounds)
+		 */
+		typedef struct ScheduleTables
+		{
+			uint64_t PC1[8][256];
+			uint32_t C[DES_ROUNDS][PC2_GROUPS][1 << PC2_GROUP_BITS];
+			uint32_t D[DES_ROUNDS][PC2_GROUPS][1 << PC2_GROUP_BITS];
+
+			/** Derive the tables from the bit-by-bit permutations in Boxes.h */
+			ScheduleTables()
+			{
+				for(auto b = 0; b < 8; b++)
+				{
+					for(auto v = 0; v < 256; v++)
+					{
+						PC1[b][v] = KeyPC64To56((0ull | v) << (56 - 8 * b));
+					}
+				}
+
+				uint64_t shift = 0;
+				for(auto r = 0; r < DES_ROUNDS; r++)
+				{
+					shift += RotationSchedule[r];
+
+					for(auto g = 0; g < PC2_GROUPS; g++)
+					{
+						for(auto v = 0; v < (1 << PC2_GROUP_BITS); v++)
+						{
+							uint64_t half = (0ull | v) << (PC2_GROUP_BITS * (PC2_GROUPS - 1 - g));
+							rotL28(half, shift);
+
+							C[r][g][v] = static_cast<uint32_t>(KeyPC56To48(join56(half, 0)) >> 24);
+							D[r][g][v] = static_cast<uint32_t>(KeyPC56To48(join56(0, half)) & 0xFFFFFF);
+						}
+					}
+				}
+			}
+		} ScheduleTables;
+
+		/** The key schedule tables, built once when the library is loaded */
+		static const ScheduleTables Tables;
+
+		/** Compress and permute the 64-bit key into 56 bits one byte at a time */
+		inline uint64_t pc1(uint64_t key)
+		{
+			return Tables.PC1[0][key >> 56 & 0xFF] |
+				Tables.PC1[1][key >> 48 & 0xFF] |
+				Tables.PC1[2][key >> 40 & 0xFF] |
+				Tables.PC1[3][key >> 32 & 0xFF] |
+				Tables.PC1[4][key >> 24 & 0xFF] |
+				Tables.PC1[5][key >> 16 & 0xFF] |
+				Tables.PC1[6][key >>  8 & 0xFF] |
+				Tables.PC1[7][key       & 0xFF];
+		}
+
+		/** Compute the round key for the specified round directly from the unrotated PC-1 halves */
+		inline uint64_t pc2(size_t round, uint64_t c, uint64_t d)
+		{
+			auto left = Tables.C[round][0][c >> 21 & MASK7] |
+				Tables.C[round][1][c >> 14 & MASK7] |
+				Tables.C[round][2][c >>  7 & MASK7] |
+				Tables.C[round][3][c       & MASK7];
+
+			auto right = Tables.D[round][0][d >> 21 & MASK7] |
+				Tables.D[round][1][d >> 14 & MASK7] |
+				Tables.D[round][2][d >>  7 & MASK7] |
+				Tables.D[round][3][d       & MASK7];
+
+			return (0ull | left) << 24 | right;
+		}
+
+		LIBCRYPTO_PUB des_key_schedule_t BuildSchedule(uint64_t key)
+		{
+			des_key_schedule_t result;
+			result.Key = key;
+
+			uint64_t c, d;
+			split56(pc1(key), c, d);
+
+			for(auto i = 0; i < DES_ROUNDS; i++)
+			{
+				result[i] = pc2(i, c, d);
+			}
+
+			return result;
+		}
+
+		LIBCRYPTO_PUB void BuildSchedules(const uint64_t* keys, des_key_schedule_t* schedules, size_t count)
+		{
+			// Keys are independent, so derive two at a time to give the lookups in each round
+			// something to overlap with
+			size_t i = 0;
+			for(; i + 1 < count; i += 2)
+			{
+				uint64_t c0, d0, c1, d1;
+				split56(pc1(keys[i]), c0, d0);
+				split56(pc1(keys[i + 1]), c1, d1);
+
+				schedules[i].Key = keys[i];
+				schedules[i + 1].Key = keys[i + 1];
+
+				for(auto r = 0; r < DES_ROUNDS; r++)
+				{
+					schedules[i][r] = pc2(r, c0, d0);
+					schedules[i + 1][r] = pc2(r, c1, d1);
+				}
+			}
+
+			if(i < count)
+			{
+				schedules[i] = BuildSchedule(keys[i]);
+			}
+		}
+	}
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Schedule.h - Key Schedule Generation for DES
+ */
+#pragma once
+#include <cstdint>
+#include "../export.h"
+
+/** The number of fistel rounds (and round keys) in DES */
+#define DES_ROUNDS 16
+
+namespace libcrypto
+{
+	namespace des
+	{
+		/** The 16 round keys for a single DES key, in encryption order */
+		typedef struct
+		{
+			/** The key the schedule was derived from (used for weak key checks) */
+			uint64_t Key;
+			uint64_t keys[DES_ROUNDS];
+			uint64_t& operator[](size_t idx) { return keys[idx]; }
+		} des_key_schedule_t;
+
+		/**
+		 * Generate the key schedule for the specified key using the precomputed PC-1 and PC-2 tables
+		 */
+		LIBCRYPTO_PUB des_key_schedule_t BuildSchedule(uint64_t key);
+
+		/**
+		 * Generate the key schedules for count keys at once. schedules must have room for count entries
+		 */
+		LIBCRYPTO_PUB void BuildSchedules(const uint64_t* keys, des_key_schedule_t* schedules, size_t count);
+	}
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ * Simd.cpp - AVX2 DES implementation
+ *
+ * Each 64-bit lane of a ymm register holds one block, and every table lookup from the scalar implementation in
+ * Tables.h becomes a gather. The S-boxes and the P permutation are merged into a single table per S-box (SP), so
+ * each round is 8 gathers XOR'd together.
+ */
+#include "Simd.h"
+#include "Schedule.h"
+#include "Tables.h"
+#include "../Cpu.h"
+#include "../Mask.h"
+#include <atomic>
+#include <intrin.h>
+
+namespace libcrypto
+{
+	namespace des
+	{
+		namespace simd
+		{
+			/** Whether the caller allows dispatching to AVX2 (see SetEnabled) */
+			static std::atomic<bool> allowed(true);
+
+			LIBCRYPTO_PUB bool Supported()
+			{
+				return cpu::HasAVX2();
+			}
+
+			LIBCRYPTO_PUB void SetEnabled(bool enabled)
+			{
+				allowed = enabled;
+			}
+
+			LIBCRYPTO_PUB bool Enabled()
+			{
+				return allowed && Supported();
+			}
+
+			/** The 6-bit groups of every round key, broadcast to all lanes */
+			typedef struct
+			{
+				__m256i Groups[DES_ROUNDS][8];
+			} VectorKeys;
+
+			/** Split each round key into its 8 groups (S-box 0 uses the most significant 6 bits), reversing the order to decrypt */
+			inline void loadKeys(const uint64_t* roundKeys, Action action, VectorKeys& keys)
+			{
+				for(auto r = 0; r < DES_ROUNDS; r++)
+				{
+					auto key = roundKeys[action == ENCRYPT ? r : DES_ROUNDS - 1 - r];
+					for(auto s = 0; s < 8; s++)
+					{
+						keys.Groups[r][s] = _mm256_set1_epi64x(key >> (6 * (7 - s)) & MASK6);
+					}
+				}
+			}
+
+			/** Permute the blocks with one gather per byte */
+			inline __m256i permute4(const uint64_t table[8][256], __m256i in)
+			{
+				auto mask = _mm256_set1_epi64x(0xFF);
+				auto result = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(table[0]), _mm256_and_si256(in, mask), 8);
+
+				for(auto b = 1; b < 8; b++)
+				{
+					auto index = _mm256_and_si256(_mm256_srl_epi64(in, _mm_cvtsi32_si128(8 * b)), mask);
+					result = _mm256_or_si256(result, _mm256_i64gather_epi64(reinterpret_cast<const long long*>(table[b]), index, 8));
+				}
+
+				return result;
+			}
+
+			/** Look up the SP table entry for one S-box. group is E(R) for the S-box, already shifted into the low 6 bits */
+			inline __m256i sp(size_t s, __m256i group, __m256i key)
+			{
+				auto index = _mm256_and_si256(_mm256_xor_si256(group, key), _mm256_set1_epi64x(MASK6));
+				return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(CipherTables.SP[s]), index, 8);
+			}
+
+			/** The DES round function f(R, K) for 4 blocks (see feistel in Tables.h) */
+			inline __m256i feistel4(__m256i right, const __m256i* key)
+			{
+				auto result = sp(0, _mm256_srli_epi64(right, 27), key[0]);
+				result = _mm256_xor_si256(result, sp(1, _mm256_srli_epi64(right, 23), key[1]));
+				result = _mm256_xor_si256(result, sp(2, _mm256_srli_epi64(right, 19), key[2]));
+				result = _mm256_xor_si256(result, sp(3, _mm256_srli_epi64(right, 15), key[3]));
+				result = _mm256_xor_si256(result, sp(4, _mm256_srli_epi64(right, 11), key[4]));
+				result = _mm256_xor_si256(result, sp(5, _mm256_srli_epi64(right,  7), key[5]));
+				result = _mm256_xor_si256(result, sp(6, _mm256_srli_epi64(right,  3), key[6]));
+				return _mm256_xor_si256(result, sp(7, _mm256_srli_epi64(right, 31), key[7]));
+			}
+
+			/** Copy the low 32 bits of each lane into the high 32 bits */
+			inline __m256i duplicate4(__m256i half)
+			{
+				return _mm256_or_si256(half, _mm256_slli_epi64(half, 32));
+			}
+
+			/** Run 4 blocks (in memory order) through the cipher */
+			inline __m256i transform(const VectorKeys& keys, __m256i blocks)
+			{
+				auto permuted = permute4(CipherTables.IP, blocks);
+
+				auto left = duplicate4(_mm256_srli_epi64(permuted, 32));
+				auto right = duplicate4(_mm256_and_si256(permuted, _mm256_set1_epi64x(MASK32)));
+
+				// Alternate which half is updated rather than swapping them after every round
+				for(auto r = 0; r < DES_ROUNDS; r += 2)
+				{
+					left = _mm256_xor_si256(left, feistel4(right, keys.Groups[r]));
+					right = _mm256_xor_si256(right, feistel4(left, keys.Groups[r + 1]));
+				}
+
+				// After an even number of rounds right holds R16 and left holds L16, and the pre-output block is R16 || L16
+				auto preoutput = _mm256_or_si256(_mm256_slli_epi64(right, 32), _mm256_and_si256(left, _mm256_set1_epi64x(MASK32)));
+				return permute4(CipherTables.FP, preoutput);
+			}
+
+			size_t TransformBlocks(const uint64_t* roundKeys, Action action, uint64_t* blocks, size_t count)
+			{
+				VectorKeys keys;
+				loadKeys(roundKeys, action, keys);
+
+				size_t i = 0;
+				for(; i + DES_SIMD_LANES <= count; i += DES_SIMD_LANES)
+				{
+					auto block = _mm256_loadu_si256(reinterpret_cast<__m256i*>(blocks + i));
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(blocks + i), transform(keys, block));
+				}
+
+				return i;
+			}
+
+			size_t DecryptBlocksCBC(const uint64_t* roundKeys, uint64_t* blocks, size_t count, uint64_t& iv)
+			{
+				VectorKeys keys;
+				loadKeys(roundKeys, DECRYPT, keys);
+
+				auto previous = _mm256_set1_epi64x(iv);
+
+				size_t i = 0;
+				for(; i + DES_SIMD_LANES <= count; i += DES_SIMD_LANES)
+				{
+					auto ciphertext = _mm256_loadu_si256(reinterpret_cast<__m256i*>(blocks + i));
+
+					// Each block is chained with the one before it: [previous[3], c0, c1, c2]
+					auto chain = _mm256_blend_epi32(_mm256_permute4x64_epi64(ciphertext, 0x90), _mm256_permute4x64_epi64(previous, 0xFF), 0x03);
+					auto plaintext = _mm256_xor_si256(transform(keys, ciphertext), chain);
+
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(blocks + i), plaintext);
+					previous = ciphertext;
+				}
+
+				uint64_t last[DES_SIMD_LANES];
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(last), previous);
+				iv = last[DES_SIMD_LANES - 1];
+
+				return i;
+			}
+		}
+	}
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ * Simd.h - AVX2 DES that runs 4 blocks side by side using gathers for the S-box lookups
+ */
+#pragma once
+#include <cstdint>
+#include "../export.h"
+#include "../libcrypto.h"
+
+/** The number of blocks processed at once by the AVX2 implementation */
+#define DES_SIMD_LANES 4
+
+namespace libcrypto
+{
+	namespace des
+	{
+		namespace simd
+		{
+			/**
+			 * Whether or not the AVX2 implementation can be used on this processor
+			 */
+			LIBCRYPTO_PUB bool Supported();
+
+			/**
+			 * Allow or prevent ECB mode and CBC decryption from dispatching to the AVX2 implementation when it is supported.
+			 * Enabled by default, this only exists so validation and benchmarks can exercise the scalar implementation on the
+			 * same machine
+			 */
+			LIBCRYPTO_PUB void SetEnabled(bool enabled);
+
+			/**
+			 * Whether or not ECB mode and CBC decryption will use the AVX2 implementation
+			 */
+			LIBCRYPTO_PUB bool Enabled();
+
+			/**
+			 * Encrypt or decrypt the blocks in place in ECB mode using the round keys (in encryption order).
+			 *
+			 * Blocks are processed DES_SIMD_LANES at a time. Returns the number of blocks transformed, which is count rounded down to a
+			 * multiple of DES_SIMD_LANES, leaving the remaining blocks for the scalar implementation
+			 */
+			size_t TransformBlocks(const uint64_t* roundKeys, Action action, uint64_t* blocks, size_t count);
+
+			/**
+			 * Decrypt the blocks in place in CBC mode using the round keys (in encryption order).
+			 *
+			 * Returns the number of blocks decrypted like TransformBlocks. IV is in memory order (as it would appear in the
+			 * buffer) and is updated to the last ciphertext block that was consumed, so the scalar implementation can continue
+			 * the chain
+			 */
+			size_t DecryptBlocksCBC(const uint64_t* roundKeys, uint64_t* blocks, size_t count, uint64_t& IV);
+		}
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ * Tables.cpp - Derivation of the DES lookup tables
+ */
+#include "Tables.h"
+#include "Boxes.h"
+
+namespace libcrypto
+{
+	namespace des
+	{
+		/** Derive the lookup tables from the permutations and S-boxes in Boxes.h */
+		des_cipher_tables_t buildCipherTables()
+		{
+			des_cipher_tables_t tables;
+
+			const uint64_t* boxes[] = { S0, S1, S2, S3, S4, S5, S6, S7 };
+			for(auto s = 0; s < 8; s++)
+			{
+				for(auto v = 0; v < 64; v++)
+				{
+					tables.SP[s][v] = duplicate(BlockP32(boxes[s][v]) & MASK32);
+				}
+			}
+
+			for(auto b = 0; b < 8; b++)
+			{
+				for(auto v = 0; v < 256; v++)
+				{
+					// Byte b in memory is the b'th most significant byte of the block
+					tables.IP[b][v] = InitialBlockPermutation((0ull | v) << (56 - 8 * b));
+					tables.FP[b][v] = _byteswap_uint64(FinalBlockPermutation((0ull | v) << (8 * b)));
+				}
+			}
+
+			return tables;
+		}
+
+		const des_cipher_tables_t CipherTables = buildCipherTables();
+	}
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ * Tables.h - Precomputed lookup tables shared by the scalar and vector DES implementations
+ */
+#pragma once
+#include <cstdint>
+#include "../Mask.h"
+
+namespace libcrypto
+{
+	namespace des
+	{
+		/**
+		 * Lookup tables for the cipher, derived from the bit-by-bit permutations in Boxes.h
+		 *
+		 *   SP[s][v]     - BlockP32 applied to the output of S-box s for input v, duplicated into both 32-bit halves
+		 *   IP[byte][v]  - the initial permutation of the block whose byte (in memory order) has value v
+		 *   FP[byte][v]  - the final permutation of the pre-output block whose byte has value v, in memory order
+		 *
+		 * Keeping each 32-bit half duplicated in both halves of a uint64_t lets every 6-bit group of the expansion
+		 * permutation be extracted with a single shift, even the groups that wrap around the end of the half block.
+		 * Working in memory order removes the byte swaps on the way in and out of the cipher.
+		 */
+		typedef struct
+		{
+			uint64_t SP[8][64];
+			uint64_t IP[8][256];
+			uint64_t FP[8][256];
+		} des_cipher_tables_t;
+
+		/** The cipher tables, built once when the library is loaded */
+		extern const des_cipher_tables_t CipherTables;
+
+		/** Copy the low 32 bits into the high 32 bits */
+		inline uint64_t duplicate(uint64_t half)
+		{
+			return half << 32 | half;
+		}
+
+		/** Apply a byte-wise permutation table to the block */
+		inline uint64_t permute(const uint64_t table[8][256], uint64_t block)
+		{
+			return table[0][block       & 0xFF] |
+				table[1][block >>  8 & 0xFF] |
+				table[2][block >> 16 & 0xFF] |
+				table[3][block >> 24 & 0xFF] |
+				table[4][block >> 32 & 0xFF] |
+				table[5][block >> 40 & 0xFF] |
+				table[6][block >> 48 & 0xFF] |
+				table[7][block >> 56 & 0xFF];
+		}
+
+		/**
+		 * The DES round function f(R, K). right must be duplicated into both halves, and so is the result
+		 *
+		 * Expansion group s covers R bits [27 - 4s, 32 - 4s] (mod 32) and is combined with bits [42 - 6s, 47 - 6s] of the round key
+		 */
+		inline uint64_t feistel(uint64_t right, uint64_t key)
+		{
+			return CipherTables.SP[0][(right >> 27 ^ key >> 42) & MASK6] ^
+				CipherTables.SP[1][(right >> 23 ^ key >> 36) & MASK6] ^
+				CipherTables.SP[2][(right >> 19 ^ key >> 30) & MASK6] ^
+				CipherTables.SP[3][(right >> 15 ^ key >> 24) & MASK6] ^
+				CipherTables.SP[4][(right >> 11 ^ key >> 18) & MASK6] ^
+				CipherTables.SP[5][(right >>  7 ^ key >> 12) & MASK6] ^
+				CipherTables.SP[6][(right >>  3 ^ key >>  6) & MASK6] ^
+				CipherTables.SP[7][(right >> 31 ^ key      ) & MASK6];
+		}
+	}
+}
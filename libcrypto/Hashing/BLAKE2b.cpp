@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * BLAKE2b.cpp - Implementation of BLAKE2b, and of BLAKE2bp on four leaves side by side
+ */
+#include <stdexcept>
+#include <cstring>
+#include <intrin.h>
+#include "BLAKE2b.h"
+#include "SHA512Simd.h"
+#include "constants.h"
+
+/** The number of rounds of the BLAKE2b compression function */
+#define BLAKE2B_ROUNDS 12
+/** The number of bytes BLAKE2bp takes at a time, a block for each leaf */
+#define BLAKE2BP_STRIPE_SIZE_BYTES (BLAKE2BP_LEAVES * BLAKE2B_BLOCK_SIZE_BYTES)
+/** A stripe is compressed once more than this follows it, when every leaf is sure to get another block */
+#define BLAKE2BP_HELD_BYTES ((BLAKE2BP_LEAVES - 1) * BLAKE2B_BLOCK_SIZE_BYTES)
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		namespace BLAKE2b
+		{
+			/** Check the digest and key sizes, returning the digest size in bytes. Throws std::invalid_argument if unsupported */
+			size_t checkSizes(size_t digestBits, const char* key, size_t keyLength)
+			{
+				if (digestBits == 0 || digestBits > 512 || digestBits % 8 != 0) throw std::invalid_argument("Unsupported BLAKE2b digest size");
+				if (keyLength > BLAKE2B_MAX_KEY_SIZE_BYTES || (key == nullptr && keyLength > 0)) throw std::invalid_argument("BLAKE2b keys are at most 64 bytes");
+
+				return digestBits / 8;
+			}
+
+			/**
+			 * The initial hash value for a node with the specified parameters: the IV, XORed with the parameter block. Plain
+			 * BLAKE2b is a tree of one node (fanout and depth 1), and the salt and personalization are always zero
+			 */
+			void initialHashValue(size_t digestSize, size_t keyLength, uint64_t fanout, uint64_t depth, uint64_t nodeOffset, uint64_t nodeDepth, uint64_t innerLength, uint64_t* iv)
+			{
+				memcpy(iv, BLAKE2B_IV, sizeof(BLAKE2B_IV));
+
+				iv[0] ^= digestSize | keyLength << 8 | fanout << 16 | depth << 24;
+				iv[1] ^= nodeOffset;
+				iv[2] ^= nodeDepth | innerLength << 8;
+			}
+
+			/** The G function: mix the message words x and y into column or diagonal (a, b, c, d) of the work vector */
+			inline void mix(uint64_t* v, size_t a, size_t b, size_t c, size_t d, uint64_t x, uint64_t y)
+			{
+				v[a] += v[b] + x;
+				v[d] = _rotr64(v[d] ^ v[a], 32);
+				v[c] += v[d];
+				v[b] = _rotr64(v[b] ^ v[c], 24);
+				v[a] += v[b] + y;
+				v[d] = _rotr64(v[d] ^ v[a], 16);
+				v[c] += v[d];
+				v[b] = _rotr64(v[b] ^ v[c], 63);
+			}
+
+			/**
+			 * Compress the block into the hash value. counter is the number of bytes hashed once this block is included, last
+			 * is set for the last block of the message and lastNode for the last block of the last node of a tree level
+			 */
+			void compress(uint64_t* hash, const char* block, uint64_t counter, bool last, bool lastNode)
+			{
+				// Windows is LE, and so is BLAKE2b, so the words load as they are
+				uint64_t m[16];
+				memcpy(m, block, sizeof(m));
+
+				uint64_t v[16];
+				memcpy(v, hash, 8 * sizeof(uint64_t));
+				memcpy(v + 8, BLAKE2B_IV, sizeof(BLAKE2B_IV));
+
+				// Only 64 bits of the 128-bit counter are kept, as no message gets anywhere near 2^64 bytes
+				v[12] ^= counter;
+				if (last) v[14] = ~v[14];
+				if (lastNode) v[15] = ~v[15];
+
+				for(auto r = 0; r < BLAKE2B_ROUNDS; r++)
+				{
+					auto s = BLAKE2B_SIGMA[r];
+
+					mix(v, 0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);
+					mix(v, 1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);
+					mix(v, 2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);
+					mix(v, 3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);
+
+					mix(v, 0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);
+					mix(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+					mix(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+					mix(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+				}
+
+				for(auto i = 0; i < 8; i++)
+				{
+					hash[i] ^= v[i] ^ v[i + 8];
+				}
+			}
+
+			/** Rotate each 64-bit lane right by n bits. The byte-aligned rotations are a single shuffle */
+			template<int n> inline __m256i rotr(__m256i x)
+			{
+				switch(n)
+				{
+				case 32:
+					return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+				case 24:
+					return _mm256_shuffle_epi8(x, _mm256_setr_epi8(
+						3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+						3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10));
+				case 16:
+					return _mm256_shuffle_epi8(x, _mm256_setr_epi8(
+						2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+						2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9));
+				default:
+					return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n));
+				}
+			}
+
+			/** The G function in each of the four lanes */
+			inline void mixLanes(__m256i* v, size_t a, size_t b, size_t c, size_t d, __m256i x, __m256i y)
+			{
+				v[a] = _mm256_add_epi64(_mm256_add_epi64(v[a], v[b]), x);
+				v[d] = rotr<32>(_mm256_xor_si256(v[d], v[a]));
+				v[c] = _mm256_add_epi64(v[c], v[d]);
+				v[b] = rotr<24>(_mm256_xor_si256(v[b], v[c]));
+				v[a] = _mm256_add_epi64(_mm256_add_epi64(v[a], v[b]), y);
+				v[d] = rotr<16>(_mm256_xor_si256(v[d], v[a]));
+				v[c] = _mm256_add_epi64(v[c], v[d]);
+				v[b] = rotr<63>(_mm256_xor_si256(v[b], v[c]));
+			}
+
+			/** Like compressLeaves, with the leaves in the four AVX2 lanes. Requires AVX2 */
+			void compressLeavesAvx2(uint64_t state[8][BLAKE2BP_LEAVES], const char* stripe, uint64_t counter)
+			{
+				// Transpose the four blocks 4 words at a time, so m[t] holds word t of every leaf's block
+				__m256i m[16];
+				auto in = reinterpret_cast<const __m256i*>(stripe);
+				for(auto g = 0; g < 4; g++)
+				{
+					auto r0 = _mm256_loadu_si256(in + g);
+					auto r1 = _mm256_loadu_si256(in + 4 + g);
+					auto r2 = _mm256_loadu_si256(in + 8 + g);
+					auto r3 = _mm256_loadu_si256(in + 12 + g);
+
+					auto t0 = _mm256_unpacklo_epi64(r0, r1);
+					auto t1 = _mm256_unpackhi_epi64(r0, r1);
+					auto t2 = _mm256_unpacklo_epi64(r2, r3);
+					auto t3 = _mm256_unpackhi_epi64(r2, r3);
+
+					m[4 * g    ] = _mm256_permute2x128_si256(t0, t2, 0x20);
+					m[4 * g + 1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+					m[4 * g + 2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+					m[4 * g + 3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+				}
+
+				// The state is only 32-byte aligned on the stack: new doesn't honour alignas here, so use unaligned access
+				__m256i v[16];
+				for(auto i = 0; i < 8; i++)
+				{
+					v[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[i]));
+					v[i + 8] = _mm256_set1_epi64x(BLAKE2B_IV[i]);
+				}
+
+				v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi64x(counter));
+
+				for(auto r = 0; r < BLAKE2B_ROUNDS; r++)
+				{
+					auto s = BLAKE2B_SIGMA[r];
+
+					mixLanes(v, 0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);
+					mixLanes(v, 1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);
+					mixLanes(v, 2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);
+					mixLanes(v, 3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);
+
+					mixLanes(v, 0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);
+					mixLanes(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+					mixLanes(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+					mixLanes(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+				}
+
+				for(auto i = 0; i < 8; i++)
+				{
+					auto h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[i]));
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(state[i]), _mm256_xor_si256(h, _mm256_xor_si256(v[i], v[i + 8])));
+				}
+			}
+
+			/**
+			 * Compress block i of the stripe into leaf i, for all four BLAKE2bp leaves. None of them is a last block, and
+			 * every leaf has hashed counter bytes once its block is included
+			 */
+			void compressLeaves(uint64_t state[8][BLAKE2BP_LEAVES], const char* stripe, uint64_t counter)
+			{
+				if(simd::Enabled())
+				{
+					compressLeavesAvx2(state, stripe, counter);
+					return;
+				}
+
+				for(auto leaf = 0; leaf < BLAKE2BP_LEAVES; leaf++)
+				{
+					uint64_t hash[8];
+					for(auto i = 0; i < 8; i++)
+					{
+						hash[i] = state[i][leaf];
+					}
+
+					compress(hash, stripe + leaf * BLAKE2B_BLOCK_SIZE_BYTES, counter, false, false);
+
+					for(auto i = 0; i < 8; i++)
+					{
+						state[i][leaf] = hash[i];
+					}
+				}
+			}
+
+			LIBCRYPTO_PUB void ComputeHash(const char* buff, size_t len, char* digest, size_t digestBits, const char* key, size_t keyLength)
+			{
+				Blake2b hasher(digestBits, key, keyLength);
+				hasher.Update(buff, len);
+				hasher.Final(digest);
+			}
+
+			LIBCRYPTO_PUB void ComputeParallelHash(const char* buff, size_t len, char* digest, size_t digestBits, const char* key, size_t keyLength)
+			{
+				Blake2bp hasher(digestBits, key, keyLength);
+				hasher.Update(buff, len);
+				hasher.Final(digest);
+			}
+		}
+
+		Blake2b::Blake2b(size_t digestBits, const char* key, size_t keyLength) :
+			digestSize(BLAKE2b::checkSizes(digestBits, key, keyLength)), keyLength(keyLength)
+		{
+			BLAKE2b::initialHashValue(digestSize, keyLength, 1, 1, 0, 0, 0, initial);
+
+			memset(this->key, 0, sizeof(this->key));
+			if (keyLength > 0) memcpy(this->key, key, keyLength);
+
+			Init();
+		}
+
+		void Blake2b::Init()
+		{
+			memcpy(state, initial, sizeof(state));
+			length = 0;
+			counter = 0;
+
+			// A keyed message starts with the key block
+			memcpy(buffer, key, sizeof(buffer));
+			buffered = keyLength > 0 ? BLAKE2B_BLOCK_SIZE_BYTES : 0;
+		}
+
+		void Blake2b::Update(const char* data, size_t len)
+		{
+			length += len;
+
+			// The buffered block is only compressed once we know it isn't the last
+			if(buffered > 0 && len > BLAKE2B_BLOCK_SIZE_BYTES - buffered)
+			{
+				auto take = BLAKE2B_BLOCK_SIZE_BYTES - buffered;
+				memcpy(buffer + buffered, data, take);
+				data += take;
+				len -= take;
+
+				counter += BLAKE2B_BLOCK_SIZE_BYTES;
+				BLAKE2b::compress(state, buffer, counter, false, false);
+				buffered = 0;
+			}
+
+			// Full blocks are hashed straight from the input, except one that could be the last
+			while(len > BLAKE2B_BLOCK_SIZE_BYTES)
+			{
+				counter += BLAKE2B_BLOCK_SIZE_BYTES;
+				BLAKE2b::compress(state, data, counter, false, false);
+				data += BLAKE2B_BLOCK_SIZE_BYTES;
+				len -= BLAKE2B_BLOCK_SIZE_BYTES;
+			}
+
+			memcpy(buffer + buffered, data, len);
+			buffered += len;
+		}
+
+		void Blake2b::Final(char* digest)
+		{
+			memset(buffer + buffered, 0, BLAKE2B_BLOCK_SIZE_BYTES - buffered);
+			counter += buffered;
+			BLAKE2b::compress(state, buffer, counter, true, false);
+			buffered = 0;
+
+			// The digest is the leading bytes of the LE hash value
+			memcpy(digest, state, digestSize);
+		}
+
+		Blake2bp::Blake2bp(size_t digestBits, const char* key, size_t keyLength) :
+			digestSize(BLAKE2b::checkSizes(digestBits, key, keyLength)), keyLength(keyLength)
+		{
+			// Every node of the two-level tree has the final digest size and key length, and the leaves' inner digests are
+			// always 64 bytes
+			for(auto leaf = 0; leaf < BLAKE2BP_LEAVES; leaf++)
+			{
+				uint64_t iv[8];
+				BLAKE2b::initialHashValue(digestSize, keyLength, BLAKE2BP_LEAVES, 2, leaf, 0, BLAKE2B_DIGEST_SIZE_BYTES, iv);
+
+				for(auto i = 0; i < 8; i++)
+				{
+					initial[i][leaf] = iv[i];
+				}
+			}
+			BLAKE2b::initialHashValue(digestSize, keyLength, BLAKE2BP_LEAVES, 2, 0, 1, BLAKE2B_DIGEST_SIZE_BYTES, rootInitial);
+
+			memset(this->key, 0, sizeof(this->key));
+			if (keyLength > 0) memcpy(this->key, key, keyLength);
+
+			Init();
+		}
+
+		void Blake2bp::Init()
+		{
+			memcpy(state, initial, sizeof(state));
+			length = 0;
+			counter = 0;
+
+			// Every leaf of a keyed message starts with the key block, which is a stripe of four of them
+			buffered = 0;
+			if(keyLength > 0)
+			{
+				for(auto leaf = 0; leaf < BLAKE2BP_LEAVES; leaf++)
+				{
+					memcpy(buffer + leaf * BLAKE2B_BLOCK_SIZE_BYTES, key, BLAKE2B_BLOCK_SIZE_BYTES);
+				}
+				buffered = BLAKE2BP_STRIPE_SIZE_BYTES;
+			}
+		}
+
+		void Blake2bp::Update(const char* data, size_t len)
+		{
+			length += len;
+
+			if(buffered > 0)
+			{
+				// Top the buffer up to a stripe boundary, so the input that follows lines up with the leaves again
+				auto take = (BLAKE2BP_STRIPE_SIZE_BYTES - buffered % BLAKE2BP_STRIPE_SIZE_BYTES) % BLAKE2BP_STRIPE_SIZE_BYTES;
+				if (take > len) take = len;
+				memcpy(buffer + buffered, data, take);
+				buffered += take;
+				data += take;
+				len -= take;
+
+				if (buffered % BLAKE2BP_STRIPE_SIZE_BYTES != 0) return;
+
+				size_t done = 0;
+				while(done < buffered && buffered - done - BLAKE2BP_STRIPE_SIZE_BYTES + len > BLAKE2BP_HELD_BYTES)
+				{
+					counter += BLAKE2B_BLOCK_SIZE_BYTES;
+					BLAKE2b::compressLeaves(state, buffer + done, counter);
+					done += BLAKE2BP_STRIPE_SIZE_BYTES;
+				}
+
+				memmove(buffer, buffer + done, buffered - done);
+				buffered -= done;
+				if(buffered > 0)
+				{
+					memcpy(buffer + buffered, data, len);
+					buffered += len;
+					return;
+				}
+			}
+
+			// Stripes are hashed straight from the input while every leaf still has a block after them
+			while(len > BLAKE2BP_STRIPE_SIZE_BYTES + BLAKE2BP_HELD_BYTES)
+			{
+				counter += BLAKE2B_BLOCK_SIZE_BYTES;
+				BLAKE2b::compressLeaves(state, data, counter);
+				data += BLAKE2BP_STRIPE_SIZE_BYTES;
+				len -= BLAKE2BP_STRIPE_SIZE_BYTES;
+			}
+
+			memcpy(buffer, data, len);
+			buffered = len;
+		}
+
+		void Blake2bp::Final(char* digest)
+		{
+			memset(buffer + buffered, 0, sizeof(buffer) - buffered);
+
+			// What is left is at most two blocks per leaf, which are finished one leaf at a time. A leaf with nothing left
+			// must be empty, as stripes are only compressed while every leaf has more after them
+			char leaves[BLAKE2BP_LEAVES * BLAKE2B_DIGEST_SIZE_BYTES];
+			for(size_t leaf = 0; leaf < BLAKE2BP_LEAVES; leaf++)
+			{
+				uint64_t hash[8];
+				for(auto i = 0; i < 8; i++)
+				{
+					hash[i] = state[i][leaf];
+				}
+
+				auto lastLeaf = leaf == BLAKE2BP_LEAVES - 1;
+				auto first = leaf * BLAKE2B_BLOCK_SIZE_BYTES;
+				auto second = first + BLAKE2BP_STRIPE_SIZE_BYTES;
+				if(buffered > second)
+				{
+					BLAKE2b::compress(hash, buffer + first, counter + BLAKE2B_BLOCK_SIZE_BYTES, false, false);
+
+					auto bytes = buffered - second < BLAKE2B_BLOCK_SIZE_BYTES ? buffered - second : BLAKE2B_BLOCK_SIZE_BYTES;
+					BLAKE2b::compress(hash, buffer + second, counter + BLAKE2B_BLOCK_SIZE_BYTES + bytes, true, lastLeaf);
+				}
+				else
+				{
+					auto bytes = buffered <= first ? 0 : buffered - first < BLAKE2B_BLOCK_SIZE_BYTES ? buffered - first : BLAKE2B_BLOCK_SIZE_BYTES;
+					BLAKE2b::compress(hash, buffer + first, counter + bytes, true, lastLeaf);
+				}
+
+				memcpy(leaves + leaf * BLAKE2B_DIGEST_SIZE_BYTES, hash, sizeof(hash));
+			}
+			buffered = 0;
+
+			// The root hashes the leaves' 64-byte digests in order, which make exactly two blocks
+			uint64_t root[8];
+			memcpy(root, rootInitial, sizeof(root));
+			BLAKE2b::compress(root, leaves, BLAKE2B_BLOCK_SIZE_BYTES, false, false);
+			BLAKE2b::compress(root, leaves + BLAKE2B_BLOCK_SIZE_BYTES, 2 * BLAKE2B_BLOCK_SIZE_BYTES, true, true);
+
+			memcpy(digest, root, digestSize);
+		}
+	}
+}
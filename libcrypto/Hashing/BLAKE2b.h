@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * BLAKE2b.h - BLAKE2b (RFC 7693) and BLAKE2bp digests, plain or keyed
+ */
+#pragma once
+#include <cstdint>
+#include "../export.h"
+
+/** The number of bytes in a BLAKE2b message block */
+#define BLAKE2B_BLOCK_SIZE_BYTES 128
+/** The number of bytes in the longest (and default) BLAKE2b digest */
+#define BLAKE2B_DIGEST_SIZE_BYTES 64
+/** The number of bytes in the longest BLAKE2b key */
+#define BLAKE2B_MAX_KEY_SIZE_BYTES 64
+/** The number of BLAKE2b leaves BLAKE2bp spreads the message over */
+#define BLAKE2BP_LEAVES 4
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		namespace BLAKE2b
+		{
+			/**
+			 * Compute the BLAKE2b digest of the buffer into digest, which must hold digestBits / 8 bytes. digestBits may be any
+			 * multiple of 8 up to 512, and gives a different digest for each size (not a truncation). With a key of up to 64
+			 * bytes this is the BLAKE2b MAC.
+			 *
+			 * Never allocates. Throws std::invalid_argument for an unsupported digest or key size
+			 */
+			LIBCRYPTO_PUB void ComputeHash(const char* buff, size_t len, char* digest, size_t digestBits = 512, const char* key = nullptr, size_t keyLength = 0);
+
+			/**
+			 * Like ComputeHash, but with BLAKE2bp: a different function (with different digests) that hashes four interleaved
+			 * BLAKE2b leaves side by side in the SIMD lanes, which makes long messages several times faster
+			 */
+			LIBCRYPTO_PUB void ComputeParallelHash(const char* buff, size_t len, char* digest, size_t digestBits = 512, const char* key = nullptr, size_t keyLength = 0);
+		}
+
+		/**
+		 * Incremental BLAKE2b for messages that arrive in pieces of any size.
+		 *
+		 * BLAKE2b flags the last block of the message, so the last block seen is always held back in the buffer until Final
+		 * (even when it is full). Like Sha512, Update can be called with any length and never allocates.
+		 *
+		 * BLAKE2b is not a FIPS algorithm. It is meant for internal integrity checks where speed matters more
+		 */
+		class LIBCRYPTO_PUB Blake2b
+		{
+		public:
+			/**
+			 * Start a new message with the specified digest size, keyed with the first keyLength (at most 64) bytes of key if
+			 * given. Throws std::invalid_argument for an unsupported digest or key size
+			 */
+			explicit Blake2b(size_t digestBits = 512, const char* key = nullptr, size_t keyLength = 0);
+
+			/** The number of bytes Final writes */
+			size_t DigestSize() const { return digestSize; }
+			/** The number of message bytes hashed so far */
+			uint64_t Length() const { return length; }
+
+			/** Reset the hasher to start a new message with the same digest size and key */
+			void Init();
+			/** Add the next len bytes of the message */
+			void Update(const char* data, size_t len);
+			/** Compress the last block and write the DigestSize()-byte digest. Call Init before hashing another message */
+			void Final(char* digest);
+
+		private:
+			/** The initial hash value: the IV mixed with the parameter block */
+			uint64_t initial[8];
+			/** The number of bytes of the final state that make up the digest */
+			size_t digestSize;
+			/** The key, zero-padded to a full block, which is hashed as the first block of every message if keyed */
+			char key[BLAKE2B_BLOCK_SIZE_BYTES];
+			size_t keyLength;
+			/** The intermediate hash value */
+			uint64_t state[8];
+			/** The number of message bytes seen so far */
+			uint64_t length;
+			/** The number of bytes compressed so far (including the key block), which goes into every compression */
+			uint64_t counter;
+			/** The number of bytes waiting in buffer */
+			size_t buffered;
+			/** The last block seen, which is only compressed once more input arrives or in Final */
+			char buffer[BLAKE2B_BLOCK_SIZE_BYTES];
+		};
+
+		/**
+		 * Incremental BLAKE2bp: block i of the message goes to BLAKE2b leaf i % 4, and the digests of the four leaves are
+		 * hashed together by a BLAKE2b root. The leaves are compressed side by side, a block each at a time (in AVX2 lanes
+		 * when available, see simd::SetEnabled).
+		 *
+		 * A leaf can only compress a block once it knows another follows, so up to two blocks per leaf are held back
+		 */
+		class LIBCRYPTO_PUB Blake2bp
+		{
+		public:
+			/** Start a new message, as with Blake2b */
+			explicit Blake2bp(size_t digestBits = 512, const char* key = nullptr, size_t keyLength = 0);
+
+			/** The number of bytes Final writes */
+			size_t DigestSize() const { return digestSize; }
+			/** The number of message bytes hashed so far */
+			uint64_t Length() const { return length; }
+
+			/** Reset the hasher to start a new message with the same digest size and key */
+			void Init();
+			/** Add the next len bytes of the message */
+			void Update(const char* data, size_t len);
+			/** Finish the leaves and the root and write the DigestSize()-byte digest. Call Init before hashing another message */
+			void Final(char* digest);
+
+		private:
+			/** The initial hash value of each leaf (word-major, like the state) and of the root */
+			alignas(32) uint64_t initial[8][BLAKE2BP_LEAVES];
+			uint64_t rootInitial[8];
+			/** The number of bytes of the root's final state that make up the digest */
+			size_t digestSize;
+			/** The key, zero-padded to a full block, which is hashed as the first block of every leaf if keyed */
+			char key[BLAKE2B_BLOCK_SIZE_BYTES];
+			size_t keyLength;
+			/** The intermediate hash value of every leaf, word-major: state[i][leaf] */
+			alignas(32) uint64_t state[8][BLAKE2BP_LEAVES];
+			/** The number of message bytes seen so far */
+			uint64_t length;
+			/** The number of bytes compressed by each leaf so far (the same for all of them until Final) */
+			uint64_t counter;
+			/** The number of bytes waiting in buffer, which always starts at a block for the first leaf */
+			size_t buffered;
+			/** Up to two blocks per leaf, which are only compressed once every leaf has more after them, or in Final */
+			char buffer[2 * BLAKE2BP_LEAVES * BLAKE2B_BLOCK_SIZE_BYTES];
+		};
+	}
+}
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * FastCDC.cpp - Content-defined chunking with SHA512 chunk digests
+ */
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include "FastCDC.h"
+
+/** The number of bytes the Gear hash depends on (each byte is shifted out after 64 more) */
+#define GEAR_WINDOW_BYTES 64
+/** The fewest input bytes worth starting another thread to find candidate boundaries for (1 MiB) */
+#define FASTCDC_SCAN_BYTES_PER_THREAD (1024 * 1024)
+/** The fewest chunks worth starting another thread to hash */
+#define FASTCDC_CHUNKS_PER_THREAD 16
+/** The number of runs of the input each thread interleaves, so the table lookups of one overlap with the others */
+#define FASTCDC_INTERLEAVED_RUNS 4
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		/**
+		 * The random value each byte adds to the Gear hash. They come from SplitMix64 seeded with 0, so the table (and with
+		 * it every chunk boundary) can be reproduced by other implementations
+		 */
+		typedef struct GearTable
+		{
+			uint64_t Values[256];
+
+			GearTable()
+			{
+				uint64_t seed = 0;
+				for(auto i = 0; i < 256; i++)
+				{
+					auto z = (seed += 0x9E3779B97F4A7C15ull);
+					z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+					z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+					Values[i] = z ^ (z >> 31);
+				}
+			}
+		} GearTable;
+
+		/** The Gear values, built once when the library is loaded */
+		static const GearTable Gear;
+
+		/** A position the chunk may end at (inclusive), and whether it also qualifies before the average size */
+		typedef struct Candidate
+		{
+			size_t Position;
+			bool Strict;
+		} Candidate;
+
+		/**
+		 * Find the candidate boundaries in [from, to) of data. The hash at each position covers the 64 bytes up to it, so
+		 * the runs are warmed up from the bytes before them (positions within 64 bytes of the start of data only cover
+		 * part of the window, but they are always inside the minimum chunk size)
+		 */
+		void findCandidates(const uint8_t* data, size_t from, size_t to, uint64_t strictMask, uint64_t looseMask, std::vector<Candidate>& candidates)
+		{
+			size_t position[FASTCDC_INTERLEAVED_RUNS], end[FASTCDC_INTERLEAVED_RUNS];
+			uint64_t hash[FASTCDC_INTERLEAVED_RUNS];
+			std::vector<Candidate> found[FASTCDC_INTERLEAVED_RUNS];
+
+			for(auto r = 0; r < FASTCDC_INTERLEAVED_RUNS; r++)
+			{
+				position[r] = from + (to - from) * r / FASTCDC_INTERLEAVED_RUNS;
+				end[r] = from + (to - from) * (r + 1) / FASTCDC_INTERLEAVED_RUNS;
+
+				hash[r] = 0;
+				for(auto i = position[r] < GEAR_WINDOW_BYTES - 1 ? 0 : position[r] - (GEAR_WINDOW_BYTES - 1); i < position[r]; i++)
+				{
+					hash[r] = (hash[r] << 1) + Gear.Values[data[i]];
+				}
+			}
+
+			// The runs differ in length by at most one byte, so step all of them together as far as the shortest goes
+			auto steps = (to - from) / FASTCDC_INTERLEAVED_RUNS;
+			for(size_t step = 0; step < steps; step++)
+			{
+				for(auto r = 0; r < FASTCDC_INTERLEAVED_RUNS; r++)
+				{
+					hash[r] = (hash[r] << 1) + Gear.Values[data[position[r]]];
+					if ((hash[r] & looseMask) == 0) found[r].push_back({ position[r], (hash[r] & strictMask) == 0 });
+					position[r]++;
+				}
+			}
+
+			for(auto r = 0; r < FASTCDC_INTERLEAVED_RUNS; r++)
+			{
+				for(; position[r] < end[r]; position[r]++)
+				{
+					hash[r] = (hash[r] << 1) + Gear.Values[data[position[r]]];
+					if ((hash[r] & looseMask) == 0) found[r].push_back({ position[r], (hash[r] & strictMask) == 0 });
+				}
+
+				candidates.insert(candidates.end(), found[r].begin(), found[r].end());
+			}
+		}
+
+		/** Hash the chunks, splitting them into contiguous runs across up to threads threads */
+		void hashChunks(const char* data, Chunk* chunks, size_t count, uint64_t offset, size_t threads)
+		{
+			std::vector<const char*> messages(count);
+			std::vector<size_t> lengths(count);
+			std::vector<char> digests(count * SHA512_DIGEST_SIZE_BYTES);
+			for(size_t i = 0; i < count; i++)
+			{
+				messages[i] = data + (chunks[i].Offset - offset);
+				lengths[i] = chunks[i].Length;
+			}
+
+			if (threads > count / FASTCDC_CHUNKS_PER_THREAD) threads = count / FASTCDC_CHUNKS_PER_THREAD;
+			if(threads <= 1)
+			{
+				SHA512::ComputeHashes(messages.data(), lengths.data(), digests.data(), count);
+			}
+			else
+			{
+				// Each thread runs the multi-buffer hash over its own run, so the lanes stay full within every thread
+				std::vector<std::thread> workers;
+				for(size_t t = 0; t < threads; t++)
+				{
+					auto first = count * t / threads;
+					auto end = count * (t + 1) / threads;
+					workers.push_back(std::thread(SHA512::ComputeHashes, messages.data() + first, lengths.data() + first, digests.data() + first * SHA512_DIGEST_SIZE_BYTES, end - first, 512));
+				}
+
+				for(auto& worker : workers)
+				{
+					worker.join();
+				}
+			}
+
+			for(size_t i = 0; i < count; i++)
+			{
+				memcpy(chunks[i].Digest, digests.data() + i * SHA512_DIGEST_SIZE_BYTES, SHA512_DIGEST_SIZE_BYTES);
+			}
+		}
+
+		FastCdc::FastCdc(size_t averageSize, size_t threads) : averageSize(averageSize), threads(threads)
+		{
+			if(averageSize < FASTCDC_MIN_AVERAGE_SIZE_BYTES || averageSize > FASTCDC_MAX_AVERAGE_SIZE_BYTES || (averageSize & (averageSize - 1)) != 0)
+			{
+				throw std::invalid_argument("The average chunk size must be a power of two from 256 bytes to 16 MiB");
+			}
+
+			minSize = averageSize / 4;
+			maxSize = averageSize * 8;
+
+			// Normalized chunking: two bits more than the average before it and two bits fewer after, taken from the top of
+			// the hash where every bit depends on the whole window. Every strict candidate is also a loose one
+			auto bits = 0;
+			while ((1ull << bits) < averageSize) bits++;
+			strictMask = ~0ull << (64 - (bits + 2));
+			looseMask = ~0ull << (64 - (bits - 2));
+
+			if (this->threads == 0) this->threads = std::thread::hardware_concurrency();
+			if (this->threads == 0) this->threads = 1;
+
+			Init();
+		}
+
+		void FastCdc::Init()
+		{
+			length = 0;
+			tail.clear();
+		}
+
+		size_t FastCdc::cut(const char* data, size_t len, uint64_t offset, bool last, size_t threads, std::vector<Chunk>& chunks)
+		{
+			auto bytes = reinterpret_cast<const uint8_t*>(data);
+
+			// Find every candidate in one pass, split across the threads
+			std::vector<Candidate> candidates;
+			auto scanners = len / FASTCDC_SCAN_BYTES_PER_THREAD < threads ? len / FASTCDC_SCAN_BYTES_PER_THREAD : threads;
+			if(scanners <= 1)
+			{
+				findCandidates(bytes, 0, len, strictMask, looseMask, candidates);
+			}
+			else
+			{
+				std::vector<std::vector<Candidate>> found(scanners);
+				std::vector<std::thread> workers;
+				for(size_t t = 0; t < scanners; t++)
+				{
+					workers.push_back(std::thread(findCandidates, bytes, len * t / scanners, len * (t + 1) / scanners, strictMask, looseMask, std::ref(found[t])));
+				}
+
+				for(size_t t = 0; t < scanners; t++)
+				{
+					workers[t].join();
+					candidates.insert(candidates.end(), found[t].begin(), found[t].end());
+				}
+			}
+
+			// Walk the candidates to pick the boundaries: a chunk ends at the first strict candidate after the minimum
+			// size, or the first loose one after the average size, or at the maximum size
+			auto first = chunks.size();
+			size_t start = 0, next = 0;
+			while(start < len)
+			{
+				auto end = start;
+				for(; next < candidates.size(); next++)
+				{
+					auto size = candidates[next].Position - start + 1;
+					if (size < minSize) continue;
+					if (size > maxSize) break;
+
+					if(size >= averageSize || candidates[next].Strict)
+					{
+						end = candidates[next].Position + 1;
+						next++;
+						break;
+					}
+				}
+
+				if(end == start)
+				{
+					// No boundary yet: the maximum size forces one, otherwise wait for more input (or stop at the end)
+					if (len - start >= maxSize) end = start + maxSize;
+					else if (last) end = len;
+					else break;
+				}
+
+				chunks.push_back({ offset + start, end - start, { 0 } });
+				start = end;
+			}
+
+			hashChunks(data, chunks.data() + first, chunks.size() - first, offset, threads);
+			return start;
+		}
+
+		void FastCdc::Update(const char* data, size_t len, std::vector<Chunk>& chunks)
+		{
+			auto offset = length;
+			length += len;
+
+			// Finish the carried over chunk first: it ends within MaxSize() of its start, so that much is enough to cut it
+			if(!tail.empty())
+			{
+				auto carried = tail.size();
+				auto take = len < maxSize - carried ? len : maxSize - carried;
+				tail.insert(tail.end(), data, data + take);
+
+				auto done = cut(tail.data(), tail.size(), offset - carried, false, 1, chunks);
+				if (done == 0) return;
+
+				// Carry on from where the cut chunks end in the new data
+				data += done - carried;
+				len -= done - carried;
+				offset += done - carried;
+				tail.clear();
+			}
+
+			auto done = cut(data, len, offset, false, threads, chunks);
+			tail.assign(data + done, data + len);
+		}
+
+		void FastCdc::Final(std::vector<Chunk>& chunks)
+		{
+			// The carried over chunk is all that is left, however small
+			if (!tail.empty()) cut(tail.data(), tail.size(), length - tail.size(), true, 1, chunks);
+
+			Init();
+		}
+	}
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * FastCDC.h - Content-defined chunking with SHA512 chunk digests
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "SHA512.h"
+#include "../export.h"
+
+/** The default average size of a chunk (8 KiB) */
+#define FASTCDC_DEFAULT_AVERAGE_SIZE_BYTES (8 * 1024)
+/** The smallest supported average chunk size, which keeps the minimum chunk size at least the 64-byte hash window */
+#define FASTCDC_MIN_AVERAGE_SIZE_BYTES 256
+/** The largest supported average chunk size (16 MiB) */
+#define FASTCDC_MAX_AVERAGE_SIZE_BYTES (16 * 1024 * 1024)
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		/** A chunk of the input: where it starts, how long it is and its SHA512 digest */
+		typedef struct Chunk
+		{
+			uint64_t Offset;
+			size_t Length;
+			char Digest[SHA512_DIGEST_SIZE_BYTES];
+		} Chunk;
+
+		/**
+		 * Splits a stream into variable-size chunks at content-defined boundaries with FastCDC, and hashes each chunk with
+		 * SHA512. Inserting or removing bytes only changes the chunks around the edit, so chunks can be deduplicated
+		 * between versions of a file.
+		 *
+		 * The boundaries come from a 64-bit Gear rolling hash, which only depends on the last 64 bytes. Whether a position
+		 * is a candidate boundary is independent of where the chunk started, so candidates are found across threads (each
+		 * interleaving four runs of the input) in a single pass, and only the cheap walk over the candidates that applies the
+		 * minimum, normalized and maximum sizes is sequential. Chunks are then hashed across the threads and SIMD lanes.
+		 *
+		 * Chunks are between a quarter and eight times the average size (the last may be shorter). The average must be a
+		 * power of two
+		 */
+		class LIBCRYPTO_PUB FastCdc
+		{
+		public:
+			/**
+			 * Start a new stream with the specified average chunk size, finding and hashing chunks on up to threads threads
+			 * (0 for one per core). Throws std::invalid_argument if the average size is not a supported power of two
+			 */
+			explicit FastCdc(size_t averageSize = FASTCDC_DEFAULT_AVERAGE_SIZE_BYTES, size_t threads = 0);
+
+			/** The smallest chunk, other than the last */
+			size_t MinSize() const { return minSize; }
+			/** The size chunks are normalized towards */
+			size_t AverageSize() const { return averageSize; }
+			/** The largest chunk */
+			size_t MaxSize() const { return maxSize; }
+			/** The number of input bytes seen so far */
+			uint64_t Length() const { return length; }
+
+			/** Discard the stream and start over */
+			void Init();
+			/**
+			 * Add the next len bytes of input, appending the chunks that are now complete to chunks. The unfinished chunk at
+			 * the end (at most MaxSize() bytes) is copied and carried over to the next call
+			 */
+			void Update(const char* data, size_t len, std::vector<Chunk>& chunks);
+			/** Append the last chunk, if there is anything left, and start over */
+			void Final(std::vector<Chunk>& chunks);
+
+		private:
+			/**
+			 * Cut data (which is at offset in the stream) into chunks from its start, hashing and appending the complete ones.
+			 * With last, whatever is left at the end is a chunk too. Returns the number of bytes cut
+			 */
+			size_t cut(const char* data, size_t len, uint64_t offset, bool last, size_t threads, std::vector<Chunk>& chunks);
+
+			/** The chunk size limits */
+			size_t minSize;
+			size_t averageSize;
+			size_t maxSize;
+			/** A position is a boundary if these bits of the hash are 0: more of them before the average size, fewer after */
+			uint64_t strictMask;
+			uint64_t looseMask;
+			/** The number of threads to find and hash chunks on */
+			size_t threads;
+			/** The number of input bytes seen so far */
+			uint64_t length;
+			/** The unfinished chunk carried over between calls to Update */
+			std::vector<char> tail;
+		};
+	}
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * HMAC.cpp - HMAC (FIPS 198-1) over the SHA512 family
+ */
+#include <cstring>
+#include "HMAC.h"
+
+/** The number of messages whose inner digests are batched together at a time in ComputeMacs */
+#define HMAC_BATCH_SIZE 64
+
+/** The byte XOR'd into the key for the inner hash */
+#define HMAC_IPAD 0x36
+/** The byte XOR'd into the key for the outer hash */
+#define HMAC_OPAD 0x5c
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		HmacSha512::HmacSha512(const char* key, size_t keyLen, size_t digestBits) : macSize(digestBits / 8), hasher(digestBits)
+		{
+			// Keys longer than a block are hashed first, shorter keys are padded with zeroes
+			char block[SHA512_BLOCK_SIZE_BYTES] = { 0 };
+			if(keyLen > SHA512_BLOCK_SIZE_BYTES)
+			{
+				hasher.Update(key, keyLen);
+				hasher.Final(block);
+			}
+			else
+			{
+				memcpy(block, key, keyLen);
+			}
+
+			uint64_t prefixLength;
+			for(auto i = 0; i < SHA512_BLOCK_SIZE_BYTES; i++)
+			{
+				block[i] ^= HMAC_IPAD;
+			}
+			hasher.Init();
+			hasher.Update(block, SHA512_BLOCK_SIZE_BYTES);
+			hasher.Midstate(innerMidstate, prefixLength);
+
+			for(auto i = 0; i < SHA512_BLOCK_SIZE_BYTES; i++)
+			{
+				block[i] ^= HMAC_IPAD ^ HMAC_OPAD;
+			}
+			hasher.Init();
+			hasher.Update(block, SHA512_BLOCK_SIZE_BYTES);
+			hasher.Midstate(outerMidstate, prefixLength);
+
+			memset(block, 0, sizeof(block));
+			Init();
+		}
+
+		void HmacSha512::Init()
+		{
+			hasher.Resume(innerMidstate, SHA512_BLOCK_SIZE_BYTES);
+		}
+
+		void HmacSha512::Update(const char* data, size_t len)
+		{
+			hasher.Update(data, len);
+		}
+
+		void HmacSha512::Final(char* mac)
+		{
+			char inner[SHA512_DIGEST_SIZE_BYTES];
+			hasher.Final(inner);
+
+			hasher.Resume(outerMidstate, SHA512_BLOCK_SIZE_BYTES);
+			hasher.Update(inner, macSize);
+			hasher.Final(mac);
+		}
+
+		void HmacSha512::ComputeMac(const char* message, size_t len, char* mac) const
+		{
+			auto copy = *this;
+			copy.Init();
+			copy.Update(message, len);
+			copy.Final(mac);
+		}
+
+		void HmacSha512::ComputeMacs(const char* const* messages, const size_t* lengths, char* macs, size_t count) const
+		{
+			char inner[HMAC_BATCH_SIZE * SHA512_DIGEST_SIZE_BYTES];
+			const char* innerDigests[HMAC_BATCH_SIZE];
+			size_t innerLengths[HMAC_BATCH_SIZE];
+
+			for(size_t first = 0; first < count; first += HMAC_BATCH_SIZE)
+			{
+				auto batch = count - first < HMAC_BATCH_SIZE ? count - first : HMAC_BATCH_SIZE;
+
+				// Inner hashes of the messages, then the outer hashes of the inner digests, both side by side in the lanes
+				SHA512::ResumeHashes(innerMidstate, SHA512_BLOCK_SIZE_BYTES, messages + first, lengths + first, inner, batch, macSize);
+
+				for(size_t i = 0; i < batch; i++)
+				{
+					innerDigests[i] = inner + i * macSize;
+					innerLengths[i] = macSize;
+				}
+
+				SHA512::ResumeHashes(outerMidstate, SHA512_BLOCK_SIZE_BYTES, innerDigests, innerLengths, macs + first * macSize, batch, macSize);
+			}
+		}
+
+		void HmacSha512::Midstates(uint64_t* inner, uint64_t* outer) const
+		{
+			memcpy(inner, innerMidstate, sizeof(innerMidstate));
+			memcpy(outer, outerMidstate, sizeof(outerMidstate));
+		}
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * HMAC.h - HMAC (FIPS 198-1) over the SHA512 family
+ */
+#pragma once
+#include <cstdint>
+#include "SHA512.h"
+#include "../export.h"
+
+/** The number of bytes in an HMAC-SHA512 tag */
+#define HMAC_SHA512_MAC_SIZE_BYTES SHA512_DIGEST_SIZE_BYTES
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		/**
+		 * A keyed HMAC context for the SHA512 family.
+		 *
+		 * The key is only processed once: the inner (key XOR ipad) and outer (key XOR opad) blocks are compressed up front
+		 * and kept as midstates. Each MAC then only costs the message blocks plus one outer block. The context can be
+		 * reused for any number of messages
+		 */
+		class LIBCRYPTO_PUB HmacSha512
+		{
+		public:
+			/**
+			 * Derive the context for the key. digestBits selects the underlying member of the SHA512 family like
+			 * SHA512::ComputeHash (e.g. 384 for HMAC-SHA384)
+			 */
+			HmacSha512(const char* key, size_t keyLen, size_t digestBits = 512);
+
+			/** The number of bytes Final writes */
+			size_t MacSize() const { return macSize; }
+
+			/** Start a new message */
+			void Init();
+			/** Add the next len bytes of the message */
+			void Update(const char* data, size_t len);
+			/** Write the MacSize()-byte tag. Call Init before authenticating another message */
+			void Final(char* mac);
+
+			/** Compute the tag of a complete message without disturbing an incremental message in progress */
+			void ComputeMac(const char* message, size_t len, char* mac) const;
+
+			/**
+			 * Compute the tags of count independent messages with the multi-buffer hash (see SHA512::ComputeHashes),
+			 * writing the tag of message i to macs + i * MacSize()
+			 */
+			void ComputeMacs(const char* const* messages, const size_t* lengths, char* macs, size_t count) const;
+
+			/**
+			 * Copy out the inner and outer midstates (8 words each), for callers that drive the compression function
+			 * directly on fixed-size messages such as PBKDF2
+			 */
+			void Midstates(uint64_t* inner, uint64_t* outer) const;
+
+		private:
+			/** The intermediate hash value after the key XOR ipad block */
+			uint64_t innerMidstate[8];
+			/** The intermediate hash value after the key XOR opad block */
+			uint64_t outerMidstate[8];
+			/** The number of bytes in a tag */
+			size_t macSize;
+			/** The hasher for the incremental API */
+			Sha512 hasher;
+		};
+	}
+}
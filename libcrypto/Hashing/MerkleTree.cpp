@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * MerkleTree.cpp - Parallel tree hashing over SHA512 with inclusion proofs for byte ranges
+ */
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include "MerkleTree.h"
+
+/** The first byte of the domain separation block hashed ahead of every leaf */
+#define MERKLE_LEAF_PREFIX 0x00
+/** The first byte of the domain separation block hashed ahead of every pair of child digests */
+#define MERKLE_NODE_PREFIX 0x01
+/** The fewest interior nodes worth starting another thread for (each is only three compressions) */
+#define MERKLE_NODES_PER_THREAD 1024
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		/**
+		 * The intermediate hash values after the domain separation blocks. Making the prefix a whole block keeps the leaf
+		 * data block aligned, and it costs nothing per message since hashing resumes from these midstates
+		 */
+		typedef struct PrefixMidstates
+		{
+			uint64_t Leaf[8];
+			uint64_t Node[8];
+
+			PrefixMidstates()
+			{
+				char block[SHA512_BLOCK_SIZE_BYTES] = { 0 };
+				uint64_t prefixLength;
+				Sha512 hasher;
+
+				block[0] = MERKLE_LEAF_PREFIX;
+				hasher.Update(block, SHA512_BLOCK_SIZE_BYTES);
+				hasher.Midstate(Leaf, prefixLength);
+
+				block[0] = MERKLE_NODE_PREFIX;
+				hasher.Init();
+				hasher.Update(block, SHA512_BLOCK_SIZE_BYTES);
+				hasher.Midstate(Node, prefixLength);
+			}
+		} PrefixMidstates;
+
+		/** The prefix midstates, computed once when the library is loaded */
+		static const PrefixMidstates Prefixes;
+
+		/**
+		 * Hash count messages from the midstate, splitting them into contiguous runs across up to threads threads with at
+		 * least perThread messages each
+		 */
+		void hashParallel(const uint64_t* midstate, const char* const* messages, const size_t* lengths, char* digests, size_t count, size_t threads, size_t perThread)
+		{
+			if (threads > count / perThread) threads = count / perThread;
+
+			if(threads <= 1)
+			{
+				SHA512::ResumeHashes(midstate, SHA512_BLOCK_SIZE_BYTES, messages, lengths, digests, count, SHA512_DIGEST_SIZE_BYTES);
+				return;
+			}
+
+			// Each thread runs the multi-buffer hash over its own run, so the lanes stay full within every thread
+			std::vector<std::thread> workers;
+			for(size_t t = 0; t < threads; t++)
+			{
+				auto first = count * t / threads;
+				auto end = count * (t + 1) / threads;
+
+				workers.push_back(std::thread(SHA512::ResumeHashes, midstate, SHA512_BLOCK_SIZE_BYTES, messages + first, lengths + first, digests + first * SHA512_DIGEST_SIZE_BYTES, end - first, SHA512_DIGEST_SIZE_BYTES));
+			}
+
+			for(auto& worker : workers)
+			{
+				worker.join();
+			}
+		}
+
+		/** Hash the leaves of data, which starts at a leaf boundary and ends at one or at the end of the input */
+		void hashLeaves(const char* data, size_t len, size_t leafSize, char* digests, size_t threads)
+		{
+			auto count = len == 0 ? 1 : (len + leafSize - 1) / leafSize;
+
+			std::vector<const char*> messages(count);
+			std::vector<size_t> lengths(count, leafSize);
+			for(size_t i = 0; i < count; i++)
+			{
+				messages[i] = data + i * leafSize;
+			}
+			lengths[count - 1] = len - (count - 1) * leafSize;
+
+			hashParallel(Prefixes.Leaf, messages.data(), lengths.data(), digests, count, threads, 1);
+		}
+
+		/**
+		 * Hash count pairs of adjacent digests into their parents. Pairs are adjacent in a level, so each is hashed straight
+		 * from it as a 128-byte message
+		 */
+		void hashPairs(const char* children, size_t count, char* parents, size_t threads)
+		{
+			std::vector<const char*> messages(count);
+			std::vector<size_t> lengths(count, 2 * SHA512_DIGEST_SIZE_BYTES);
+			for(size_t i = 0; i < count; i++)
+			{
+				messages[i] = children + 2 * i * SHA512_DIGEST_SIZE_BYTES;
+			}
+
+			hashParallel(Prefixes.Node, messages.data(), lengths.data(), parents, count, threads, MERKLE_NODES_PER_THREAD);
+		}
+
+		MerkleTree::MerkleTree(size_t leafSize, size_t threads) : leafSize(leafSize), threads(threads)
+		{
+			if (leafSize == 0) throw std::invalid_argument("The leaf size must be at least one byte");
+
+			if (this->threads == 0) this->threads = std::thread::hardware_concurrency();
+			if (this->threads == 0) this->threads = 1;
+
+			Init();
+		}
+
+		void MerkleTree::Init()
+		{
+			length = 0;
+			finished = false;
+			levels.assign(1, std::vector<char>());
+			tail.clear();
+		}
+
+		void MerkleTree::addLeaves(const char* data, size_t count)
+		{
+			auto& leaves = levels[0];
+			auto offset = leaves.size();
+			leaves.resize(offset + count * SHA512_DIGEST_SIZE_BYTES);
+
+			hashLeaves(data, count * leafSize, leafSize, leaves.data() + offset, threads);
+		}
+
+		void MerkleTree::Update(const char* data, size_t len)
+		{
+			if (finished) throw std::logic_error("The tree is finished. Call Init to start a new one");
+
+			length += len;
+
+			// Top up the carried over leaf first
+			if(!tail.empty())
+			{
+				auto take = leafSize - tail.size() < len ? leafSize - tail.size() : len;
+				tail.insert(tail.end(), data, data + take);
+				data += take;
+				len -= take;
+
+				if(tail.size() < leafSize) return;
+
+				addLeaves(tail.data(), 1);
+				tail.clear();
+			}
+
+			auto whole = len / leafSize;
+			if (whole > 0) addLeaves(data, whole);
+
+			tail.insert(tail.end(), data + whole * leafSize, data + len);
+		}
+
+		void MerkleTree::Final(char* root)
+		{
+			if (finished) throw std::logic_error("The tree is finished. Call Init to start a new one");
+
+			// The short last leaf, or the single empty leaf of an empty input
+			auto& leaves = levels[0];
+			if(!tail.empty() || leaves.empty())
+			{
+				leaves.resize(leaves.size() + SHA512_DIGEST_SIZE_BYTES);
+				hashLeaves(tail.data(), tail.size(), leafSize, leaves.data() + leaves.size() - SHA512_DIGEST_SIZE_BYTES, 1);
+				tail.clear();
+			}
+
+			while(levels.back().size() > SHA512_DIGEST_SIZE_BYTES)
+			{
+				auto count = levels.back().size() / SHA512_DIGEST_SIZE_BYTES;
+				std::vector<char> parent((count + 1) / 2 * SHA512_DIGEST_SIZE_BYTES);
+				hashPairs(levels.back().data(), count / 2, parent.data(), threads);
+
+				// The odd node out is promoted to the next level as is
+				if(count % 2 == 1)
+				{
+					memcpy(parent.data() + parent.size() - SHA512_DIGEST_SIZE_BYTES, levels.back().data() + levels.back().size() - SHA512_DIGEST_SIZE_BYTES, SHA512_DIGEST_SIZE_BYTES);
+				}
+
+				levels.push_back(std::move(parent));
+			}
+
+			memcpy(root, levels.back().data(), SHA512_DIGEST_SIZE_BYTES);
+			finished = true;
+		}
+
+		size_t MerkleTree::Proof(size_t first, size_t last, char* proof) const
+		{
+			if (!finished) throw std::logic_error("Proofs can only be built for a finished tree");
+			if (first > last || last >= LeafCount()) throw std::out_of_range("The leaf range is not in the tree");
+
+			// At each level the range needs its left neighbour if it starts on a right child, and its right neighbour if it
+			// ends on a left child that has one. Verify consumes them in the same order
+			size_t digests = 0;
+			for(size_t l = 0; l + 1 < levels.size(); l++, first /= 2, last /= 2)
+			{
+				auto count = levels[l].size() / SHA512_DIGEST_SIZE_BYTES;
+
+				if(first % 2 == 1)
+				{
+					memcpy(proof + digests++ * SHA512_DIGEST_SIZE_BYTES, levels[l].data() + (first - 1) * SHA512_DIGEST_SIZE_BYTES, SHA512_DIGEST_SIZE_BYTES);
+				}
+
+				if(last % 2 == 0 && last + 1 < count)
+				{
+					memcpy(proof + digests++ * SHA512_DIGEST_SIZE_BYTES, levels[l].data() + (last + 1) * SHA512_DIGEST_SIZE_BYTES, SHA512_DIGEST_SIZE_BYTES);
+				}
+			}
+
+			return digests;
+		}
+
+		bool MerkleTree::Verify(const char* data, size_t len, uint64_t offset, uint64_t length, size_t leafSize, const char* proof, size_t proofDigests, const char* root)
+		{
+			if (leafSize == 0 || offset % leafSize != 0 || offset > length || len > length - offset) return false;
+
+			// The range has to cover whole leaves, and only the empty input has an empty leaf
+			auto end = offset + len;
+			if (end != length && end % leafSize != 0) return false;
+			if (len == 0 && length != 0) return false;
+
+			uint64_t count = length == 0 ? 1 : (length + leafSize - 1) / leafSize;
+			uint64_t first = offset / leafSize;
+			uint64_t last = len == 0 ? first : (end - 1) / leafSize;
+
+			// Room for the range plus a neighbour on each side
+			std::vector<char> nodes((static_cast<size_t>(last - first) + 3) * SHA512_DIGEST_SIZE_BYTES);
+			auto range = nodes.data() + SHA512_DIGEST_SIZE_BYTES;
+			hashLeaves(data, len, leafSize, range, 1);
+
+			size_t used = 0;
+			for(; count > 1; count = (count + 1) / 2, first /= 2, last /= 2)
+			{
+				// Pull in the neighbours from the proof so the range starts on a left child and ends on a complete pair
+				if(first % 2 == 1)
+				{
+					if (used == proofDigests) return false;
+
+					range -= SHA512_DIGEST_SIZE_BYTES;
+					memcpy(range, proof + used++ * SHA512_DIGEST_SIZE_BYTES, SHA512_DIGEST_SIZE_BYTES);
+					first--;
+				}
+
+				if(last % 2 == 0 && last + 1 < count)
+				{
+					if (used == proofDigests) return false;
+
+					memcpy(range + (last - first + 1) * SHA512_DIGEST_SIZE_BYTES, proof + used++ * SHA512_DIGEST_SIZE_BYTES, SHA512_DIGEST_SIZE_BYTES);
+					last++;
+				}
+
+				// Parents overwrite the front of the range in place, with room for a left neighbour at the next level
+				auto pairs = static_cast<size_t>(last - first + 1) / 2;
+				std::vector<char> parents((pairs + 1) * SHA512_DIGEST_SIZE_BYTES);
+				hashPairs(range, pairs, parents.data(), 1);
+
+				// The odd node out at the end of the level is promoted
+				if((last - first) % 2 == 0)
+				{
+					memcpy(parents.data() + pairs * SHA512_DIGEST_SIZE_BYTES, range + (last - first) * SHA512_DIGEST_SIZE_BYTES, SHA512_DIGEST_SIZE_BYTES);
+				}
+
+				range = nodes.data() + SHA512_DIGEST_SIZE_BYTES;
+				memcpy(range, parents.data(), parents.size());
+			}
+
+			return used == proofDigests && memcmp(range, root, SHA512_DIGEST_SIZE_BYTES) == 0;
+		}
+	}
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * MerkleTree.h - Parallel tree hashing over SHA512 with inclusion proofs for byte ranges
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "SHA512.h"
+#include "../export.h"
+
+/** The default number of bytes of the input covered by each leaf of the tree (1 MiB) */
+#define MERKLE_DEFAULT_LEAF_SIZE_BYTES (1024 * 1024)
+/** The most digests in a proof: at most one sibling on each side of the range at each of the 64 levels */
+#define MERKLE_MAX_PROOF_DIGESTS 128
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		/**
+		 * A binary hash tree over fixed-size leaves of the input.
+		 *
+		 * Each leaf is hashed with SHA512 after a block of domain separation (0x00 for leaves, 0x01 for interior nodes),
+		 * so leaves are independent and are hashed in parallel: across threads and, within a thread, across the SIMD
+		 * lanes. Pairs of nodes are combined level by level; an odd node at the end of a level is promoted unchanged. The
+		 * last leaf may be short, and an empty input is a single empty leaf.
+		 *
+		 * The root commits to the content for a given leaf size and input length. Any run of leaves can be checked against
+		 * the root with the proof from Proof, without the rest of the input (see Verify)
+		 */
+		class LIBCRYPTO_PUB MerkleTree
+		{
+		public:
+			/**
+			 * Start a new tree with the specified leaf size, hashing leaves on up to threads threads (0 for one per core).
+			 * Throws std::invalid_argument if leafSize is 0
+			 */
+			explicit MerkleTree(size_t leafSize = MERKLE_DEFAULT_LEAF_SIZE_BYTES, size_t threads = 0);
+
+			/** The number of input bytes covered by each leaf */
+			size_t LeafSize() const { return leafSize; }
+			/** The number of input bytes seen so far */
+			uint64_t Length() const { return length; }
+			/** The number of leaves in the finished tree */
+			size_t LeafCount() const { return levels[0].size() / SHA512_DIGEST_SIZE_BYTES; }
+
+			/** Discard the tree and start over */
+			void Init();
+			/**
+			 * Add the next len bytes of input. Whole leaves are hashed in place, so passing multiples of LeafSize() avoids
+			 * copying. Throws std::logic_error after Final
+			 */
+			void Update(const char* data, size_t len);
+			/** Hash the last leaf, build the rest of the tree and write the 64-byte root */
+			void Final(char* root);
+
+			/**
+			 * Write the proof for leaves first through last (inclusive) of the finished tree to proof (room for
+			 * MERKLE_MAX_PROOF_DIGESTS digests) and return the number of digests written. Throws std::logic_error before
+			 * Final and std::out_of_range for a bad leaf range
+			 */
+			size_t Proof(size_t first, size_t last, char* proof) const;
+
+			/**
+			 * Check that the len bytes at offset of an input of the specified total length hash to root, using the proof for
+			 * the leaves they cover. The range must start on a leaf boundary and end on one or at the end of the input
+			 */
+			static bool Verify(const char* data, size_t len, uint64_t offset, uint64_t length, size_t leafSize, const char* proof, size_t proofDigests, const char* root);
+
+		private:
+			/** Hash count whole leaves of data onto the bottom level */
+			void addLeaves(const char* data, size_t count);
+
+			/** The number of input bytes covered by each leaf */
+			size_t leafSize;
+			/** The number of threads to hash leaves and nodes on */
+			size_t threads;
+			/** The number of input bytes seen so far */
+			uint64_t length;
+			/** Whether Final has been called */
+			bool finished;
+			/** The digests of each level of the tree, starting from the leaves */
+			std::vector<std::vector<char>> levels;
+			/** The incomplete leaf carried over between calls to Update */
+			std::vector<char> tail;
+		};
+	}
+}
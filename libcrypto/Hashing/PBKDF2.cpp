@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * PBKDF2.cpp - PBKDF2 (RFC 8018) with HMAC-SHA512 as the pseudorandom function
+ */
+#include <cstring>
+#include "PBKDF2.h"
+#include "HMAC.h"
+#include "SHA512Simd.h"
+#include "../libcrypto.h"
+
+/** The padding word that follows a 64-byte message in its final block */
+#define PBKDF2_PAD_WORD 0x8000000000000000ull
+/** The bit length of the key block plus a 64-byte message, which ends the final block of every iteration */
+#define PBKDF2_MESSAGE_BITS ((SHA512_BLOCK_SIZE_BYTES + PBKDF2_SHA512_BLOCK_SIZE_BYTES) * 8ull)
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		namespace PBKDF2
+		{
+			/** Compute U1 = HMAC(password, salt || INT(index)) for the output block as native words */
+			void firstIteration(const HmacSha512& prf, const char* salt, size_t saltLen, uint32_t index, uint64_t* U)
+			{
+				char counter[4] = {
+					static_cast<char>(index >> 24 & 0xFF), static_cast<char>(index >> 16 & 0xFF),
+					static_cast<char>(index >> 8 & 0xFF), static_cast<char>(index & 0xFF)
+				};
+
+				auto mac = prf;
+				char digest[HMAC_SHA512_MAC_SIZE_BYTES];
+				mac.Init();
+				mac.Update(salt, saltLen);
+				mac.Update(counter, sizeof(counter));
+				mac.Final(digest);
+
+				auto words = reinterpret_cast<const unsigned long long*>(digest);
+				for(auto i = 0; i < 8; i++)
+				{
+					U[i] = _byteswap_uint64(words[i]);
+				}
+			}
+
+			/** Write the big-endian bytes of the output block into the key, truncated to len bytes */
+			void storeBlock(const uint64_t* T, char* key, size_t len)
+			{
+				char block[PBKDF2_SHA512_BLOCK_SIZE_BYTES];
+				for(auto i = 0; i < 8; i++)
+				{
+					buffStuff64(block, i * 8, T[i]);
+				}
+
+				memcpy(key, block, len);
+			}
+
+			/** Run the remaining iterations of a single output block one compression at a time */
+			void iterateBlock(const uint64_t* inner, const uint64_t* outer, uint32_t iterations, uint64_t* U, uint64_t* T)
+			{
+				// Both messages are the previous 64-byte digest, so only the first 8 words of the block ever change
+				uint64_t words[16] = { 0 };
+				words[8] = PBKDF2_PAD_WORD;
+				words[15] = PBKDF2_MESSAGE_BITS;
+
+				uint64_t hash[8];
+				for(uint32_t n = 1; n < iterations; n++)
+				{
+					memcpy(words, U, sizeof(hash));
+					memcpy(hash, inner, sizeof(hash));
+					SHA512::CompressWords(hash, words);
+
+					memcpy(words, hash, sizeof(hash));
+					memcpy(U, outer, sizeof(hash));
+					SHA512::CompressWords(U, words);
+
+					for(auto i = 0; i < 8; i++)
+					{
+						T[i] ^= U[i];
+					}
+				}
+			}
+
+			/** Run the remaining iterations of up to simd::Lanes() output blocks side by side, one block per lane */
+			void iterateLanes(const uint64_t* inner, const uint64_t* outer, uint32_t iterations, size_t lanes, uint64_t U[8][SHA512_MAX_LANES], uint64_t T[8][SHA512_MAX_LANES])
+			{
+				alignas(32) uint64_t words[16][SHA512_MAX_LANES] = { { 0 } };
+				alignas(32) uint64_t state[8][SHA512_MAX_LANES];
+				for(size_t l = 0; l < SHA512_MAX_LANES; l++)
+				{
+					words[8][l] = PBKDF2_PAD_WORD;
+					words[15][l] = PBKDF2_MESSAGE_BITS;
+				}
+
+				for(uint32_t n = 1; n < iterations; n++)
+				{
+					for(auto i = 0; i < 8; i++)
+					{
+						for(size_t l = 0; l < lanes; l++)
+						{
+							words[i][l] = U[i][l];
+							state[i][l] = inner[i];
+						}
+					}
+					simd::CompressLaneWords(state, words);
+
+					for(auto i = 0; i < 8; i++)
+					{
+						for(size_t l = 0; l < lanes; l++)
+						{
+							words[i][l] = state[i][l];
+							state[i][l] = outer[i];
+						}
+					}
+					simd::CompressLaneWords(state, words);
+
+					for(auto i = 0; i < 8; i++)
+					{
+						for(size_t l = 0; l < lanes; l++)
+						{
+							U[i][l] = state[i][l];
+							T[i][l] ^= state[i][l];
+						}
+					}
+				}
+			}
+
+			LIBCRYPTO_PUB int DeriveKey(const char* password, size_t passwordLen, const char* salt, size_t saltLen, uint32_t iterations, char* key, size_t keyLen)
+			{
+				if(iterations == 0 || keyLen == 0)
+				{
+					return ERR_BAD_INPUT;
+				}
+
+				HmacSha512 prf(password, passwordLen);
+				uint64_t inner[8], outer[8];
+				prf.Midstates(inner, outer);
+
+				auto blocks = (keyLen + PBKDF2_SHA512_BLOCK_SIZE_BYTES - 1) / PBKDF2_SHA512_BLOCK_SIZE_BYTES;
+				auto lanes = simd::Lanes();
+
+				// Output blocks are independent, so fill the lanes with consecutive blocks while there are at least two left
+				size_t block = 0;
+				while(lanes > 1 && blocks - block > 1)
+				{
+					auto count = blocks - block < lanes ? blocks - block : lanes;
+
+					uint64_t U[8][SHA512_MAX_LANES] = { { 0 } }, T[8][SHA512_MAX_LANES];
+					for(size_t l = 0; l < count; l++)
+					{
+						uint64_t first[8];
+						firstIteration(prf, salt, saltLen, static_cast<uint32_t>(block + l + 1), first);
+						for(auto i = 0; i < 8; i++)
+						{
+							U[i][l] = first[i];
+						}
+					}
+					memcpy(T, U, sizeof(T));
+
+					iterateLanes(inner, outer, iterations, lanes, U, T);
+
+					for(size_t l = 0; l < count; l++, block++)
+					{
+						uint64_t out[8];
+						for(auto i = 0; i < 8; i++)
+						{
+							out[i] = T[i][l];
+						}
+
+						auto offset = block * PBKDF2_SHA512_BLOCK_SIZE_BYTES;
+						storeBlock(out, key + offset, keyLen - offset < PBKDF2_SHA512_BLOCK_SIZE_BYTES ? keyLen - offset : PBKDF2_SHA512_BLOCK_SIZE_BYTES);
+					}
+				}
+
+				for(; block < blocks; block++)
+				{
+					uint64_t U[8], T[8];
+					firstIteration(prf, salt, saltLen, static_cast<uint32_t>(block + 1), U);
+					memcpy(T, U, sizeof(T));
+
+					iterateBlock(inner, outer, iterations, U, T);
+
+					auto offset = block * PBKDF2_SHA512_BLOCK_SIZE_BYTES;
+					storeBlock(T, key + offset, keyLen - offset < PBKDF2_SHA512_BLOCK_SIZE_BYTES ? keyLen - offset : PBKDF2_SHA512_BLOCK_SIZE_BYTES);
+				}
+
+				memset(inner, 0, sizeof(inner));
+				memset(outer, 0, sizeof(outer));
+				return SUCCESS;
+			}
+		}
+	}
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * PBKDF2.h - PBKDF2 (RFC 8018) with HMAC-SHA512 as the pseudorandom function
+ */
+#pragma once
+#include <cstdint>
+#include "../export.h"
+
+/** The number of bytes of derived key produced per PBKDF2-HMAC-SHA512 output block */
+#define PBKDF2_SHA512_BLOCK_SIZE_BYTES 64
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		namespace PBKDF2
+		{
+			/**
+			 * Derive keyLen bytes of key material from the password and salt with the specified number of iterations of
+			 * HMAC-SHA512.
+			 *
+			 * Every iteration after the first hashes a fixed 64-byte message, so those run straight on the compression
+			 * function from the HMAC midstates. When the key is longer than one output block, the blocks are computed side
+			 * by side in the SIMD lanes (see simd::Lanes). Returns ERR_BAD_INPUT if iterations or keyLen is 0
+			 */
+			LIBCRYPTO_PUB int DeriveKey(const char* password, size_t passwordLen, const char* salt, size_t saltLen, uint32_t iterations, char* key, size_t keyLen);
+		}
+	}
+}
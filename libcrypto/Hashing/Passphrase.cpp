@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Passphrase.cpp - The header stored ahead of files encrypted with a key derived from a passphrase
+ */
+#include "Passphrase.h"
+#include "PBKDF2.h"
+#include "../libcrypto.h"
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		namespace Passphrase
+		{
+			void MakeHeader(uint32_t iterations, size_t keyBits, char* header)
+			{
+				buffStuff64(header, 0, Random64());
+				buffStuff64(header, 8, Random64());
+
+				header[16] = iterations >> 24 & 0xFF;
+				header[17] = iterations >> 16 & 0xFF;
+				header[18] = iterations >> 8 & 0xFF;
+				header[19] = iterations & 0xFF;
+				header[20] = keyBits >> 8 & 0xFF;
+				header[21] = keyBits & 0xFF;
+			}
+
+			int ParseHeader(const char* header, uint32_t& iterations, size_t& keyBits)
+			{
+				iterations = static_cast<uint32_t>(header[16] & 0xFF) << 24 | (header[17] & 0xFF) << 16 | (header[18] & 0xFF) << 8 | (header[19] & 0xFF);
+				keyBits = static_cast<size_t>(header[20] & 0xFF) << 8 | (header[21] & 0xFF);
+				return iterations == 0 || iterations > MAX_PASSPHRASE_ITERATIONS || keyBits == 0 || keyBits % 8 != 0 ? ERR_BAD_INPUT : SUCCESS;
+			}
+
+			int DeriveKey(const char* passphrase, size_t passphraseLen, const char* header, char* key, size_t keyLen)
+			{
+				uint32_t iterations;
+				size_t keyBits;
+				auto result = ParseHeader(header, iterations, keyBits);
+				if (result != SUCCESS) return result;
+				if (keyBits != keyLen * 8) return ERR_BAD_INPUT;
+
+				return PBKDF2::DeriveKey(passphrase, passphraseLen, header, PASSPHRASE_SALT_BYTES, iterations, key, keyLen);
+			}
+		}
+	}
+}
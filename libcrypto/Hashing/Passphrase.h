@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Passphrase.h - The header stored ahead of files encrypted with a key derived from a passphrase
+ */
+#pragma once
+#include <cstdint>
+#include "../export.h"
+
+/** The number of random salt bytes at the start of a passphrase header */
+#define PASSPHRASE_SALT_BYTES 16
+/**
+ * The size of the passphrase header: the salt, the big-endian 32-bit iteration count, then the big-endian 16-bit size of
+ * the derived key in bits
+ */
+#define PASSPHRASE_HEADER_BYTES (PASSPHRASE_SALT_BYTES + 6)
+/** The number of PBKDF2 iterations used to derive a key from a passphrase unless another count is asked for */
+#define DEFAULT_PASSPHRASE_ITERATIONS 200000
+/** The most iterations a header may ask for, so a corrupt or hostile file can't tie up the CPU for hours */
+#define MAX_PASSPHRASE_ITERATIONS (100 * DEFAULT_PASSPHRASE_ITERATIONS)
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		namespace Passphrase
+		{
+			/** Fill a new passphrase header with a random salt, the iteration count and the size of the key to derive */
+			LIBCRYPTO_PUB void MakeHeader(uint32_t iterations, size_t keyBits, char* header);
+
+			/**
+			 * Read the iteration count and key size out of the header. Returns ERR_BAD_INPUT if the header is corrupt, which
+			 * includes asking for no iterations or more than MAX_PASSPHRASE_ITERATIONS, or a key that isn't whole bytes
+			 */
+			LIBCRYPTO_PUB int ParseHeader(const char* header, uint32_t& iterations, size_t& keyBits);
+
+			/**
+			 * Derive keyLen bytes of key from the passphrase with PBKDF2-HMAC-SHA512, using the salt and iteration count in
+			 * the header. Returns ERR_BAD_INPUT if the header is corrupt, or is for a key of another size
+			 */
+			LIBCRYPTO_PUB int DeriveKey(const char* passphrase, size_t passphraseLen, const char* header, char* key, size_t keyLen);
+		}
+	}
+}
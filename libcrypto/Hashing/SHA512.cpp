@@ -23,13 +23,12 @@
  */
 
 #include <stdexcept>
+#include <cstring>
 #include "SHA512.h"
+#include "SHA512Simd.h"
 #include "constants.h"
 #include "../libcrypto.h"
 
-/** The number of internal rounds performed on each block of data */
-#define SHA512_ROUNDS_PER_BLOCK 80
-
 namespace libcrypto
 {
 	namespace hashing
@@ -47,8 +46,6 @@ namespace libcrypto
 				uint64_t f = 0x9b05688c2b3e6c1f;
 				uint64_t g = 0x1f83d9abfb41bd6b;
 				uint64_t h = 0x5be0cd19137e2179;
-
-				uint64_t W[SHA512_ROUNDS_PER_BLOCK] = { 0 };
 			}State;
 
 			/** A 1024-bit block that SHA512 Operates on */
@@ -94,21 +91,67 @@ namespace libcrypto
 				return _rotr64(x, 19) ^ _rotr64(x, 61) ^ (x >> 6);
 			}
 
-			/** Generate the word schedule for the round from the specified message block */
-			inline void GenSchedule(State* state, MessageBlock M)
+			/**
+			 * Supplies K[t] + W[t] by expanding the message schedule on the fly. Only the last 16 words are ever live, so they
+			 * are kept in a circular buffer where W[t] overwrites W[t - 16]
+			 */
+			typedef struct RollingSchedule
 			{
-				for(auto t = 0; t < 16; t++)
+				uint64_t W[16];
+
+				explicit RollingSchedule(const uint64_t* words)
+				{
+					memcpy(W, words, sizeof(W));
+				}
+
+				template<size_t t> uint64_t next()
 				{
-					state->W[t] = M[t];
+					if (t >= 16)
+					{
+						W[t & 15] += sigma1(W[(t - 2) & 15]) + W[(t - 7) & 15] + sigma0(W[(t - 15) & 15]);
+					}
+
+					return K[t] + W[t & 15];
 				}
-				for(auto t = 16; t < SHA512_ROUNDS_PER_BLOCK; t++)
+			} RollingSchedule;
+
+			/** Supplies K[t] + W[t] from a schedule that was expanded ahead of time (see simd::ExpandSchedule) */
+			typedef struct PrecomputedSchedule
+			{
+				const uint64_t* KW;
+
+				template<size_t t> uint64_t next()
 				{
-					state->W[t] = sigma1(state->W[t - 2]) + state->W[t - 7] + sigma0(state->W[t - 15]) + state->W[t - 16];
+					return KW[t];
 				}
+			} PrecomputedSchedule;
+
+			/**
+			 * A single SHA512 round. Instead of shifting every working variable down one place, the caller renames them:
+			 * only d and h change, and the next round is called with (h, a, b, c, d, e, f, g) in place of (a, ..., h)
+			 */
+			inline void step(uint64_t a, uint64_t b, uint64_t c, uint64_t& d, uint64_t e, uint64_t f, uint64_t g, uint64_t& h, uint64_t kw)
+			{
+				auto t1 = h + SIGMA1(e) + ch(e, f, g) + kw;
+				d += t1;
+				h = t1 + SIGMA0(a) + maj(a, b, c);
 			}
 
-			/** Perform an iteration of SHA512 on the specified message block */
-			inline void round(State* state, MessageBlock M)
+			/** Rounds [t, t + 8), after which the working variables are back in their original positions */
+			template<size_t t, typename Schedule> inline void octet(Schedule& W, uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d, uint64_t& e, uint64_t& f, uint64_t& g, uint64_t& h)
+			{
+				step(a, b, c, d, e, f, g, h, W.template next<t    >());
+				step(h, a, b, c, d, e, f, g, W.template next<t + 1>());
+				step(g, h, a, b, c, d, e, f, W.template next<t + 2>());
+				step(f, g, h, a, b, c, d, e, W.template next<t + 3>());
+				step(e, f, g, h, a, b, c, d, W.template next<t + 4>());
+				step(d, e, f, g, h, a, b, c, W.template next<t + 5>());
+				step(c, d, e, f, g, h, a, b, W.template next<t + 6>());
+				step(b, c, d, e, f, g, h, a, W.template next<t + 7>());
+			}
+
+			/** Run the 80 rounds of the compression function on the state, drawing K[t] + W[t] from the schedule */
+			template<typename Schedule> inline void compress(State* state, Schedule& W)
 			{
 				auto a = state->a;
 				auto b = state->b;
@@ -119,21 +162,16 @@ namespace libcrypto
 				auto g = state->g;
 				auto h = state->h;
 
-				GenSchedule(state, M);
-
-				for(auto t = 0; t < SHA512_ROUNDS_PER_BLOCK; t++)
-				{
-					auto t1 = h + SIGMA1(e) + ch(e, f, g) + K[t] + state->W[t];
-					auto t2 = SIGMA0(a) + maj(a, b, c);
-					h = g;
-					g = f;
-					f = e;
-					e = d + t1;
-					d = c;
-					c = b;
-					b = a;
-					a = t1 + t2;
-				}
+				octet< 0>(W, a, b, c, d, e, f, g, h);
+				octet< 8>(W, a, b, c, d, e, f, g, h);
+				octet<16>(W, a, b, c, d, e, f, g, h);
+				octet<24>(W, a, b, c, d, e, f, g, h);
+				octet<32>(W, a, b, c, d, e, f, g, h);
+				octet<40>(W, a, b, c, d, e, f, g, h);
+				octet<48>(W, a, b, c, d, e, f, g, h);
+				octet<56>(W, a, b, c, d, e, f, g, h);
+				octet<64>(W, a, b, c, d, e, f, g, h);
+				octet<72>(W, a, b, c, d, e, f, g, h);
 
 				state->a += a;
 				state->b += b;
@@ -145,6 +183,62 @@ namespace libcrypto
 				state->h += h;
 			}
 
+			/** Perform an iteration of SHA512 on the specified message block */
+			inline void round(State* state, const MessageBlock& M)
+			{
+				RollingSchedule W(M.M);
+				compress(state, W);
+			}
+
+			/** Load a full 128-byte block from the buffer as 16 big-endian words. No padding or bounds checks are done */
+			inline void LoadBlock(const char* buff, MessageBlock& M)
+			{
+				auto words = reinterpret_cast<const unsigned long long*>(buff);
+
+				// Windows is LE. Since that's the only platform we support, always swap the byte order
+				M[ 0] = _byteswap_uint64(words[ 0]);
+				M[ 1] = _byteswap_uint64(words[ 1]);
+				M[ 2] = _byteswap_uint64(words[ 2]);
+				M[ 3] = _byteswap_uint64(words[ 3]);
+				M[ 4] = _byteswap_uint64(words[ 4]);
+				M[ 5] = _byteswap_uint64(words[ 5]);
+				M[ 6] = _byteswap_uint64(words[ 6]);
+				M[ 7] = _byteswap_uint64(words[ 7]);
+				M[ 8] = _byteswap_uint64(words[ 8]);
+				M[ 9] = _byteswap_uint64(words[ 9]);
+				M[10] = _byteswap_uint64(words[10]);
+				M[11] = _byteswap_uint64(words[11]);
+				M[12] = _byteswap_uint64(words[12]);
+				M[13] = _byteswap_uint64(words[13]);
+				M[14] = _byteswap_uint64(words[14]);
+				M[15] = _byteswap_uint64(words[15]);
+			}
+
+			/** Compress the full blocks at the start of the buffer, loading each one directly from the input */
+			inline void compressFullBlocks(State* state, const char* buff, size_t blocks)
+			{
+				if(simd::Enabled())
+				{
+					// Expand the whole schedule with AVX2 first so the rounds only have to read K[t] + W[t]
+					alignas(32) uint64_t KW[SHA512_ROUNDS_PER_BLOCK];
+					PrecomputedSchedule W = { KW };
+					for(size_t i = 0; i < blocks; i++)
+					{
+						simd::ExpandSchedule(buff + i * SHA512_BLOCK_SIZE_BYTES, KW);
+						compress(state, W);
+					}
+
+					return;
+				}
+
+				MessageBlock M;
+				for(size_t i = 0; i < blocks; i++)
+				{
+					LoadBlock(buff + i * SHA512_BLOCK_SIZE_BYTES, M);
+					round(state, M);
+				}
+			}
+
 			/** Extract and pad up to 1024 bits from the buffer. If less than 112 bytes were extracted, the length field is appended after padding */
 			MessageBlock ExtractAndPadBlock(const char* buff, size_t off, size_t len, size_t* realLen = nullptr)
 			{
@@ -171,58 +265,202 @@ namespace libcrypto
 				return result;
 			}
 
-			LIBCRYPTO_PUB char* ComputeHash(const char* buff, size_t len)
+			/** Run the full blocks through the compression function, updating the intermediate hash value in place */
+			void compressBlocks(uint64_t* hash, const char* buff, size_t blocks)
+			{
+				State state;
+				state.a = hash[0];
+				state.b = hash[1];
+				state.c = hash[2];
+				state.d = hash[3];
+				state.e = hash[4];
+				state.f = hash[5];
+				state.g = hash[6];
+				state.h = hash[7];
+
+				compressFullBlocks(&state, buff, blocks);
+
+				hash[0] = state.a;
+				hash[1] = state.b;
+				hash[2] = state.c;
+				hash[3] = state.d;
+				hash[4] = state.e;
+				hash[5] = state.f;
+				hash[6] = state.g;
+				hash[7] = state.h;
+			}
+
+			void CompressWords(uint64_t* hash, const uint64_t* words)
+			{
+				State state;
+				state.a = hash[0];
+				state.b = hash[1];
+				state.c = hash[2];
+				state.d = hash[3];
+				state.e = hash[4];
+				state.f = hash[5];
+				state.g = hash[6];
+				state.h = hash[7];
+
+				RollingSchedule W(words);
+				compress(&state, W);
+
+				hash[0] = state.a;
+				hash[1] = state.b;
+				hash[2] = state.c;
+				hash[3] = state.d;
+				hash[4] = state.e;
+				hash[5] = state.f;
+				hash[6] = state.g;
+				hash[7] = state.h;
+			}
+
+			/**
+			 * Copy the trailing partial block of a message (less than 128 bytes) to out, then pad it and append the 128-bit
+			 * message length. Returns the number of blocks written to out (1, or 2 if the length field did not fit)
+			 */
+			size_t padFinalBlocks(const char* tail, size_t tailLength, uint64_t messageLength, char* out)
 			{
-				auto state = new State();
-				auto blocks = len / SHA512_BLOCK_SIZE_BYTES + (len % SHA512_BLOCK_SIZE_BYTES != 0 ? 1 : 0);
+				memcpy(out, tail, tailLength);
+
+				// A '1' bit after the message followed by zeroes
+				out[tailLength++] = static_cast<char>(0x80);
+
+				// The length field needs the last 16 bytes of a block, which may mean an extra block
+				auto blocks = tailLength > SHA512_BLOCK_SIZE_BYTES - 16 ? 2 : 1;
+				auto end = blocks * SHA512_BLOCK_SIZE_BYTES;
+				memset(out + tailLength, 0, end - 16 - tailLength);
+				libcrypto::buffStuff64(out, end - 16, messageLength >> 61);
+				libcrypto::buffStuff64(out, end - 8, messageLength << 3);
 
-				if(len == 0 || (len == 1 && buff[0] == 0))
+				return blocks;
+			}
+
+			/** Write the first size bytes of the big-endian hash value (truncated digests can end part way through a word) */
+			inline void storeDigest(const uint64_t* hash, char* digest, size_t size)
+			{
+				for(size_t i = 0; i < size; i++)
 				{
-					// Special case for empty string
-					MessageBlock M;
-					M[0] = 1ull << 63;
-					round(state, M);
+					digest[i] = static_cast<char>(hash[i / 8] >> (56 - 8 * (i % 8)));
 				}
-				else
+			}
+
+			/** Fill iv with the initial hash value of the SHA512 family member with the specified digest size */
+			void initialHashValue(size_t digestBits, uint64_t* iv)
+			{
+				if (digestBits == 0 || digestBits > 512 || digestBits % 8 != 0) throw std::invalid_argument("Unsupported SHA512 digest size");
+
+				switch(digestBits)
 				{
-					for(auto i = 0; i < blocks; i++)
-					{
-						auto M = ExtractAndPadBlock(buff, i * SHA512_BLOCK_SIZE_BYTES, len);
-						round(state, M);
-					}
+				case 384:
+					memcpy(iv, SHA384_IV, sizeof(SHA384_IV));
+					return;
+				case 256:
+					memcpy(iv, SHA512_256_IV, sizeof(SHA512_256_IV));
+					return;
+				case 224:
+					memcpy(iv, SHA512_224_IV, sizeof(SHA512_224_IV));
+					return;
+				}
 
-					// Final padding comes after
-					if(len % SHA512_BLOCK_SIZE_BYTES == 0)
-					{
-						// If we're exactly a multiple of 128 bytes, the first byte of the padding block needs to be set
-						MessageBlock M;
-						M[0] = 1ull << 63;
-						M[15] = len << 3;
-						round(state, M);
-					}
-					else if(len - (blocks - 1) * SHA512_BLOCK_SIZE_BYTES >= 112)
-					{
-						// Otherwise the padding bit was already set, just append the length
-						MessageBlock M;
-						M[15] = len << 3;
-						round(state, M);
-					}
+				State initial;
+				iv[0] = initial.a;
+				iv[1] = initial.b;
+				iv[2] = initial.c;
+				iv[3] = initial.d;
+				iv[4] = initial.e;
+				iv[5] = initial.f;
+				iv[6] = initial.g;
+				iv[7] = initial.h;
+				if (digestBits == 512) return;
+
+				// SHA512/t (FIPS 180-4 5.3.6): hash the name of the algorithm, starting from the SHA512 initial hash value XOR a5a5...
+				for(auto i = 0; i < 8; i++)
+				{
+					iv[i] ^= 0xa5a5a5a5a5a5a5a5;
+				}
+
+				auto name = "SHA-512/" + std::to_string(digestBits);
+				char block[2 * SHA512_BLOCK_SIZE_BYTES];
+				compressBlocks(iv, block, padFinalBlocks(name.c_str(), name.length(), name.length(), block));
+			}
 
+			/** A message being hashed in one of the lanes of ComputeHashes */
+			typedef struct
+			{
+				/** The index of the message */
+				size_t Message;
+				/** The next block to compress, first from the message itself and then from Tail */
+				const char* Next;
+				/** The number of full blocks left in the message */
+				size_t FullBlocks;
+				/** The number of padded blocks left in Tail */
+				size_t TailBlocks;
+				/** The padded final block(s) of the message */
+				char Tail[2 * SHA512_BLOCK_SIZE_BYTES];
+			} Lane;
+
+			/** Start hashing the message in lane l, resetting its column of the word-major state */
+			void startLane(Lane& lane, uint64_t state[8][SHA512_MAX_LANES], size_t l, const uint64_t* iv, uint64_t prefixLength, size_t message, const char* buff, size_t len)
+			{
+				for(auto i = 0; i < 8; i++)
+				{
+					state[i][l] = iv[i];
 				}
 
-				
-				auto result = new char[64]{ 0 };
+				auto full = len / SHA512_BLOCK_SIZE_BYTES;
+				lane.Message = message;
+				lane.FullBlocks = full;
+				lane.TailBlocks = padFinalBlocks(buff + full * SHA512_BLOCK_SIZE_BYTES, len - full * SHA512_BLOCK_SIZE_BYTES, prefixLength + len, lane.Tail);
+				lane.Next = full > 0 ? buff : lane.Tail;
+			}
 
-				libcrypto::buffStuff64(result,  0, state->a);
-				libcrypto::buffStuff64(result,  8, state->b);
-				libcrypto::buffStuff64(result, 16, state->c);
-				libcrypto::buffStuff64(result, 24, state->d);
-				libcrypto::buffStuff64(result, 32, state->e);
-				libcrypto::buffStuff64(result, 40, state->f);
-				libcrypto::buffStuff64(result, 48, state->g);
-				libcrypto::buffStuff64(result, 56, state->h);
+			/** Move the lane on to its next block. Returns false once the message has been completely hashed */
+			inline bool advanceLane(Lane& lane)
+			{
+				lane.Next += SHA512_BLOCK_SIZE_BYTES;
+
+				if(lane.FullBlocks > 0)
+				{
+					if (--lane.FullBlocks == 0) lane.Next = lane.Tail;
+					return true;
+				}
+
+				return --lane.TailBlocks > 0;
+			}
+
+			/** Copy column l out of the word-major state */
+			inline void loadLane(const uint64_t state[8][SHA512_MAX_LANES], size_t l, uint64_t* hash)
+			{
+				for(auto i = 0; i < 8; i++)
+				{
+					hash[i] = state[i][l];
+				}
+			}
+
+			LIBCRYPTO_PUB void ComputeHash(const char* buff, size_t len, char* digest, size_t digestBits)
+			{
+				uint64_t hash[8];
+				initialHashValue(digestBits, hash);
+
+				// Full blocks are compressed straight from the buffer, and only the trailing partial block is copied to be padded
+				auto full = len / SHA512_BLOCK_SIZE_BYTES;
+				compressBlocks(hash, buff, full);
+
+				char tail[2 * SHA512_BLOCK_SIZE_BYTES];
+				compressBlocks(hash, tail, padFinalBlocks(buff + full * SHA512_BLOCK_SIZE_BYTES, len - full * SHA512_BLOCK_SIZE_BYTES, len, tail));
+
+				storeDigest(hash, digest, digestBits / 8);
+			}
+
+			LIBCRYPTO_PUB char* ComputeHash(const char* buff, size_t len)
+			{
+				// This overload has always read a single zero byte as the empty message (how the response files encode it)
+				if (len == 1 && buff[0] == 0) len = 0;
+
+				auto result = new char[SHA512_DIGEST_SIZE_BYTES];
+				ComputeHash(buff, len, result);
 
-				delete state;
 				return result;
 			}
 
@@ -231,32 +469,142 @@ namespace libcrypto
 				return ComputeHash(str.c_str(), str.length());
 			}
 
+			LIBCRYPTO_PUB char* ComputeHash(const char* buff, size_t len, size_t digestBits)
+			{
+				// Validates digestBits before anything is allocated
+				Sha512 hasher(digestBits);
+				hasher.Update(buff, len);
+
+				auto result = new char[hasher.DigestSize()];
+				hasher.Final(result);
+
+				return result;
+			}
+
+			LIBCRYPTO_PUB void ComputeHashes(const char* const* messages, const size_t* lengths, char* digests, size_t count, size_t digestBits)
+			{
+				uint64_t iv[8];
+				initialHashValue(digestBits, iv);
+
+				ResumeHashes(iv, 0, messages, lengths, digests, count, digestBits / 8);
+			}
+
+			LIBCRYPTO_PUB void ResumeHashes(const uint64_t* midstate, uint64_t prefixLength, const char* const* messages, const size_t* lengths, char* digests, size_t count, size_t digestSize)
+			{
+				if (prefixLength % SHA512_BLOCK_SIZE_BYTES != 0) throw std::invalid_argument("The midstate must be at a block boundary");
+
+				auto lanes = simd::Lanes();
+
+				// Word-major so each word of the lanes' states can be loaded as one vector
+				alignas(32) uint64_t state[8][SHA512_MAX_LANES];
+				Lane lane[SHA512_MAX_LANES];
+				bool busy[SHA512_MAX_LANES] = { false };
+				size_t active = 0, next = 0;
+
+				// Fill every lane we have work for
+				for(size_t l = 0; l < lanes && next < count; l++, next++)
+				{
+					startLane(lane[l], state, l, midstate, prefixLength, next, messages[next], lengths[next]);
+					busy[l] = true;
+					active++;
+				}
+
+				// Compressing one block in all lanes costs about the same as in one, so only stay vectorized
+				// while at least two messages are left
+				const char* blocks[SHA512_MAX_LANES];
+				while(active > 1)
+				{
+					size_t first = 0;
+					while (!busy[first]) first++;
+
+					// Idle lanes just recompress the first busy lane's block and their results are discarded
+					for(size_t l = 0; l < lanes; l++)
+					{
+						blocks[l] = busy[l] ? lane[l].Next : lane[first].Next;
+					}
+
+					simd::CompressLanes(state, blocks);
+
+					for(size_t l = 0; l < lanes; l++)
+					{
+						if (!busy[l] || advanceLane(lane[l])) continue;
+
+						uint64_t hash[8];
+						loadLane(state, l, hash);
+						storeDigest(hash, digests + lane[l].Message * digestSize, digestSize);
+
+						// Refill the lane straight away so it doesn't sit idle while longer messages finish
+						if(next < count)
+						{
+							startLane(lane[l], state, l, midstate, prefixLength, next, messages[next], lengths[next]);
+							next++;
+						}
+						else
+						{
+							busy[l] = false;
+							active--;
+						}
+					}
+				}
+
+				// At most one message is left, so finish it with the scalar compression function. Without multi-buffer support
+				// (a single lane) every message goes through here one at a time
+				for(size_t l = 0; l < lanes; l++)
+				{
+					while(busy[l])
+					{
+						uint64_t hash[8];
+						loadLane(state, l, hash);
+
+						if(lane[l].FullBlocks > 0)
+						{
+							compressBlocks(hash, lane[l].Next, lane[l].FullBlocks);
+							lane[l].Next = lane[l].Tail;
+						}
+						compressBlocks(hash, lane[l].Next, lane[l].TailBlocks);
+
+						storeDigest(hash, digests + lane[l].Message * digestSize, digestSize);
+
+						if(next < count)
+						{
+							startLane(lane[l], state, l, midstate, prefixLength, next, messages[next], lengths[next]);
+							next++;
+						}
+						else
+						{
+							busy[l] = false;
+						}
+					}
+				}
+			}
+
 			LIBCRYPTO_PUB void ComputePartialHash(char* prev, const char* buff, size_t len, bool initialBlock, size_t* totalLength)
 			{
 				if (totalLength == nullptr && len % SHA512_BLOCK_SIZE_BYTES != 0) throw std::length_error("Non-final input block must be a multiple of 128 bytes");
 
 				auto blocks = len / SHA512_BLOCK_SIZE_BYTES + (totalLength != nullptr && len % SHA512_BLOCK_SIZE_BYTES != 0 ? 1 : 0);
 
-				auto state = new State();
+				State state;
 				auto previousState = reinterpret_cast<uint64_t*>(prev);
 
 				if(!initialBlock)
 				{
 					// Load the state from the previous partial hash
-					state->a = _byteswap_uint64(previousState[0]);
-					state->b = _byteswap_uint64(previousState[1]);
-					state->c = _byteswap_uint64(previousState[2]);
-					state->d = _byteswap_uint64(previousState[3]);
-					state->e = _byteswap_uint64(previousState[4]);
-					state->f = _byteswap_uint64(previousState[5]);
-					state->g = _byteswap_uint64(previousState[6]);
-					state->h = _byteswap_uint64(previousState[7]);
+					state.a = _byteswap_uint64(previousState[0]);
+					state.b = _byteswap_uint64(previousState[1]);
+					state.c = _byteswap_uint64(previousState[2]);
+					state.d = _byteswap_uint64(previousState[3]);
+					state.e = _byteswap_uint64(previousState[4]);
+					state.f = _byteswap_uint64(previousState[5]);
+					state.g = _byteswap_uint64(previousState[6]);
+					state.h = _byteswap_uint64(previousState[7]);
 				}
 
-				for(auto i = 0; i < blocks; i++)
+				compressFullBlocks(&state, buff, len / SHA512_BLOCK_SIZE_BYTES);
+				if(blocks * SHA512_BLOCK_SIZE_BYTES != len)
 				{
-					auto M = ExtractAndPadBlock(buff, i * SHA512_BLOCK_SIZE_BYTES, len, totalLength);
-					round(state, M);
+					auto M = ExtractAndPadBlock(buff, (blocks - 1) * SHA512_BLOCK_SIZE_BYTES, len, totalLength);
+					round(&state, M);
 				}
 
 				if(totalLength != nullptr)
@@ -268,28 +616,143 @@ namespace libcrypto
 						MessageBlock M;
 						M[0] = 1ull << 63;
 						M[15] = *totalLength << 3;
-						round(state, M);
+						round(&state, M);
 					}
 					else if(len - (blocks - 1) * SHA512_BLOCK_SIZE_BYTES >= 112)
 					{
 						// Otherwise the padding bit was already set, just append the length
 						MessageBlock M;
 						M[15] = *totalLength << 3;
-						round(state, M);
+						round(&state, M);
 					}
 				}
 
-				previousState[0] = _byteswap_uint64(state->a);
-				previousState[1] = _byteswap_uint64(state->b);
-				previousState[2] = _byteswap_uint64(state->c);
-				previousState[3] = _byteswap_uint64(state->d);
-				previousState[4] = _byteswap_uint64(state->e);
-				previousState[5] = _byteswap_uint64(state->f);
-				previousState[6] = _byteswap_uint64(state->g);
-				previousState[7] = _byteswap_uint64(state->h);
+				previousState[0] = _byteswap_uint64(state.a);
+				previousState[1] = _byteswap_uint64(state.b);
+				previousState[2] = _byteswap_uint64(state.c);
+				previousState[3] = _byteswap_uint64(state.d);
+				previousState[4] = _byteswap_uint64(state.e);
+				previousState[5] = _byteswap_uint64(state.f);
+				previousState[6] = _byteswap_uint64(state.g);
+				previousState[7] = _byteswap_uint64(state.h);
+			}
+		}
 
-				delete state;
+		Sha512::Sha512(size_t digestBits) : digestSize(digestBits / 8)
+		{
+			SHA512::initialHashValue(digestBits, initial);
+			Init();
+		}
+
+		void Sha512::Init()
+		{
+			memcpy(state, initial, sizeof(state));
+			length = 0;
+			buffered = 0;
+		}
+
+		void Sha512::Midstate(uint64_t* midstate, uint64_t& prefixLength) const
+		{
+			if (buffered != 0) throw std::logic_error("The midstate is only available at a block boundary");
+
+			memcpy(midstate, state, sizeof(state));
+			prefixLength = length;
+		}
+
+		void Sha512::Resume(const uint64_t* midstate, uint64_t prefixLength)
+		{
+			if (prefixLength % SHA512_BLOCK_SIZE_BYTES != 0) throw std::invalid_argument("The midstate must be at a block boundary");
+
+			memcpy(state, midstate, sizeof(state));
+			length = prefixLength;
+			buffered = 0;
+		}
+
+		/** The tag at the start of every checkpoint, which also versions the layout */
+		const char CHECKPOINT_TAG[8] = { 'S', 'H', 'A', '5', '1', '2', 'C', '1' };
+
+		/** Read a big-endian 64-bit integer from the buffer starting at the specified offset */
+		inline uint64_t buffUnstuff64(const char* buff, size_t offset)
+		{
+			uint64_t block = 0;
+			for(auto i = 0; i < 8; i++)
+			{
+				block = block << 8 | static_cast<uint8_t>(buff[offset + i]);
+			}
+
+			return block;
+		}
+
+		void Sha512::Save(char* checkpoint) const
+		{
+			memcpy(checkpoint, CHECKPOINT_TAG, sizeof(CHECKPOINT_TAG));
+			libcrypto::buffStuff64(checkpoint, 8, digestSize);
+			libcrypto::buffStuff64(checkpoint, 16, length);
+			for(auto i = 0; i < 8; i++)
+			{
+				libcrypto::buffStuff64(checkpoint, 24 + 8 * i, state[i]);
 			}
+
+			// The unused part of the block is zeroed so equal states always save the same checkpoint
+			auto tail = checkpoint + 24 + SHA512_DIGEST_SIZE_BYTES;
+			memcpy(tail, buffer, buffered);
+			memset(tail + buffered, 0, SHA512_BLOCK_SIZE_BYTES - buffered);
+		}
+
+		void Sha512::Load(const char* checkpoint)
+		{
+			if (memcmp(checkpoint, CHECKPOINT_TAG, sizeof(CHECKPOINT_TAG)) != 0) throw std::invalid_argument("Not a SHA512 checkpoint");
+			if (buffUnstuff64(checkpoint, 8) != digestSize) throw std::invalid_argument("The checkpoint is for a different digest size");
+
+			// Everything but a partial block has been through the compression function, so the length says what is buffered
+			length = buffUnstuff64(checkpoint, 16);
+			for(auto i = 0; i < 8; i++)
+			{
+				state[i] = buffUnstuff64(checkpoint, 24 + 8 * i);
+			}
+
+			buffered = length % SHA512_BLOCK_SIZE_BYTES;
+			memcpy(buffer, checkpoint + 24 + SHA512_DIGEST_SIZE_BYTES, buffered);
+		}
+
+		void Sha512::Update(const char* data, size_t len)
+		{
+			length += len;
+
+			// Top up a partially filled block first
+			if(buffered > 0)
+			{
+				auto take = SHA512_BLOCK_SIZE_BYTES - buffered < len ? SHA512_BLOCK_SIZE_BYTES - buffered : len;
+				memcpy(buffer + buffered, data, take);
+				buffered += take;
+				data += take;
+				len -= take;
+
+				if (buffered < SHA512_BLOCK_SIZE_BYTES) return;
+
+				SHA512::compressBlocks(state, buffer, 1);
+				buffered = 0;
+			}
+
+			// Full blocks are hashed straight from the input
+			auto blocks = len / SHA512_BLOCK_SIZE_BYTES;
+			SHA512::compressBlocks(state, data, blocks);
+			data += blocks * SHA512_BLOCK_SIZE_BYTES;
+			len -= blocks * SHA512_BLOCK_SIZE_BYTES;
+
+			// Hold on to whatever is left until the next call
+			memcpy(buffer, data, len);
+			buffered = len;
+		}
+
+		void Sha512::Final(char* digest)
+		{
+			char padding[2 * SHA512_BLOCK_SIZE_BYTES];
+			auto blocks = SHA512::padFinalBlocks(buffer, buffered, length, padding);
+			SHA512::compressBlocks(state, padding, blocks);
+			buffered = 0;
+
+			SHA512::storeDigest(state, digest, digestSize);
 		}
 	}
 }
@@ -23,6 +23,7 @@
  */
 
 #pragma once
+#include <cstdint>
 #include <string>
 #include "../export.h"
 
@@ -30,6 +31,17 @@
 #define SHA512_BLOCK_SIZE_BYTES 128
 /** The number of bytes in a SHA512 Digest */
 #define SHA512_DIGEST_SIZE_BYTES 64
+/** The number of internal rounds performed on each block of data */
+#define SHA512_ROUNDS_PER_BLOCK 80
+/** The number of bytes in a serialized Sha512 checkpoint: tag, digest size, length, hash value and the buffered block */
+#define SHA512_CHECKPOINT_SIZE_BYTES (8 + 8 + 8 + SHA512_DIGEST_SIZE_BYTES + SHA512_BLOCK_SIZE_BYTES)
+
+/** The number of bytes in a SHA384 Digest */
+#define SHA384_DIGEST_SIZE_BYTES 48
+/** The number of bytes in a SHA512/224 Digest */
+#define SHA512_224_DIGEST_SIZE_BYTES 28
+/** The number of bytes in a SHA512/256 Digest */
+#define SHA512_256_DIGEST_SIZE_BYTES 32
 
 namespace libcrypto
 {
@@ -37,12 +49,118 @@ namespace libcrypto
 	{
 		namespace SHA512
 		{
-			/** Compute the 8-byte SHA512 digest for the buffer of the specified length */
+			/** Compute the 64-byte SHA512 digest for the buffer of the specified length. Returns a new buffer */
 			LIBCRYPTO_PUB char* ComputeHash(const char* buff, size_t len);
-			/** Compute the 8-byte SHA512 digest for the specified string */
+			/** Compute the 64-byte SHA512 digest for the specified string. Returns a new buffer */
 			LIBCRYPTO_PUB char* ComputeHash(std::string str);
 			/** Compute the partial hash using the previous state. The size of the buffer must be a multiple of 128 bytes */
 			LIBCRYPTO_PUB void ComputePartialHash(char* previous, const char* buff, size_t len, bool initialBlock, size_t* totalLength);
+
+			/**
+			 * Compute the digest of the buffer with a member of the SHA512 family, selected by its digest size in bits: 512, 384
+			 * (SHA384) or any other multiple of 8 below 512 (SHA512/t, e.g. 224 and 256). They all share the SHA512 compression
+			 * function and only differ in the initial hash value and how much of the final state is output.
+			 *
+			 * Returns a new buffer of digestBits / 8 bytes. Throws std::invalid_argument for an unsupported digest size
+			 */
+			LIBCRYPTO_PUB char* ComputeHash(const char* buff, size_t len, size_t digestBits);
+
+			/**
+			 * Compute the digest of the buffer into digest, which must hold digestBits / 8 bytes. digestBits selects the member
+			 * of the SHA512 family as above.
+			 *
+			 * All of the hash state lives on the stack, so this never touches the heap. Prefer it over the overloads above
+			 * when hashing many messages one at a time. Throws std::invalid_argument for an unsupported digest size
+			 */
+			LIBCRYPTO_PUB void ComputeHash(const char* buff, size_t len, char* digest, size_t digestBits = 512);
+
+			/**
+			 * Compute the digests of count independent messages, writing the digest of message i to digests + i * digestBits / 8.
+			 * digestBits selects the member of the SHA512 family like ComputeHash.
+			 *
+			 * Messages are hashed side by side in vector lanes (4 with AVX2, 2 with SSE2) and a lane picks up the next message
+			 * as soon as its current one is done, so many small messages hash several times faster than one at a time
+			 */
+			LIBCRYPTO_PUB void ComputeHashes(const char* const* messages, const size_t* lengths, char* digests, size_t count, size_t digestBits = 512);
+
+			/**
+			 * Like ComputeHashes, but every message continues from the same midstate: the intermediate hash value after hashing a
+			 * shared prefix of prefixLength bytes (a multiple of 128, see Sha512::Midstate). Writes the first digestSize bytes of
+			 * each digest. Throws std::invalid_argument if prefixLength is not at a block boundary
+			 */
+			LIBCRYPTO_PUB void ResumeHashes(const uint64_t* midstate, uint64_t prefixLength, const char* const* messages, const size_t* lengths, char* digests, size_t count, size_t digestSize);
+
+			/**
+			 * Run the compression function once on a block that is already loaded as 16 native-endian words, with no padding.
+			 * For algorithms built on SHA512 that control the block layout themselves (e.g. PBKDF2)
+			 */
+			void CompressWords(uint64_t* hash, const uint64_t* words);
 		}
+
+		/**
+		 * Incremental SHA512 for messages that arrive in pieces of any size.
+		 *
+		 * The hash state is kept in native form and partial blocks are buffered internally, so Update can be called with any
+		 * length and never allocates. Padding is only applied once, in Final.
+		 *
+		 * The other members of the SHA512 family are selected by their digest size in bits, as with SHA512::ComputeHash
+		 */
+		class LIBCRYPTO_PUB Sha512
+		{
+		public:
+			/** Start a new message for the SHA512 family member with the specified digest size. Throws std::invalid_argument if unsupported */
+			explicit Sha512(size_t digestBits = 512);
+
+			/** The number of bytes Final writes */
+			size_t DigestSize() const { return digestSize; }
+
+			/** Reset the hasher to start a new message */
+			void Init();
+			/** Add the next len bytes of the message */
+			void Update(const char* data, size_t len);
+			/** Pad the message and write the DigestSize()-byte digest. Call Init before hashing another message */
+			void Final(char* digest);
+
+			/**
+			 * Copy out the intermediate hash value and the number of bytes hashed so far, so hashing can be resumed from this
+			 * point (e.g. after a fixed prefix) without rehashing it. Throws std::logic_error unless a whole number of blocks
+			 * has been hashed
+			 */
+			void Midstate(uint64_t* midstate, uint64_t& prefixLength) const;
+			/**
+			 * Continue from a midstate captured after prefixLength bytes (a multiple of 128, otherwise std::invalid_argument is
+			 * thrown), discarding the current message
+			 */
+			void Resume(const uint64_t* midstate, uint64_t prefixLength);
+
+			/** The number of message bytes hashed so far */
+			uint64_t Length() const { return length; }
+
+			/**
+			 * Serialize everything needed to carry on with the message later (the intermediate hash value, the partial block
+			 * and the length) into SHA512_CHECKPOINT_SIZE_BYTES bytes. Unlike Midstate, this works after any number of bytes.
+			 * The checkpoint is big-endian, so it can be loaded on any machine
+			 */
+			void Save(char* checkpoint) const;
+			/**
+			 * Continue from a checkpoint written by Save, discarding the current message. Throws std::invalid_argument if it
+			 * is not a checkpoint or was saved by a different member of the SHA512 family
+			 */
+			void Load(const char* checkpoint);
+
+		private:
+			/** The initial hash value of the family member */
+			uint64_t initial[8];
+			/** The number of bytes of the final state that make up the digest */
+			size_t digestSize;
+			/** The intermediate hash value (H0..H7) */
+			uint64_t state[8];
+			/** The number of message bytes seen so far */
+			uint64_t length;
+			/** The number of bytes waiting in buffer for a full block */
+			size_t buffered;
+			/** The incomplete block carried over between calls to Update */
+			char buffer[SHA512_BLOCK_SIZE_BYTES];
+		};
 	}
 }
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SHA512Simd.cpp - Vectorized SHA512
+ *
+ * The message schedule only depends on the block, so it can be expanded ahead of the rounds. Four words are computed
+ * per step in a ymm register: W[t - 16], W[t - 15] and W[t - 7] are all known for the whole group, but sigma1 reads
+ * W[t - 2], so the upper two lanes are finished off with the two words computed in the lower lanes.
+ *
+ * Multi-buffer hashing instead puts one independent message in each 64-bit lane (4 in a ymm register, 2 in an xmm
+ * register) and runs the whole compression function lane-wise, so there are no dependencies between lanes at all.
+ */
+#include "SHA512Simd.h"
+#include "constants.h"
+#include "../Cpu.h"
+#include <atomic>
+#include <intrin.h>
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		namespace simd
+		{
+			/** Whether the caller allows dispatching to AVX2 (see SetEnabled) */
+			static std::atomic<bool> allowed(true);
+
+			LIBCRYPTO_PUB bool Supported()
+			{
+				return cpu::HasAVX2();
+			}
+
+			LIBCRYPTO_PUB void SetEnabled(bool enabled)
+			{
+				allowed = enabled;
+			}
+
+			LIBCRYPTO_PUB bool Enabled()
+			{
+				return allowed && Supported();
+			}
+
+			/** Rotate each 64-bit lane right by n bits (AVX2 has no 64-bit rotate) */
+			template<int n> inline __m256i rotr(__m256i x)
+			{
+				return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n));
+			}
+
+			/** Little-Sigma 0 from FIPS 180-4 on each lane */
+			inline __m256i sigma0(__m256i x)
+			{
+				return _mm256_xor_si256(_mm256_xor_si256(rotr<1>(x), rotr<8>(x)), _mm256_srli_epi64(x, 7));
+			}
+
+			/** Little-Sigma 1 from FIPS 180-4 on each lane */
+			inline __m256i sigma1(__m256i x)
+			{
+				return _mm256_xor_si256(_mm256_xor_si256(rotr<19>(x), rotr<61>(x)), _mm256_srli_epi64(x, 6));
+			}
+
+			/** The words { lo[1], lo[2], lo[3], hi[0] }, i.e. the group starting one word after lo */
+			inline __m256i shiftIn(__m256i lo, __m256i hi)
+			{
+				return _mm256_permute4x64_epi64(_mm256_blend_epi32(lo, hi, 0x03), 0x39);
+			}
+
+			/**
+			 * Compute W[t, t + 4) from the previous 16 words, held as W[t - 16, t - 12) in w0 through W[t - 4, t) in w3
+			 */
+			inline __m256i expand(__m256i w0, __m256i w1, __m256i w2, __m256i w3)
+			{
+				// Everything except sigma1 is available for all four lanes
+				auto partial = _mm256_add_epi64(_mm256_add_epi64(w0, sigma0(shiftIn(w0, w1))), shiftIn(w2, w3));
+
+				// W[t] and W[t + 1] depend on W[t - 2] and W[t - 1]
+				auto low = _mm256_add_epi64(partial, sigma1(_mm256_permute4x64_epi64(w3, 0x0E)));
+
+				// W[t + 2] and W[t + 3] depend on the two words just computed
+				auto high = _mm256_add_epi64(partial, sigma1(_mm256_permute4x64_epi64(low, 0x44)));
+
+				return _mm256_blend_epi32(low, high, 0xF0);
+			}
+
+			void ExpandSchedule(const char* block, uint64_t* KW)
+			{
+				// Reverse the bytes of each 64-bit word to load them big-endian
+				const auto swap = _mm256_setr_epi8(
+					7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+					7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+				auto in = reinterpret_cast<const __m256i*>(block);
+				auto w0 = _mm256_shuffle_epi8(_mm256_loadu_si256(in    ), swap);
+				auto w1 = _mm256_shuffle_epi8(_mm256_loadu_si256(in + 1), swap);
+				auto w2 = _mm256_shuffle_epi8(_mm256_loadu_si256(in + 2), swap);
+				auto w3 = _mm256_shuffle_epi8(_mm256_loadu_si256(in + 3), swap);
+
+				auto k = reinterpret_cast<const __m256i*>(K);
+				auto out = reinterpret_cast<__m256i*>(KW);
+				_mm256_store_si256(out    , _mm256_add_epi64(w0, _mm256_loadu_si256(k    )));
+				_mm256_store_si256(out + 1, _mm256_add_epi64(w1, _mm256_loadu_si256(k + 1)));
+				_mm256_store_si256(out + 2, _mm256_add_epi64(w2, _mm256_loadu_si256(k + 2)));
+				_mm256_store_si256(out + 3, _mm256_add_epi64(w3, _mm256_loadu_si256(k + 3)));
+
+				for(auto g = 4; g < SHA512_ROUNDS_PER_BLOCK / 4; g++)
+				{
+					auto next = expand(w0, w1, w2, w3);
+					_mm256_store_si256(out + g, _mm256_add_epi64(next, _mm256_loadu_si256(k + g)));
+
+					w0 = w1;
+					w1 = w2;
+					w2 = w3;
+					w3 = next;
+				}
+			}
+
+			/** Vector operations on 4 lanes of 64 bits for the multi-buffer compression function */
+			typedef struct Avx2Lanes
+			{
+				typedef __m256i Vector;
+				static const size_t Count = 4;
+
+				static Vector load(const uint64_t* p) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); }
+				static void store(uint64_t* p, Vector x) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), x); }
+				static Vector broadcast(uint64_t x) { return _mm256_set1_epi64x(x); }
+				static Vector add(Vector x, Vector y) { return _mm256_add_epi64(x, y); }
+				static Vector bitXor(Vector x, Vector y) { return _mm256_xor_si256(x, y); }
+				static Vector bitAnd(Vector x, Vector y) { return _mm256_and_si256(x, y); }
+				static Vector bitAndNot(Vector x, Vector y) { return _mm256_andnot_si256(x, y); }
+				template<int n> static Vector shr(Vector x) { return _mm256_srli_epi64(x, n); }
+				template<int n> static Vector rotr(Vector x) { return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n)); }
+			} Avx2Lanes;
+
+			/** Vector operations on 2 lanes of 64 bits for the multi-buffer compression function */
+			typedef struct Sse2Lanes
+			{
+				typedef __m128i Vector;
+				static const size_t Count = 2;
+
+				static Vector load(const uint64_t* p) { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+				static void store(uint64_t* p, Vector x) { _mm_store_si128(reinterpret_cast<__m128i*>(p), x); }
+				static Vector broadcast(uint64_t x) { return _mm_set1_epi64x(x); }
+				static Vector add(Vector x, Vector y) { return _mm_add_epi64(x, y); }
+				static Vector bitXor(Vector x, Vector y) { return _mm_xor_si128(x, y); }
+				static Vector bitAnd(Vector x, Vector y) { return _mm_and_si128(x, y); }
+				static Vector bitAndNot(Vector x, Vector y) { return _mm_andnot_si128(x, y); }
+				template<int n> static Vector shr(Vector x) { return _mm_srli_epi64(x, n); }
+				template<int n> static Vector rotr(Vector x) { return _mm_or_si128(_mm_srli_epi64(x, n), _mm_slli_epi64(x, 64 - n)); }
+			} Sse2Lanes;
+
+			/** One SHA512 round in every lane, with the same variable renaming as the scalar implementation */
+			template<typename L> inline void laneStep(typename L::Vector a, typename L::Vector b, typename L::Vector c, typename L::Vector& d,
+				typename L::Vector e, typename L::Vector f, typename L::Vector g, typename L::Vector& h, typename L::Vector kw)
+			{
+				auto SIGMA1 = L::bitXor(L::bitXor(L::template rotr<14>(e), L::template rotr<18>(e)), L::template rotr<41>(e));
+				auto ch = L::bitXor(L::bitAnd(e, f), L::bitAndNot(e, g));
+				auto t1 = L::add(L::add(L::add(h, SIGMA1), ch), kw);
+
+				auto SIGMA0 = L::bitXor(L::bitXor(L::template rotr<28>(a), L::template rotr<34>(a)), L::template rotr<39>(a));
+				auto maj = L::bitXor(L::bitAnd(a, L::bitXor(b, c)), L::bitAnd(b, c));
+
+				d = L::add(d, t1);
+				h = L::add(t1, L::add(SIGMA0, maj));
+			}
+
+			/** K[t] + W[t] in every lane, expanding W[t] in the 16-word circular buffer when t >= 16 */
+			template<typename L> inline typename L::Vector laneSchedule(typename L::Vector* W, size_t t)
+			{
+				if(t >= 16)
+				{
+					auto w2 = W[(t - 2) & 15];
+					auto w15 = W[(t - 15) & 15];
+					auto s1 = L::bitXor(L::bitXor(L::template rotr<19>(w2), L::template rotr<61>(w2)), L::template shr<6>(w2));
+					auto s0 = L::bitXor(L::bitXor(L::template rotr<1>(w15), L::template rotr<8>(w15)), L::template shr<7>(w15));
+					W[t & 15] = L::add(L::add(W[t & 15], s1), L::add(W[(t - 7) & 15], s0));
+				}
+
+				return L::add(W[t & 15], L::broadcast(K[t]));
+			}
+
+			/** Run the compression function once in each of the L::Count lanes on word-major message words */
+			template<typename L> void compressLanes(uint64_t state[8][SHA512_MAX_LANES], const uint64_t words[16][SHA512_MAX_LANES])
+			{
+				typedef typename L::Vector Vector;
+
+				Vector W[16];
+				for(auto t = 0; t < 16; t++)
+				{
+					W[t] = L::load(words[t]);
+				}
+
+				auto a = L::load(state[0]);
+				auto b = L::load(state[1]);
+				auto c = L::load(state[2]);
+				auto d = L::load(state[3]);
+				auto e = L::load(state[4]);
+				auto f = L::load(state[5]);
+				auto g = L::load(state[6]);
+				auto h = L::load(state[7]);
+
+				for(size_t t = 0; t < SHA512_ROUNDS_PER_BLOCK; t += 8)
+				{
+					laneStep<L>(a, b, c, d, e, f, g, h, laneSchedule<L>(W, t    ));
+					laneStep<L>(h, a, b, c, d, e, f, g, laneSchedule<L>(W, t + 1));
+					laneStep<L>(g, h, a, b, c, d, e, f, laneSchedule<L>(W, t + 2));
+					laneStep<L>(f, g, h, a, b, c, d, e, laneSchedule<L>(W, t + 3));
+					laneStep<L>(e, f, g, h, a, b, c, d, laneSchedule<L>(W, t + 4));
+					laneStep<L>(d, e, f, g, h, a, b, c, laneSchedule<L>(W, t + 5));
+					laneStep<L>(c, d, e, f, g, h, a, b, laneSchedule<L>(W, t + 6));
+					laneStep<L>(b, c, d, e, f, g, h, a, laneSchedule<L>(W, t + 7));
+				}
+
+				L::store(state[0], L::add(L::load(state[0]), a));
+				L::store(state[1], L::add(L::load(state[1]), b));
+				L::store(state[2], L::add(L::load(state[2]), c));
+				L::store(state[3], L::add(L::load(state[3]), d));
+				L::store(state[4], L::add(L::load(state[4]), e));
+				L::store(state[5], L::add(L::load(state[5]), f));
+				L::store(state[6], L::add(L::load(state[6]), g));
+				L::store(state[7], L::add(L::load(state[7]), h));
+			}
+
+			size_t Lanes()
+			{
+				if (Enabled()) return Avx2Lanes::Count;
+				if (cpu::HasSSE2()) return Sse2Lanes::Count;
+
+				return 1;
+			}
+
+			void CompressLanes(uint64_t state[8][SHA512_MAX_LANES], const char* const* blocks)
+			{
+				auto lanes = Lanes();
+
+				// Transpose the blocks so word t of every lane's block can be loaded together
+				alignas(32) uint64_t words[16][SHA512_MAX_LANES];
+				for(size_t l = 0; l < lanes; l++)
+				{
+					for(auto t = 0; t < 16; t++)
+					{
+						words[t][l] = _byteswap_uint64(reinterpret_cast<const unsigned long long*>(blocks[l])[t]);
+					}
+				}
+
+				CompressLaneWords(state, words);
+			}
+
+			void CompressLaneWords(uint64_t state[8][SHA512_MAX_LANES], const uint64_t words[16][SHA512_MAX_LANES])
+			{
+				if(Enabled())
+				{
+					compressLanes<Avx2Lanes>(state, words);
+				}
+				else
+				{
+					compressLanes<Sse2Lanes>(state, words);
+				}
+			}
+		}
+	}
+}
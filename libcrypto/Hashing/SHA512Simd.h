@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SHA512Simd.h - Vectorized SHA512: AVX2 message schedule expansion and multi-buffer compression
+ */
+#pragma once
+#include <cstdint>
+#include "SHA512.h"
+#include "../export.h"
+
+/** The most messages any multi-buffer implementation hashes side by side (4 lanes of 64 bits with AVX2) */
+#define SHA512_MAX_LANES 4
+
+namespace libcrypto
+{
+	namespace hashing
+	{
+		namespace simd
+		{
+			/**
+			 * Whether or not the AVX2 implementation can be used on this processor
+			 */
+			LIBCRYPTO_PUB bool Supported();
+
+			/**
+			 * Allow or prevent the hash functions from dispatching to the AVX2 implementation when it is supported. Enabled by
+			 * default, this only exists so validation and benchmarks can exercise the scalar implementation on the same machine
+			 */
+			LIBCRYPTO_PUB void SetEnabled(bool enabled);
+
+			/**
+			 * Whether or not the hash functions will use the AVX2 implementation
+			 */
+			LIBCRYPTO_PUB bool Enabled();
+
+			/**
+			 * Load the 128-byte block and expand its full message schedule, storing K[t] + W[t] for all 80 rounds in KW
+			 * (which must be 32-byte aligned). Requires AVX2
+			 */
+			void ExpandSchedule(const char* block, uint64_t* KW);
+
+			/**
+			 * The number of messages the best available multi-buffer implementation hashes side by side: 4 with AVX2 (if
+			 * enabled), 2 with SSE2, otherwise 1 (no multi-buffer support)
+			 */
+			size_t Lanes();
+
+			/**
+			 * Run the compression function once in each of the Lanes() lanes. state is word-major (state[i][lane] is H(i) of
+			 * that lane) and must be 32-byte aligned, and blocks[lane] points to the 128-byte block for that lane
+			 */
+			void CompressLanes(uint64_t state[8][SHA512_MAX_LANES], const char* const* blocks);
+
+			/**
+			 * Like CompressLanes, but the message words are already loaded: words[t][lane] is word t of that lane's block.
+			 * words must be 32-byte aligned
+			 */
+			void CompressLaneWords(uint64_t state[8][SHA512_MAX_LANES], const uint64_t words[16][SHA512_MAX_LANES]);
+		}
+	}
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Mapping.h - Encrypting and decrypting files through memory mappings
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <windows.h>
+
+/** The number of bytes of a mapping each worker transforms at a time (and hints to the memory manager a chunk ahead) */
+#define MAPPED_REGION_CHUNK_BYTES (1024 * 1024)
+/** The granularity at which TouchPages reads a mapping */
+#define MAPPED_PAGE_BYTES 4096
+
+namespace libcrypto
+{
+	namespace mapping
+	{
+		/**
+		 * A file mapped into memory in one view, read-only or read-write
+		 */
+		class MappedFile
+		{
+		public:
+			MappedFile() {}
+
+			~MappedFile()
+			{
+				Unmap();
+				if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+			}
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			/**
+			 * Open the file at path for reading, or for reading and writing. Creates (or truncates) it if create is set.
+			 * Returns false if it cannot be opened
+			 */
+			bool Open(const std::string& path, bool writable, bool create = false)
+			{
+				this->writable = writable;
+				file = CreateFileA(path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+					create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+				if (file == INVALID_HANDLE_VALUE) return false;
+
+				LARGE_INTEGER length;
+				if (!GetFileSizeEx(file, &length)) return false;
+
+				size = static_cast<uint64_t>(length.QuadPart);
+				return true;
+			}
+
+			/** The size of the file */
+			uint64_t Size() const { return size; }
+
+			/** Grow or shrink the file. It must not be mapped */
+			bool Resize(uint64_t length)
+			{
+				LARGE_INTEGER distance;
+				distance.QuadPart = static_cast<LONGLONG>(length);
+				if (!SetFilePointerEx(file, distance, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) return false;
+
+				size = length;
+				return true;
+			}
+
+			/**
+			 * Map the whole file. Returns nullptr if it cannot be mapped: it is empty, or too big for the address space
+			 */
+			char* Map()
+			{
+				if (size == 0) return nullptr;
+
+				mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+				if (mapping == nullptr) return nullptr;
+
+				view = static_cast<char*>(MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+				return view;
+			}
+
+			/** Unmap the file, writing back what changed */
+			void Unmap()
+			{
+				if (view != nullptr) UnmapViewOfFile(view);
+				if (mapping != nullptr) CloseHandle(mapping);
+
+				view = nullptr;
+				mapping = nullptr;
+			}
+
+		private:
+			HANDLE file = INVALID_HANDLE_VALUE;
+			HANDLE mapping = nullptr;
+			char* view = nullptr;
+			uint64_t size = 0;
+			bool writable = false;
+		};
+
+		/**
+		 * True iff both paths name the same existing file, however they spell it: relative or absolute, differently cased,
+		 * or through another hard link. Compares the volume serial number and file index rather than the paths
+		 */
+		inline bool SameFile(const std::string& a, const std::string& b)
+		{
+			BY_HANDLE_FILE_INFORMATION info[2];
+			const std::string* paths[2] = { &a, &b };
+			for(auto i = 0; i < 2; i++)
+			{
+				// Only the attributes are needed, and the file may already be open for writing elsewhere
+				auto file = CreateFileA(paths[i]->c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+					nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (file == INVALID_HANDLE_VALUE) return false;
+
+				auto ok = GetFileInformationByHandle(file, &info[i]);
+				CloseHandle(file);
+				if (!ok) return false;
+			}
+
+			return info[0].dwVolumeSerialNumber == info[1].dwVolumeSerialNumber &&
+				info[0].nFileIndexHigh == info[1].nFileIndexHigh && info[0].nFileIndexLow == info[1].nFileIndexLow;
+		}
+
+		/**
+		 * Run f, which reads or writes a mapping, and return what it returns, or false if it touched a page that could not be
+		 * read in. Windows raises EXCEPTION_IN_PAGE_ERROR for that (the file was truncated under the mapping, or the disk or
+		 * network failed) instead of returning an error, and it would otherwise end the process. f is abandoned where it
+		 * faulted, without unwinding, so it must not hold locks or own anything that needs freeing
+		 */
+		template<typename F> bool GuardPages(const F& f)
+		{
+			__try
+			{
+				return f();
+			}
+			__except(GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+			{
+				return false;
+			}
+		}
+
+		/** Read a byte of every page of the range, so it is in memory before it is needed. Returns false if a page could not be read in */
+		inline bool TouchPages(const char* data, size_t len)
+		{
+			return GuardPages([data, len]
+			{
+				volatile char sink = 0;
+				for (size_t page = 0; page < len; page += MAPPED_PAGE_BYTES) sink ^= data[page];
+				return true;
+			});
+		}
+
+		/**
+		 * Ask the memory manager to read the range in with large sequential reads, instead of a page fault at a time. Only
+		 * a hint, so it is ignored where it is not supported
+		 */
+		inline void Prefetch(const char* data, uint64_t len)
+		{
+			if (data == nullptr || len == 0) return;
+
+			WIN32_MEMORY_RANGE_ENTRY range = { const_cast<char*>(data), static_cast<size_t>(len) };
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+		}
+
+		/**
+		 * Transforms len bytes at data in place, offset bytes into the region. previous is the ciphertext block just before
+		 * them (the IV for the first chunk), or nullptr in ECB mode
+		 */
+		typedef std::function<bool(char* data, uint64_t offset, size_t len, const char* previous)> Transform;
+
+		/**
+		 * A run of mapped bytes to encrypt or decrypt in place
+		 */
+		struct Region
+		{
+			/** The bytes to transform, a whole number of blocks */
+			char* Data;
+			/** The number of bytes to transform */
+			uint64_t Length;
+			/** Where the bytes are copied from, at the same offsets, so it can be read ahead. Data itself when in place */
+			const char* Source;
+			/** Where the ciphertext of the region can be read to chain the chunks in CBC mode, or nullptr in ECB mode */
+			const char* Chain;
+			/** The block to chain the first chunk from (the IV) */
+			const char* First;
+			/** True when encrypting, which makes every CBC chunk wait for the ciphertext of the one before it */
+			bool Encrypting;
+		};
+
+		/**
+		 * Transform the region a chunk at a time on the specified number of workers, reading ahead of the chunks being
+		 * worked on. Returns false if any call to transform does, or a page of the region could not be read in (see GuardPages)
+		 *
+		 * CBC encryption chains every chunk to the ciphertext of the last, so it runs on one worker in order. Decryption
+		 * chains from ciphertext that is already there, so any worker can take any chunk, but when decrypting in place the
+		 * ciphertext is overwritten as it goes: the block before each chunk is saved before any of them are transformed
+		 */
+		inline bool TransformRegion(const Region& region, size_t block, unsigned int workers, const Transform& transform)
+		{
+			auto chunks = (region.Length + MAPPED_REGION_CHUNK_BYTES - 1) / MAPPED_REGION_CHUNK_BYTES;
+			if (region.Chain != nullptr && region.Encrypting) workers = 1;
+			if (workers < 1) workers = 1;
+			if (workers > chunks) workers = static_cast<unsigned int>(chunks < 1 ? 1 : chunks);
+
+			std::vector<char> saved;
+			if(region.Chain == region.Data && !region.Encrypting)
+			{
+				saved.resize(static_cast<size_t>(chunks * block));
+				auto ok = GuardPages([&]
+				{
+					for(uint64_t chunk = 1; chunk < chunks; chunk++)
+					{
+						memcpy(&saved[static_cast<size_t>(chunk * block)], region.Chain + chunk * MAPPED_REGION_CHUNK_BYTES - block, block);
+					}
+					return true;
+				});
+				if (!ok) return false;
+			}
+
+			std::atomic<uint64_t> next(0);
+			std::atomic<bool> failed(false);
+
+			auto work = [&]()
+			{
+				for(auto chunk = next++; chunk < chunks && !failed; chunk = next++)
+				{
+					auto offset = chunk * MAPPED_REGION_CHUNK_BYTES;
+					auto len = static_cast<size_t>(region.Length - offset < MAPPED_REGION_CHUNK_BYTES ? region.Length - offset : MAPPED_REGION_CHUNK_BYTES);
+
+					// Read ahead past the chunks the other workers are about to take
+					auto ahead = offset + workers * MAPPED_REGION_CHUNK_BYTES;
+					if (region.Source != nullptr && ahead < region.Length) Prefetch(region.Source + ahead, region.Length - ahead < MAPPED_REGION_CHUNK_BYTES ? region.Length - ahead : MAPPED_REGION_CHUNK_BYTES);
+
+					const char* previous = nullptr;
+					if (region.Chain != nullptr) previous = chunk == 0 ? region.First : !saved.empty() ? &saved[static_cast<size_t>(chunk * block)] : region.Chain + offset - block;
+
+					if (!GuardPages([&] { return transform(region.Data + offset, offset, len, previous); })) failed = true;
+				}
+			};
+
+			if (region.Source != nullptr) Prefetch(region.Source, region.Length < MAPPED_REGION_CHUNK_BYTES ? region.Length : MAPPED_REGION_CHUNK_BYTES);
+
+			std::vector<std::thread> threads;
+			for (unsigned int i = 1; i < workers; i++) threads.emplace_back(work);
+			work();
+			for (auto& thread : threads) thread.join();
+
+			return !failed;
+		}
+	}
+}
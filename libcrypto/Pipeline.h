@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Pipeline.h - Reading, transforming and writing a file in chunks on separate threads
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+
+/** The alignment of the chunk buffers (a page, so they suit any cipher and unbuffered i/o) */
+#define PIPELINE_CHUNK_ALIGNMENT 4096
+/** The number of chunks in flight for each crypto worker, so the reader and writer can run ahead and behind */
+#define PIPELINE_CHUNKS_PER_WORKER 3
+/** The largest cipher block a chunk carries the preceding ciphertext block of */
+#define PIPELINE_MAX_BLOCK_BYTES 16
+/** How many times a consumer checks an empty ring (yielding in between) before it goes to sleep until an item arrives */
+#define PIPELINE_SPIN_COUNT 100
+
+namespace libcrypto
+{
+	namespace pipeline
+	{
+		/**
+		 * One chunk of the file on its way through the pipeline
+		 */
+		struct Chunk
+		{
+			/** The ciphertext block just before the chunk (the IV for the first), which lets CBC decryption run on any worker */
+			alignas(16) char Previous[PIPELINE_MAX_BLOCK_BYTES];
+			/** The buffer, aligned to PIPELINE_CHUNK_ALIGNMENT */
+			char* Data;
+			/** The size of the buffer */
+			size_t Capacity;
+			/** The number of bytes in the buffer */
+			size_t Length;
+			/** The position of the chunk in the file, counting from 0 */
+			uint64_t Index;
+			/** Set by the reader on the last chunk of the file */
+			bool Last;
+		};
+
+		/**
+		 * A lock-free ring of items passed from exactly one producer thread to exactly one consumer thread. A consumer that
+		 * finds it empty for long only takes the lock to sleep, and the producer only takes it to wake a sleeping consumer
+		 */
+		template<typename T> class Ring
+		{
+		public:
+			/** Create a ring with room for at least capacity items */
+			explicit Ring(size_t capacity)
+			{
+				size_t size = 1;
+				while (size < capacity) size <<= 1;
+
+				slots.resize(size);
+				mask = size - 1;
+			}
+
+			/** Rings are over-aligned to keep head and tail on cache lines of their own, which plain new doesn't honor */
+			static void* operator new(size_t size)
+			{
+				auto ring = _aligned_malloc(size, alignof(Ring));
+				if (ring == nullptr) throw std::bad_alloc();
+				return ring;
+			}
+
+			static void operator delete(void* ring)
+			{
+				_aligned_free(ring);
+			}
+
+			/** Add the item to the back of the ring. Returns false if the ring is full. Only call from the producer */
+			bool TryPush(const T& item)
+			{
+				auto back = tail.load(std::memory_order_relaxed);
+				if (back - head.load(std::memory_order_acquire) == slots.size()) return false;
+
+				slots[back & mask] = item;
+				tail.store(back + 1, std::memory_order_release);
+				return true;
+			}
+
+			/** Take the item at the front of the ring. Returns false if the ring is empty. Only call from the consumer */
+			bool TryPop(T& item)
+			{
+				auto front = head.load(std::memory_order_relaxed);
+				if (front == tail.load(std::memory_order_acquire)) return false;
+
+				item = slots[front & mask];
+				head.store(front + 1, std::memory_order_release);
+				return true;
+			}
+
+			/** Add the item to the back of the ring and wake the consumer if it is asleep. Only call from the producer */
+			bool Push(const T& item)
+			{
+				if (!TryPush(item)) return false;
+
+				// Pairs with the fence in Pop: either the consumer sees the item, or we see that it is (about to be) asleep
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if(sleeping.load(std::memory_order_relaxed))
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					wakeup.notify_one();
+				}
+
+				return true;
+			}
+
+			/**
+			 * Take the item at the front of the ring, waiting for one to arrive: spinning at first, as the next item is often
+			 * moments away, then asleep until Push wakes it. Returns false once stop returns true and the ring is empty (call
+			 * Wake after changing what stop looks at). Only call from the consumer
+			 */
+			template<typename Stop> bool Pop(T& item, Stop stop)
+			{
+				for(auto spin = 0; spin < PIPELINE_SPIN_COUNT; spin++)
+				{
+					// Check stop first, so an item pushed just before the producer stops is still taken
+					auto stopping = stop();
+					if (TryPop(item)) return true;
+					if (stopping) return false;
+					std::this_thread::yield();
+				}
+
+				std::unique_lock<std::mutex> guard(lock);
+				for(;;)
+				{
+					sleeping.store(true, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+
+					auto stopping = stop();
+					auto popped = TryPop(item);
+					if(popped || stopping)
+					{
+						sleeping.store(false, std::memory_order_relaxed);
+						return popped;
+					}
+
+					wakeup.wait(guard);
+				}
+			}
+
+			/** Wake the consumer if it is asleep, so it checks its stop condition again */
+			void Wake()
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				wakeup.notify_all();
+			}
+
+		private:
+			std::vector<T> slots;
+			size_t mask;
+
+			/** Where the consumer sleeps while the ring is empty */
+			std::mutex lock;
+			std::condition_variable wakeup;
+			std::atomic<bool> sleeping{ false };
+
+			/** The next slot to pop and push, on their own cache lines so the two threads do not contend */
+			alignas(64) std::atomic<size_t> head{ 0 };
+			alignas(64) std::atomic<size_t> tail{ 0 };
+		};
+
+		/**
+		 * Runs a file through three stages: a reader thread fills chunks, one or more crypto workers transform them in place,
+		 * and the writer (the calling thread) writes them out in order. Chunk i always goes to worker i % workers, over a ring
+		 * of its own in each direction, so every ring has a single producer and consumer and the writer can restore the order
+		 * without locks. The writer hands written chunks back to the reader over one more ring.
+		 *
+		 * A stage returns false to stop the pipeline (after printing why). Stages never run concurrently with themselves, except
+		 * the transform, which runs on every worker at once and must only touch its own chunk when there is more than one
+		 */
+		class Pipeline
+		{
+		public:
+			typedef std::function<bool(Chunk&)> Stage;
+
+			/** Create a pipeline with the specified number of crypto workers, moving chunkSize bytes at a time */
+			Pipeline(size_t chunkSize, unsigned int workers) : workers(workers < 1 ? 1 : workers),
+				chunks(this->workers * PIPELINE_CHUNKS_PER_WORKER), empty(chunks.size()), workerSeconds(this->workers, 0)
+			{
+				for(size_t i = 0; i < chunks.size(); i++)
+				{
+					chunks[i].Data = static_cast<char*>(_aligned_malloc(chunkSize, PIPELINE_CHUNK_ALIGNMENT));
+					if(chunks[i].Data == nullptr)
+					{
+						// The destructor won't run for a constructor that throws, so give back the chunks we already have
+						for (size_t j = 0; j < i; j++) _aligned_free(chunks[j].Data);
+						throw std::bad_alloc();
+					}
+
+					chunks[i].Capacity = chunkSize;
+					empty.TryPush(&chunks[i]);
+				}
+
+				for(unsigned int i = 0; i < this->workers; i++)
+				{
+					inputs.emplace_back(new Ring<Chunk*>(chunks.size()));
+					outputs.emplace_back(new Ring<Chunk*>(chunks.size()));
+				}
+			}
+
+			~Pipeline()
+			{
+				for (auto& chunk : chunks) _aligned_free(chunk.Data);
+			}
+
+			Pipeline(const Pipeline&) = delete;
+			Pipeline& operator=(const Pipeline&) = delete;
+
+			/** The number of crypto workers */
+			unsigned int Workers() const { return workers; }
+
+			/**
+			 * Read, transform and write chunks until the reader marks one as the last, or a stage fails. Returns true iff every
+			 * chunk was written
+			 */
+			bool Run(const Stage& read, const Stage& transform, const Stage& write)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+
+				std::thread reader(&Pipeline::readChunks, this, std::cref(read));
+				std::vector<std::thread> threads;
+				for(unsigned int i = 0; i < workers; i++)
+				{
+					threads.emplace_back(&Pipeline::transformChunks, this, i, std::cref(transform));
+				}
+
+				writeChunks(write);
+
+				reader.join();
+				for (auto& thread : threads) thread.join();
+
+				std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+				seconds = duration.count();
+
+				return !failed;
+			}
+
+			/** The wall time of the last run, in milliseconds */
+			double Milliseconds() const { return seconds * 1000; }
+
+			/**
+			 * Print how long each stage spent working, and how much of the run that was. A stage near 100% is the bottleneck;
+			 * the others spent the rest of the run waiting on it
+			 */
+			void Report(std::ostream& out) const
+			{
+				double crypto = 0;
+				for (auto busy : workerSeconds) crypto += busy;
+
+				out << std::fixed << std::setprecision(1);
+				out << "\tread:   " << readSeconds * 1000 << "ms (" << utilization(readSeconds) << "% busy)" << std::endl;
+				out << "\tcrypto: " << crypto * 1000 << "ms on " << workers << (workers == 1 ? " worker (" : " workers (")
+					<< utilization(crypto / workers) << "% busy)" << std::endl;
+				out << "\twrite:  " << writeSeconds * 1000 << "ms (" << utilization(writeSeconds) << "% busy)" << std::endl;
+				out << std::defaultfloat;
+			}
+
+		private:
+			/** Time the stage on the chunk, adding it to busy. Stops the pipeline if the stage fails */
+			bool runStage(const Stage& stage, Chunk& chunk, double& busy)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				auto ok = stage(chunk);
+				std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+				busy += duration.count();
+
+				if (!ok) stop();
+				return ok;
+			}
+
+			/** Stop the pipeline, waking every stage that is waiting for a chunk */
+			void stop()
+			{
+				failed = true;
+				wakeAll();
+			}
+
+			/** Wake every stage that is waiting for a chunk */
+			void wakeAll()
+			{
+				empty.Wake();
+				for (auto& ring : inputs) ring->Wake();
+				for (auto& ring : outputs) ring->Wake();
+			}
+
+			/** Pop the next item from the ring, waiting for one to arrive. Returns false if the pipeline stopped first */
+			bool pop(Ring<Chunk*>& ring, Chunk*& chunk)
+			{
+				return ring.Pop(chunk, [this] { return failed.load(); }) && !failed;
+			}
+
+			void readChunks(const Stage& read)
+			{
+				Chunk* chunk;
+				for(uint64_t index = 0; pop(empty, chunk); index++)
+				{
+					chunk->Index = index;
+					chunk->Length = 0;
+					chunk->Last = false;
+					if (!runStage(read, *chunk, readSeconds)) break;
+
+					// Every ring can hold every chunk, so this never waits
+					inputs[index % workers]->Push(chunk);
+					if (chunk->Last) break;
+				}
+
+				done.store(true, std::memory_order_release);
+				for (auto& ring : inputs) ring->Wake();
+			}
+
+			void transformChunks(unsigned int worker, const Stage& transform)
+			{
+				auto& input = *inputs[worker];
+				auto& output = *outputs[worker];
+
+				// Once the reader is done, an empty ring stays empty
+				auto stopped = [this] { return failed.load() || done.load(std::memory_order_acquire); };
+
+				Chunk* chunk;
+				while(input.Pop(chunk, stopped) && !failed)
+				{
+					if (!runStage(transform, *chunk, workerSeconds[worker])) return;
+					output.Push(chunk);
+				}
+			}
+
+			void writeChunks(const Stage& write)
+			{
+				Chunk* chunk;
+				for(uint64_t index = 0; pop(*outputs[index % workers], chunk); index++)
+				{
+					if (!runStage(write, *chunk, writeSeconds)) return;
+
+					auto last = chunk->Last;
+					empty.Push(chunk);
+					if (last) return;
+				}
+			}
+
+			/** The percentage of the run spent busy */
+			double utilization(double busy) const
+			{
+				return seconds > 0 ? 100 * busy / seconds : 0;
+			}
+
+			unsigned int workers;
+
+			/** Every chunk buffer */
+			std::vector<Chunk> chunks;
+			/** Empty chunks, from the writer back to the reader */
+			Ring<Chunk*> empty;
+			/** Chunks read, from the reader to each worker */
+			std::vector<std::unique_ptr<Ring<Chunk*>>> inputs;
+			/** Chunks transformed, from each worker to the writer */
+			std::vector<std::unique_ptr<Ring<Chunk*>>> outputs;
+
+			/** Set by the reader after the last chunk */
+			std::atomic<bool> done{ false };
+			/** Set when any stage fails */
+			std::atomic<bool> failed{ false };
+
+			/** The time each stage spent working, and the whole run, in seconds */
+			double readSeconds = 0;
+			std::vector<double> workerSeconds;
+			double writeSeconds = 0;
+			double seconds = 0;
+		};
+	}
+}
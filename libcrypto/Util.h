@@ -35,10 +35,10 @@ inline uint64_t charToUnsigned64(char c)
 /**
  * Extract a uint64_t from the specified char buffer
  */
-inline uint64_t extract64FromBuff(char* buff, size_t offset)
+inline uint64_t extract64FromBuff(const char* buff, size_t offset)
 {
 	// Windows is LE. Since that's the only platform we support, always swap the byte order
-	return _byteswap_uint64(*reinterpret_cast<unsigned long long*>(buff + offset));
+	return _byteswap_uint64(*reinterpret_cast<const unsigned long long*>(buff + offset));
 }
 
 /**
@@ -35,6 +35,8 @@ namespace libcrypto
 	{
 		ECB,
 		CBC,
+		CTR,
+		OFB,
 		UNKNOWN_MODE
 	};
 
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * DigestCache.cpp - A persistent index of the digests of files that have not changed since they were hashed
+ */
+#include "stdafx.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include "DigestCache.h"
+#include "Files.h"
+
+/** The header ahead of the entries: the tag, then the number of entries */
+#define DIGEST_CACHE_HEADER_BYTES 16
+
+/** Order entries by the file they are for, so one can be found with a binary search */
+inline bool before(const CacheKey& a, const CacheKey& b)
+{
+	if (a.Volume != b.Volume) return a.Volume < b.Volume;
+	if (a.File != b.File) return a.File < b.File;
+	return a.Kind < b.Kind;
+}
+
+/** True iff the keys are for the same file and kind of digest */
+inline bool same(const CacheKey& a, const CacheKey& b)
+{
+	return a.Volume == b.Volume && a.File == b.File && a.Kind == b.Kind;
+}
+
+/** Open the root of every mounted volume by its serial number, so the files on it can be opened by their index */
+std::map<uint64_t, HANDLE> openVolumes()
+{
+	std::map<uint64_t, HANDLE> volumes;
+	char name[MAX_PATH];
+	auto search = FindFirstVolumeA(name, sizeof(name));
+	if (search == INVALID_HANDLE_VALUE) return volumes;
+
+	do
+	{
+		DWORD serial;
+		if (!GetVolumeInformationA(name, nullptr, 0, &serial, nullptr, nullptr, nullptr, 0)) continue;
+
+		auto root = CreateFileA(name, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+		if (root != INVALID_HANDLE_VALUE) volumes[serial] = root;
+	} while(FindNextVolumeA(search, name, sizeof(name)));
+	FindVolumeClose(search);
+
+	return volumes;
+}
+
+/**
+ * True unless the file the entry is for is gone, or has been written to since it was hashed. Entries for volumes that
+ * aren't mounted, or files that can't be opened for some other reason, are assumed to still be current
+ */
+bool current(const CacheKey& key, const std::map<uint64_t, HANDLE>& volumes)
+{
+	auto volume = volumes.find(key.Volume);
+	if (volume == volumes.end()) return true;
+
+	FILE_ID_DESCRIPTOR id;
+	id.dwSize = sizeof(id);
+	id.Type = FileIdType;
+	id.FileId.QuadPart = static_cast<LONGLONG>(key.File);
+
+	auto file = OpenFileById(volume->second, &id, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, 0);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		auto error = GetLastError();
+		return error != ERROR_INVALID_PARAMETER && error != ERROR_FILE_NOT_FOUND && error != ERROR_PATH_NOT_FOUND && error != ERROR_DELETE_PENDING;
+	}
+
+	BY_HANDLE_FILE_INFORMATION info;
+	auto ok = GetFileInformationByHandle(file, &info);
+	CloseHandle(file);
+	if (!ok) return true;
+
+	auto size = static_cast<uint64_t>(info.nFileSizeHigh) << 32 | info.nFileSizeLow;
+	auto modified = static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32 | info.ftLastWriteTime.dwLowDateTime;
+	return size == key.Size && modified == key.Modified;
+}
+
+DigestCache::DigestCache(const std::string& path) : path(path)
+{
+	// Let other scans read it too, and let a finishing scan rename a new index over it
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < DIGEST_CACHE_HEADER_BYTES) return;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) return;
+
+	view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (view == nullptr) return;
+
+	uint64_t count;
+	memcpy(&count, view + 8, sizeof(count));
+	if(memcmp(view, DIGEST_CACHE_TAG, 8) != 0 || static_cast<uint64_t>(size.QuadPart) != DIGEST_CACHE_HEADER_BYTES + count * sizeof(CacheEntry))
+	{
+		std::cerr << path << " is not a digest cache, so it will be replaced" << std::endl;
+		return;
+	}
+
+	index = reinterpret_cast<const CacheEntry*>(view + DIGEST_CACHE_HEADER_BYTES);
+	entries = static_cast<size_t>(count);
+	seen.resize(entries);
+}
+
+DigestCache::~DigestCache()
+{
+	if (view != nullptr) UnmapViewOfFile(view);
+	if (mapping != nullptr) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+bool DigestCache::Identify(const std::string& path, uint64_t kind, CacheKey& key)
+{
+	// Only the attributes are needed, which doesn't touch the contents
+	auto file = CreateFileA(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	BY_HANDLE_FILE_INFORMATION info;
+	auto ok = GetFileInformationByHandle(file, &info);
+	CloseHandle(file);
+	if (!ok) return false;
+
+	key.Volume = info.dwVolumeSerialNumber;
+	key.File = static_cast<uint64_t>(info.nFileIndexHigh) << 32 | info.nFileIndexLow;
+	key.Kind = kind;
+	key.Size = static_cast<uint64_t>(info.nFileSizeHigh) << 32 | info.nFileSizeLow;
+	key.Modified = static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32 | info.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+size_t DigestCache::find(const CacheKey& key) const
+{
+	auto found = std::lower_bound(index, index + entries, key, [](const CacheEntry& entry, const CacheKey& k) { return before(entry.Key, k); });
+	return found != index + entries && same(found->Key, key) ? static_cast<size_t>(found - index) : entries;
+}
+
+bool DigestCache::Lookup(const CacheKey& key, char* digest)
+{
+	auto at = find(key);
+	if (at == entries) return false;
+
+	// Purging needn't look at the file again, as it is either current or about to be stored again
+	std::lock_guard<std::mutex> guard(lock);
+	seen[at] = true;
+
+	auto& entry = index[at];
+	if (entry.Key.Size != key.Size || entry.Key.Modified != key.Modified) return false;
+
+	memcpy(digest, entry.Digest, SHA512_DIGEST_SIZE_BYTES);
+	hits++;
+	return true;
+}
+
+void DigestCache::Store(const CacheKey& key, const char* digest)
+{
+	CacheEntry entry;
+	entry.Key = key;
+	memcpy(entry.Digest, digest, SHA512_DIGEST_SIZE_BYTES);
+
+	std::lock_guard<std::mutex> guard(lock);
+	stored.push_back(entry);
+}
+
+bool DigestCache::Save(bool purge)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	// Merge the stored digests into the index, newest first so they replace the entries they update
+	std::vector<CacheEntry> merged(stored.rbegin(), stored.rend());
+	std::map<uint64_t, HANDLE> volumes;
+	if (purge) volumes = openVolumes();
+	purged = 0;
+	for(size_t i = 0; i < entries; i++)
+	{
+		if(purge && !seen[i] && !current(index[i].Key, volumes))
+		{
+			purged++;
+			continue;
+		}
+
+		merged.push_back(index[i]);
+	}
+
+	for(auto& volume : volumes)
+	{
+		CloseHandle(volume.second);
+	}
+
+	if (stored.empty() && purged == 0) return true;
+
+	std::stable_sort(merged.begin(), merged.end(), [](const CacheEntry& a, const CacheEntry& b) { return before(a.Key, b.Key); });
+	merged.erase(std::unique(merged.begin(), merged.end(), [](const CacheEntry& a, const CacheEntry& b) { return same(a.Key, b.Key); }), merged.end());
+
+	std::vector<char> contents(DIGEST_CACHE_HEADER_BYTES + merged.size() * sizeof(CacheEntry));
+	uint64_t count = merged.size();
+	memcpy(contents.data(), DIGEST_CACHE_TAG, 8);
+	memcpy(contents.data() + 8, &count, sizeof(count));
+	if (!merged.empty()) memcpy(contents.data() + DIGEST_CACHE_HEADER_BYTES, merged.data(), merged.size() * sizeof(CacheEntry));
+
+	// Other scans may keep the old index mapped while it is replaced, but this one has no more use for it
+	if (view != nullptr) UnmapViewOfFile(view);
+	if (mapping != nullptr) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	view = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+	index = nullptr;
+	entries = 0;
+	seen.clear();
+	stored.clear();
+
+	return WriteAtomically(path, contents.data(), contents.size());
+}
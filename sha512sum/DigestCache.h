@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * DigestCache.h - A persistent index of the digests of files that have not changed since they were hashed
+ */
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "../libcrypto/Hashing/SHA512.h"
+
+/** The tag at the start of a digest cache, which also versions the layout */
+#define DIGEST_CACHE_TAG "S512DC01"
+
+/**
+ * What identifies a file and the version of its contents: the volume and file index (the Windows equivalent of the
+ * device and inode) pick out the file however it is named, and the size and last write time say if it has changed.
+ * Kind says what was computed: 0 for the SHA512 digest, or the leaf size of the tree
+ */
+typedef struct CacheKey
+{
+	uint64_t Volume;
+	uint64_t File;
+	uint64_t Kind;
+	uint64_t Size;
+	uint64_t Modified;
+} CacheKey;
+
+/** A record of the index, which is an array of them sorted by (Volume, File, Kind) after a small header */
+typedef struct CacheEntry
+{
+	CacheKey Key;
+	char Digest[SHA512_DIGEST_SIZE_BYTES];
+} CacheEntry;
+
+/**
+ * A digest cache file, memory-mapped read-only so any number of scans can use it at the same time. Lookups are a binary
+ * search of the mapping, so opening a cache costs nothing however big it is.
+ *
+ * New digests are kept in memory until Save, which writes a whole new index next to the old one and renames it into place.
+ * Readers keep using the old index even after it has been replaced, so a cache is never seen half written. When two scans save at once, the last one
+ * wins and the other's new digests are simply hashed again next time
+ */
+class DigestCache
+{
+public:
+	/** Map the cache at path. A missing or unreadable cache starts out empty */
+	explicit DigestCache(const std::string& path);
+	~DigestCache();
+
+	/** Identify the file at path for the specified kind of digest. Returns false if it cannot be opened */
+	static bool Identify(const std::string& path, uint64_t kind, CacheKey& key);
+
+	/** Copy out the digest of the file if it was cached and has not changed since. Safe to call from any thread */
+	bool Lookup(const CacheKey& key, char* digest);
+	/** Remember the digest of the file for Save. Safe to call from any thread */
+	void Store(const CacheKey& key, const char* digest);
+
+	/**
+	 * Write the cache back with the digests stored since it was opened, if anything changed. With purge, entries for files
+	 * that have been deleted or written to since they were hashed are dropped, whether or not this scan looked at them.
+	 * Returns false if it could not be written
+	 */
+	bool Save(bool purge);
+
+	/** The number of digests served from the cache */
+	size_t Hits() const { return hits; }
+	/** The number of entries dropped by the last Save with purge */
+	size_t Purged() const { return purged; }
+
+private:
+	/** The index of the mapped entry for the file (ignoring its size and time), or entries if there is none */
+	size_t find(const CacheKey& key) const;
+
+	std::string path;
+
+	/** The file, the mapping and the entries in the view */
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+	const char* view = nullptr;
+	const CacheEntry* index = nullptr;
+	size_t entries = 0;
+
+	/** Guards everything below */
+	std::mutex lock;
+	/** Whether each mapped entry has been looked up (so purging needn't check its file again) */
+	std::vector<bool> seen;
+	/** The digests stored since the cache was opened */
+	std::vector<CacheEntry> stored;
+	size_t hits = 0;
+	size_t purged = 0;
+};
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Files.cpp - Finding the files to hash and reading checksum manifests
+ */
+
+#include "stdafx.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <windows.h>
+#include "Files.h"
+
+/** The separator put between a directory and the names found in it */
+#define PATH_SEPARATOR "\\"
+
+/** How many temporary names WriteAtomically tries before giving up */
+#define WRITE_ATOMICALLY_ATTEMPTS 16
+
+// The Windows 8.1 SDK predates rename with POSIX semantics (Windows 10 1607), so declare what it needs here
+#ifndef FILE_RENAME_FLAG_POSIX_SEMANTICS
+#define FILE_RENAME_FLAG_REPLACE_IF_EXISTS 0x00000001
+#define FILE_RENAME_FLAG_POSIX_SEMANTICS 0x00000002
+#define FileRenameInfoEx 22
+#endif
+
+/** FILE_RENAME_INFO as FileRenameInfoEx takes it, with flags in place of ReplaceIfExists */
+typedef struct RenameInformation
+{
+	DWORD Flags;
+	HANDLE RootDirectory;
+	DWORD FileNameLength;
+	WCHAR FileName[1];
+} RenameInformation;
+
+/** Add the files under the directory, sorted by name at each level, without following junctions or directory symlinks */
+bool collectDirectory(const std::string& directory, std::vector<FileEntry>& files)
+{
+	WIN32_FIND_DATAA found;
+	auto search = FindFirstFileA((directory + PATH_SEPARATOR "*").c_str(), &found);
+	if(search == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "Unable to list directory: " << directory << std::endl;
+		return false;
+	}
+
+	// The order FindNextFile returns entries in depends on the file system, so sort them for a stable output
+	std::vector<WIN32_FIND_DATAA> entries;
+	do
+	{
+		std::string name(found.cFileName);
+		if (name != "." && name != "..") entries.push_back(found);
+	} while(FindNextFileA(search, &found));
+	FindClose(search);
+
+	std::sort(entries.begin(), entries.end(), [](const WIN32_FIND_DATAA& a, const WIN32_FIND_DATAA& b) { return strcmp(a.cFileName, b.cFileName) < 0; });
+
+	for(auto& entry : entries)
+	{
+		auto path = directory + PATH_SEPARATOR + entry.cFileName;
+		if(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			// Junctions and directory symlinks can lead back up the tree (forever) or out of it, so they aren't followed
+			if (entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) continue;
+			if (!collectDirectory(path, files)) return false;
+		}
+		else
+		{
+			files.push_back({ path, "" });
+		}
+	}
+
+	return true;
+}
+
+bool CollectFiles(const std::vector<std::string>& inputs, bool recursive, std::vector<FileEntry>& files)
+{
+	for(auto& input : inputs)
+	{
+		if(input == "-")
+		{
+			files.push_back({ input, "" });
+			continue;
+		}
+
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if(!GetFileAttributesExA(input.c_str(), GetFileExInfoStandard, &attributes))
+		{
+			std::cerr << "Unable to open file for read: " << input << std::endl;
+			return false;
+		}
+
+		if(attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if(!recursive)
+			{
+				std::cerr << input << " is a directory (use -r to hash the files in it)" << std::endl;
+				return false;
+			}
+
+			// Don't double up the separator when the directory is given with a trailing one
+			auto directory = input;
+			while (directory.size() > 1 && (directory.back() == '\\' || directory.back() == '/')) directory.pop_back();
+
+			if (!collectDirectory(directory, files)) return false;
+		}
+		else
+		{
+			files.push_back({ input, "" });
+		}
+	}
+
+	return true;
+}
+
+bool ReadManifest(const std::string& path, size_t digestSize, std::vector<FileEntry>& files)
+{
+	std::ifstream reader(path);
+	if(!reader.good())
+	{
+		std::cerr << "Unable to open manifest for read: " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	for(auto number = 1; std::getline(reader, line); number++)
+	{
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty()) continue;
+
+		// "<digest>  <path>", or "<digest> *<path>" for files coreutils hashed in binary mode
+		auto hex = digestSize * 2;
+		if(line.size() < hex + 3 || line[hex] != ' ' || (line[hex + 1] != ' ' && line[hex + 1] != '*') ||
+			line.find_first_not_of("0123456789abcdefABCDEF") != hex)
+		{
+			std::cerr << path << ":" << number << ": not a " << hex << "-digit checksum line" << std::endl;
+			return false;
+		}
+
+		auto expected = line.substr(0, hex);
+		std::transform(expected.begin(), expected.end(), expected.begin(), ::tolower);
+
+		files.push_back({ line.substr(hex + 2), expected });
+	}
+
+	return true;
+}
+
+bool ReadSmall(const std::string& path, size_t maxSize, std::vector<char>& contents, bool& small)
+{
+	auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	// Pipes and devices have no size up front, so they are always streamed
+	LARGE_INTEGER size;
+	small = GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &size) && static_cast<uint64_t>(size.QuadPart) <= maxSize;
+	if(!small)
+	{
+		CloseHandle(file);
+		return true;
+	}
+
+	// The file may have changed size since it was listed, so trust what the read returns
+	contents.resize(static_cast<size_t>(size.QuadPart));
+	DWORD read = 0;
+	auto ok = contents.empty() || ReadFile(file, contents.data(), static_cast<DWORD>(contents.size()), &read, nullptr);
+	auto error = GetLastError();
+	CloseHandle(file);
+
+	contents.resize(read);
+	if (!ok) SetLastError(error);
+	return ok != FALSE;
+}
+
+bool WriteAtomically(const std::string& path, const char* data, size_t len)
+{
+	// Write the whole thing next to the original under a name no other scan is using, then swap it in with a single rename
+	HANDLE file = INVALID_HANDLE_VALUE;
+	std::string temporary;
+	for(auto attempt = 0; file == INVALID_HANDLE_VALUE && attempt < WRITE_ATOMICALLY_ATTEMPTS; attempt++)
+	{
+		temporary = path + "." + std::to_string(GetCurrentProcessId()) + "." + std::to_string(GetTickCount64() + attempt) + ".tmp";
+		file = CreateFileA(temporary.c_str(), GENERIC_WRITE | DELETE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE && GetLastError() != ERROR_FILE_EXISTS) return false;
+	}
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	DWORD written = 0;
+	auto ok = WriteFile(file, data, static_cast<DWORD>(len), &written, nullptr) && written == len && FlushFileBuffers(file);
+
+	// A POSIX rename unlinks the old file even while other scans have it open and mapped, and they keep reading it
+	auto renamed = false;
+	if(ok)
+	{
+		std::vector<wchar_t> target(path.size() + 1);
+		auto characters = MultiByteToWideChar(CP_ACP, 0, path.c_str(), static_cast<int>(path.size()), target.data(), static_cast<int>(target.size()));
+
+		std::vector<char> information(offsetof(RenameInformation, FileName) + characters * sizeof(wchar_t));
+		auto rename = reinterpret_cast<RenameInformation*>(information.data());
+		rename->Flags = FILE_RENAME_FLAG_REPLACE_IF_EXISTS | FILE_RENAME_FLAG_POSIX_SEMANTICS;
+		rename->RootDirectory = nullptr;
+		rename->FileNameLength = static_cast<DWORD>(characters * sizeof(wchar_t));
+		memcpy(rename->FileName, target.data(), characters * sizeof(wchar_t));
+
+		renamed = characters > 0 && SetFileInformationByHandle(file, static_cast<FILE_INFO_BY_HANDLE_CLASS>(FileRenameInfoEx), rename, static_cast<DWORD>(information.size()));
+	}
+	CloseHandle(file);
+
+	// Before Windows 10 1607, and on file systems without POSIX semantics, fall back to a plain rename, which fails if the
+	// old file is still mapped by another scan
+	if(!ok || (!renamed && !MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)))
+	{
+		DeleteFileA(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Files.h - Finding the files to hash and reading checksum manifests
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+
+/** A file to hash, or standard input when the path is "-" */
+typedef struct FileEntry
+{
+	/** The path as given or found, which is also how it is printed */
+	std::string Path;
+	/** The digest expected by the manifest, in hex (only in check mode) */
+	std::string Expected;
+} FileEntry;
+
+/**
+ * Expand the inputs into the list of files to hash, in a deterministic order: the inputs in the order given, and the
+ * contents of each directory sorted by name. Directories are only accepted when recursive is set, and junctions and
+ * directory symlinks found inside them are skipped. Returns false (after printing why) if an input does not exist or is
+ * a directory without recursive
+ */
+bool CollectFiles(const std::vector<std::string>& inputs, bool recursive, std::vector<FileEntry>& files);
+
+/**
+ * Read the expected digests from a manifest of "<hex digest>  <path>" lines (as printed for multiple files, and by
+ * coreutils sha512sum). Returns false (after printing why) if it cannot be read or a line is malformed
+ */
+bool ReadManifest(const std::string& path, size_t digestSize, std::vector<FileEntry>& files);
+
+/**
+ * Read the whole file into contents if it is no bigger than maxSize, otherwise clear small and read nothing. Returns
+ * false if it cannot be opened or read, with the reason left in GetLastError
+ */
+bool ReadSmall(const std::string& path, size_t maxSize, std::vector<char>& contents, bool& small);
+
+/**
+ * Replace the file at path with the len bytes of data, so that it holds either the old or the new contents even if the
+ * process dies part way through. Where the file system supports it, this works while other processes have the old file
+ * open or mapped (as long as they share delete), and they go on seeing the old contents. Returns false if it cannot be
+ * written
+ */
+bool WriteAtomically(const std::string& path, const char* data, size_t len);
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Input.cpp - Reading files for hashing concurrently with the hash itself
+ */
+
+#include "stdafx.h"
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <windows.h>
+#include "Input.h"
+#include "../libcrypto/AsyncIO.h"
+#include "../libcrypto/Mapping.h"
+
+/**
+ * A regular file, mapped into memory in one view. The readahead thread asks the memory manager to read each chunk with
+ * PrefetchVirtualMemory (large sequential reads instead of a page fault at a time), then touches its pages so the hashing
+ * thread never faults. It stays at most MAPPED_READAHEAD_CHUNKS ahead. A page that cannot be read in (the file was
+ * truncated, or the disk or network failed) fails the read instead of ending the process
+ */
+class MappedInput : public Input
+{
+public:
+	MappedInput(HANDLE file, uint64_t size, uint64_t first) : file(file), mapping(nullptr), view(nullptr), size(size), first(first),
+		chunks((size - first + MAPPED_CHUNK_SIZE - 1) / MAPPED_CHUNK_SIZE)
+	{
+		if (size == first) return;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr) return;
+
+		view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (view == nullptr) return;
+
+		readahead = std::thread(&MappedInput::readAhead, this);
+	}
+
+	~MappedInput()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		changed.notify_all();
+
+		if (readahead.joinable()) readahead.join();
+		if (view != nullptr) UnmapViewOfFile(view);
+		if (mapping != nullptr) CloseHandle(mapping);
+		CloseHandle(file);
+	}
+
+	/** True iff the file is mapped (or there is nothing left to read, which needs no mapping) */
+	bool Mapped() const { return size == first || view != nullptr; }
+
+	bool Next(const char*& data, size_t& len) override
+	{
+		if (next == chunks) return false;
+
+		// Let the readahead thread move on past the chunk we are done with, then wait for the next one
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			consumed = next;
+			changed.notify_all();
+			changed.wait(lock, [this] { return ready > next || broken; });
+			failed = ready <= next;
+		}
+		std::chrono::duration<double> waited = std::chrono::high_resolution_clock::now() - start;
+		waitSeconds += waited.count();
+		if (failed) return false;
+
+		auto offset = first + next * MAPPED_CHUNK_SIZE;
+		data = view + offset;
+		len = static_cast<size_t>(size - offset < MAPPED_CHUNK_SIZE ? size - offset : MAPPED_CHUNK_SIZE);
+		next++;
+
+		// The pages read ahead may have been dropped again under memory pressure, and reading them back in can fail too
+		if(!libcrypto::mapping::TouchPages(data, len))
+		{
+			failed = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	const char* Kind() const override { return "mapped"; }
+
+private:
+	void readAhead()
+	{
+		for(uint64_t chunk = 0; chunk < chunks; chunk++)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [this, chunk] { return stop || chunk < consumed + MAPPED_READAHEAD_CHUNKS; });
+				if (stop) return;
+			}
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			auto offset = first + chunk * MAPPED_CHUNK_SIZE;
+			auto len = static_cast<size_t>(size - offset < MAPPED_CHUNK_SIZE ? size - offset : MAPPED_CHUNK_SIZE);
+
+			// The hint only batches the reads, so carry on without it where it is not supported
+			WIN32_MEMORY_RANGE_ENTRY range = { const_cast<char*>(view + offset), len };
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+
+			auto ok = libcrypto::mapping::TouchPages(view + offset, len);
+
+			std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				ioSeconds += duration.count();
+				if (ok) ready = chunk + 1;
+				else broken = true;
+			}
+			changed.notify_all();
+
+			if (!ok) return;
+		}
+	}
+
+	/** The file, the mapping, and the view of the whole file */
+	HANDLE file;
+	HANDLE mapping;
+	const char* view;
+
+	/** The size of the file, where reading starts, and the number of chunks from there on */
+	uint64_t size;
+	uint64_t first;
+	uint64_t chunks;
+
+	/** The next chunk Next hands out */
+	uint64_t next = 0;
+	/** The number of chunks the hashing thread is done with */
+	uint64_t consumed = 0;
+	/** The number of chunks the readahead thread has read */
+	uint64_t ready = 0;
+	/** Set to stop the readahead thread early */
+	bool stop = false;
+	/** Set by the readahead thread when a chunk could not be read in, after which no more become ready */
+	bool broken = false;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::thread readahead;
+};
+
+/**
+ * A pipe, console or anything else that can only be read front to back. The reader thread fills one buffer while the
+ * hashing thread works on the other
+ */
+class StreamInput : public Input
+{
+public:
+	StreamInput(HANDLE handle, bool owned) : handle(handle), owned(owned)
+	{
+		buffers[0] = new char[STREAM_BUFFER_SIZE];
+		buffers[1] = new char[STREAM_BUFFER_SIZE];
+
+		reader = std::thread(&StreamInput::read, this);
+	}
+
+	~StreamInput()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		changed.notify_all();
+
+		// A read blocked on a pipe only returns once the writer writes or closes it
+		if (reader.joinable()) reader.join();
+		if (owned) CloseHandle(handle);
+
+		delete[] buffers[0];
+		delete[] buffers[1];
+	}
+
+	bool Next(const char*& data, size_t& len) override
+	{
+		auto slot = next % 2;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			// Hand the buffer we are done with back to the reader
+			if(next > 0)
+			{
+				full[1 - slot] = false;
+				changed.notify_all();
+			}
+
+			changed.wait(lock, [this, slot] { return full[slot] || done; });
+		}
+		std::chrono::duration<double> waited = std::chrono::high_resolution_clock::now() - start;
+		waitSeconds += waited.count();
+
+		if (!full[slot]) return false;
+
+		data = buffers[slot];
+		len = lengths[slot];
+		next++;
+
+		return true;
+	}
+
+	const char* Kind() const override { return "stream"; }
+
+private:
+	void read()
+	{
+		for(uint64_t fill = 0; ; fill++)
+		{
+			auto slot = fill % 2;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [this, slot] { return stop || !full[slot]; });
+				if (stop) return;
+			}
+
+			// Fill the whole buffer so every chunk but the last is the same size, however little each read returns
+			auto start = std::chrono::high_resolution_clock::now();
+			size_t len = 0;
+			auto error = false, end = false;
+			while(len < STREAM_BUFFER_SIZE)
+			{
+				DWORD read = 0;
+				if(!ReadFile(handle, buffers[slot] + len, static_cast<DWORD>(STREAM_BUFFER_SIZE - len), &read, nullptr))
+				{
+					// The writer closing its end of a pipe is the end of the input
+					error = GetLastError() != ERROR_BROKEN_PIPE;
+					end = true;
+					break;
+				}
+
+				if(read == 0)
+				{
+					end = true;
+					break;
+				}
+
+				len += read;
+			}
+			std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				ioSeconds += duration.count();
+				failed = error;
+				lengths[slot] = len;
+				full[slot] = len > 0;
+				done = end;
+			}
+			changed.notify_all();
+
+			if (end) return;
+		}
+	}
+
+	/** The handle to read from, and whether it is ours to close */
+	HANDLE handle;
+	bool owned;
+
+	/** The two buffers */
+	char* buffers[2];
+	/** The number of bytes in each buffer */
+	size_t lengths[2] = { 0, 0 };
+	/** Whether each buffer is waiting to be hashed */
+	bool full[2] = { false, false };
+
+	/** The number of buffers Next has handed out */
+	uint64_t next = 0;
+	/** Set by the reader at the end of the input */
+	bool done = false;
+	/** Set to stop the reader early */
+	bool stop = false;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::thread reader;
+};
+
+/**
+ * A regular file read unbuffered, straight from the disk into a ring of aligned buffers, with the reads for the chunks
+ * after the one being hashed already in flight. Nothing is left behind in the file cache, so hashing files much bigger
+ * than memory does not push everything else out of it
+ */
+class UnbufferedInput : public Input
+{
+public:
+	UnbufferedInput() : reader(UNBUFFERED_READ_SIZE, UNBUFFERED_QUEUE_DEPTH), start(std::chrono::high_resolution_clock::now())
+	{
+	}
+
+	/** Open the file and start reading it from offset. Returns false if it cannot be read unbuffered */
+	bool Open(const std::string& path, uint64_t offset)
+	{
+		return reader.Open(path, offset, false);
+	}
+
+	bool Next(const char*& data, size_t& len) override
+	{
+		auto waitStart = std::chrono::high_resolution_clock::now();
+		auto ok = reader.Next(data, len);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		// There is no reading thread, as the reads run on their own from when the file is opened until the last one is in
+		std::chrono::duration<double> waited = end - waitStart;
+		std::chrono::duration<double> reading = end - start;
+		waitSeconds += waited.count();
+		if (ok) ioSeconds = reading.count();
+
+		failed = reader.Failed();
+		return ok;
+	}
+
+	const char* Kind() const override { return "unbuffered"; }
+
+private:
+	libcrypto::io::Reader reader;
+	std::chrono::high_resolution_clock::time_point start;
+};
+
+std::unique_ptr<Input> Input::Open(const std::string& path, uint64_t offset, bool unbuffered)
+{
+	if (path == "-") return std::unique_ptr<Input>(new StreamInput(GetStdHandle(STD_INPUT_HANDLE), false));
+
+	if(unbuffered)
+	{
+		std::unique_ptr<UnbufferedInput> input(new UnbufferedInput());
+		if (input->Open(path, offset)) return std::move(input);
+	}
+
+	auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+	LARGE_INTEGER size;
+	if(GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &size))
+	{
+		if(static_cast<uint64_t>(size.QuadPart) < offset)
+		{
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		std::unique_ptr<MappedInput> mapped(new MappedInput(file, static_cast<uint64_t>(size.QuadPart), offset));
+		if (mapped->Mapped()) return std::move(mapped);
+
+		// Too big for the address space (32-bit builds) or not mappable, so read it like a stream instead
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+		LARGE_INTEGER distance;
+		distance.QuadPart = static_cast<LONGLONG>(offset);
+		if(!SetFilePointerEx(file, distance, nullptr, FILE_BEGIN))
+		{
+			CloseHandle(file);
+			return nullptr;
+		}
+	}
+	else if(offset > 0)
+	{
+		// Pipes and devices cannot skip ahead
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	return std::unique_ptr<Input>(new StreamInput(file, true));
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Input.h - Reading files for hashing concurrently with the hash itself
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/** The size of the chunks handed out from a memory-mapped file, and how far ahead they are read (64 MiB) */
+#define MAPPED_CHUNK_SIZE (64ull * 1024 * 1024)
+/** The number of chunks of a memory-mapped file that are read ahead of the one being hashed */
+#define MAPPED_READAHEAD_CHUNKS 2
+/** The size of each of the two buffers the reader thread fills for pipes and standard input (16 MiB) */
+#define STREAM_BUFFER_SIZE (16 * 1024 * 1024)
+/** The size of each read of a file read unbuffered (4 MiB) */
+#define UNBUFFERED_READ_SIZE (4 * 1024 * 1024)
+/** The number of reads of a file read unbuffered that are kept in flight */
+#define UNBUFFERED_QUEUE_DEPTH 8
+
+/**
+ * The contents of a file, handed out as a sequence of read-only chunks while the next ones are read on another thread.
+ *
+ * Regular files are memory-mapped with sequential access hints, and a readahead thread faults in the chunks ahead of the
+ * one being hashed. Pipes and standard input cannot be mapped, so a reader thread fills two large buffers in turn. Asked
+ * to, regular files are instead read unbuffered, with several reads in flight, so they do not pass through the file cache
+ */
+class Input
+{
+public:
+	virtual ~Input() {}
+
+	/**
+	 * Open the file at path, or standard input for "-", starting offset bytes in. Regular files are read unbuffered if
+	 * unbuffered is set and their disk allows it, and mapped otherwise. Returns nullptr if it cannot be opened, is shorter
+	 * than offset, or is not a regular file and offset is not 0. Standard input is always read from where it is
+	 */
+	static std::unique_ptr<Input> Open(const std::string& path, uint64_t offset = 0, bool unbuffered = false);
+
+	/**
+	 * Get the next chunk of the input, which stays valid until the next call. Every chunk but the last is a multiple of
+	 * 1 MiB, except the first of a file read unbuffered from an offset. Returns false at the end of the input, or if a
+	 * read failed (see Failed)
+	 */
+	virtual bool Next(const char*& data, size_t& len) = 0;
+
+	/** How the input is being read ("mapped", "stream" or "unbuffered") */
+	virtual const char* Kind() const = 0;
+
+	/** True iff reading stopped because of an error rather than the end of the input */
+	bool Failed() const { return failed; }
+	/** The time the reading thread spent on I/O, in seconds. Only final after Next returns false */
+	double IoSeconds() const { return ioSeconds; }
+	/** The time Next spent waiting for the reading thread, in seconds (how much of the I/O was not overlapped) */
+	double WaitSeconds() const { return waitSeconds; }
+
+protected:
+	/** True iff reading stopped because of an error */
+	bool failed = false;
+	/** The time the reading thread spent on I/O, in seconds */
+	double ioSeconds = 0;
+	/** The time Next spent waiting for the reading thread, in seconds */
+	double waitSeconds = 0;
+};
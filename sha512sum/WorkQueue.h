@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * WorkQueue.h - Work-stealing distribution of files across the hashing threads
+ */
+
+#pragma once
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * A contiguous run of work items owned by one worker. The owner takes from the front and thieves take from the back, so
+ * each worker mostly walks neighbouring items (small files in the same directory end up in the same batch)
+ */
+typedef struct Run
+{
+	std::mutex Lock;
+	size_t Next = 0;
+	size_t End = 0;
+} Run;
+
+/**
+ * Hands out the items [0, count) to the workers. Each worker starts with an even share and steals half of the largest
+ * remaining run once its own is empty
+ */
+class WorkQueue
+{
+public:
+	WorkQueue(size_t count, size_t workers) : runs(workers)
+	{
+		for(size_t w = 0; w < workers; w++)
+		{
+			runs[w].reset(new Run());
+			runs[w]->Next = count * w / workers;
+			runs[w]->End = count * (w + 1) / workers;
+		}
+	}
+
+	/** Take the next item for the worker. Returns false once every item has been taken */
+	bool Take(size_t worker, size_t& item)
+	{
+		auto& own = *runs[worker];
+		while(true)
+		{
+			{
+				std::lock_guard<std::mutex> lock(own.Lock);
+				if(own.Next < own.End)
+				{
+					item = own.Next++;
+					return true;
+				}
+			}
+
+			if (!steal(worker)) return false;
+		}
+	}
+
+private:
+	/** Move the back half of the largest other run to the worker's run. Returns false if there is nothing left to steal */
+	bool steal(size_t worker)
+	{
+		while(true)
+		{
+			// Pick the victim without holding any locks; the sizes are re-checked under its lock
+			size_t victim = runs.size(), most = 0;
+			for(size_t w = 0; w < runs.size(); w++)
+			{
+				if (w == worker) continue;
+
+				std::lock_guard<std::mutex> lock(runs[w]->Lock);
+				if(runs[w]->End - runs[w]->Next > most)
+				{
+					most = runs[w]->End - runs[w]->Next;
+					victim = w;
+				}
+			}
+
+			if (victim == runs.size()) return false;
+
+			size_t first, end;
+			{
+				std::lock_guard<std::mutex> lock(runs[victim]->Lock);
+				auto left = runs[victim]->End - runs[victim]->Next;
+				if (left == 0) continue;
+
+				// Take the back half, rounded up so the last item of a run can be taken over too
+				end = runs[victim]->End;
+				first = end - (left + 1) / 2;
+				runs[victim]->End = first;
+			}
+
+			std::lock_guard<std::mutex> lock(runs[worker]->Lock);
+			runs[worker]->Next = first;
+			runs[worker]->End = end;
+			return true;
+		}
+	}
+
+	std::vector<std::unique_ptr<Run>> runs;
+};
@@ -24,13 +24,39 @@
 
 #include "stdafx.h"
 #include <iostream>
-#include <fstream>
+#include <cstring>
 #include <chrono>
 #include <iomanip>
+#include <algorithm>
+#include <condition_variable>
+#include <stdexcept>
+#include <unordered_set>
+#include "opts.h"
+#include "Input.h"
+#include "Files.h"
+#include "WorkQueue.h"
+#include "DigestCache.h"
 #include "../libcrypto/Hashing/SHA512.h"
+#include "../libcrypto/Hashing/MerkleTree.h"
+#include "../libcrypto/Hashing/FastCDC.h"
+#include "../libcrypto/Hashing/BLAKE2b.h"
 
-/** The size of the buffer for computing hashes on large files (16k) */
-#define BUFFER_SIZE SHA512_BLOCK_SIZE_BYTES * 128
+/** Files up to this size are read whole and hashed together across the SIMD lanes instead of being streamed (64 KiB) */
+#define SMALL_FILE_SIZE_BYTES (64 * 1024)
+/** The most small files hashed together in one batch */
+#define SMALL_BATCH_FILES 64
+/** The most bytes of small files held for one batch (1 MiB) */
+#define SMALL_BATCH_BYTES (1024 * 1024)
+/** The volume serial and file index saved after the hash state, so a checkpoint is only resumed against its own file */
+#define CHECKPOINT_IDENTITY_BYTES 16
+/** The size of a checkpoint file: the SHA512 state, then the identity of the file */
+#define CHECKPOINT_FILE_SIZE_BYTES (SHA512_CHECKPOINT_SIZE_BYTES + CHECKPOINT_IDENTITY_BYTES)
+
+// Forward-declare so main is at the top as per project spec
+void printHelp();
+int hashSingle(const Options& opts);
+int hashMany(const Options& opts);
+int hashChunks(const Options& opts);
 
 /** Print the specified digest in the format required by the project spec (8-byte chunks) */
 void printHash(char* digest)
@@ -42,50 +68,552 @@ void printHash(char* digest)
 	}
 }
 
+/** Format the specified digest as one unbroken hex string, as in manifests */
+std::string toHex(const char* digest)
+{
+	static const char* digits = "0123456789abcdef";
+
+	std::string hex(SHA512_DIGEST_SIZE_BYTES * 2, '0');
+	for(auto i = 0; i < SHA512_DIGEST_SIZE_BYTES; i++)
+	{
+		hex[2 * i] = digits[digest[i] >> 4 & 0xf];
+		hex[2 * i + 1] = digits[digest[i] & 0xf];
+	}
+
+	return hex;
+}
+
 int main(int argc, char* argv[])
 {
-	if(argc != 2)
+	Options opts(argc, argv);
+	if(opts.Errors)
 	{
-		std::cout << "syntax: sha512sum <file>" << std::endl;
+		printHelp();
 		return -1;
 	}
 
-	std::ifstream reader;
-	reader.open(argv[1], std::ios::binary | std::ios::in);
-	if(!reader.good())
+	if (opts.ChunkSize > 0) return hashChunks(opts);
+	return opts.Single() ? hashSingle(opts) : hashMany(opts);
+}
+
+/** Save the SHA512 state to the checkpoint, if one is given */
+void saveCheckpoint(const libcrypto::hashing::Sha512& hasher, char* checkpoint)
+{
+	if (checkpoint != nullptr) hasher.Save(checkpoint);
+}
+
+/** Only SHA512 has checkpoints (-k is rejected for the others) */
+template<typename Hasher> void saveCheckpoint(const Hasher&, char*)
+{
+}
+
+/**
+ * Hash everything left in the input, continuing the message in hasher (or a tree on the specified number of threads in
+ * tree mode). If checkpoint is given, the hash state is saved there before it is padded. The time spent hashing is added
+ * to hashing. Returns false if the input could not be read
+ */
+template<typename Hasher> bool hashInput(Input& input, const Options& opts, size_t threads, Hasher& hasher, char* digest,
+	std::chrono::duration<double>& hashing, char* checkpoint = nullptr)
+{
+	libcrypto::hashing::MerkleTree tree(opts.LeafSize, threads);
+
+	const char* data;
+	size_t len;
+	while(input.Next(data, len))
+	{
+		auto hashStart = std::chrono::high_resolution_clock::now();
+
+		// Chunks are whole leaves (except the last), so the tree hashes them in place, many at a time across the threads
+		if (opts.Tree) tree.Update(data, len);
+		else hasher.Update(data, len);
+
+		hashing += std::chrono::high_resolution_clock::now() - hashStart;
+	}
+
+	if (input.Failed()) return false;
+
+	auto hashStart = std::chrono::high_resolution_clock::now();
+	saveCheckpoint(hasher, checkpoint);
+	if (opts.Tree) tree.Final(digest);
+	else hasher.Final(digest);
+	hashing += std::chrono::high_resolution_clock::now() - hashStart;
+
+	return true;
+}
+
+/** Hash everything left in the input from the start of a new message, with the algorithm picked with -a (see hashInput) */
+bool hashInput(Input& input, const Options& opts, size_t threads, char* digest, std::chrono::duration<double>& hashing)
+{
+	switch(opts.Hash)
+	{
+	case BLAKE2B_ALGORITHM:
+		{
+			libcrypto::hashing::Blake2b hasher;
+			return hashInput(input, opts, threads, hasher, digest, hashing);
+		}
+	case BLAKE2BP_ALGORITHM:
+		{
+			libcrypto::hashing::Blake2bp hasher;
+			return hashInput(input, opts, threads, hasher, digest, hashing);
+		}
+	default:
+		{
+			libcrypto::hashing::Sha512 hasher;
+			return hashInput(input, opts, threads, hasher, digest, hashing);
+		}
+	}
+}
+
+/**
+ * Identify the file at path by its volume serial and file index, which stay the same however much is appended to it but
+ * change when a log is rotated or replaced. Returns false if it cannot be opened
+ */
+bool identify(const std::string& path, char* identity)
+{
+	CacheKey key;
+	if (!DigestCache::Identify(path, 0, key)) return false;
+
+	memcpy(identity, &key.Volume, sizeof(key.Volume));
+	memcpy(identity + sizeof(key.Volume), &key.File, sizeof(key.File));
+	return true;
+}
+
+/**
+ * Load the hash state and the identity of the file it is for from the checkpoint file, if there is one yet (identity is
+ * left alone if not). Returns false (after printing why) if it exists but can't be read or is not a checkpoint
+ */
+bool loadCheckpoint(const std::string& path, libcrypto::hashing::Sha512& hasher, char* identity)
+{
+	std::vector<char> checkpoint;
+	auto small = false;
+	if(!ReadSmall(path, CHECKPOINT_FILE_SIZE_BYTES, checkpoint, small))
+	{
+		// Only a missing file means there is no checkpoint yet. Starting over because it was locked or unreadable would
+		// hash the whole file and then overwrite the checkpoint with the state for all of it
+		auto error = GetLastError();
+		if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) return true;
+
+		std::cerr << "Unable to read the checkpoint " << path << " (error " << error << ")" << std::endl;
+		return false;
+	}
+
+	if(!small || checkpoint.size() != CHECKPOINT_FILE_SIZE_BYTES)
+	{
+		std::cerr << path << " is not a SHA512 checkpoint" << std::endl;
+		return false;
+	}
+
+	try
+	{
+		hasher.Load(checkpoint.data());
+	}
+	catch(std::invalid_argument& e)
+	{
+		std::cerr << path << ": " << e.what() << std::endl;
+		return false;
+	}
+
+	memcpy(identity, checkpoint.data() + SHA512_CHECKPOINT_SIZE_BYTES, CHECKPOINT_IDENTITY_BYTES);
+	return true;
+}
+
+/**
+ * Hash a single file and print its digest with the time spent on i/o and hashing. With a checkpoint, only the bytes
+ * appended since it was saved are read, and the new state is saved back to it
+ */
+int hashSingle(const Options& opts)
+{
+	auto& path = opts.Inputs[0];
+
+	libcrypto::hashing::Sha512 hasher;
+	char saved[CHECKPOINT_IDENTITY_BYTES] = { 0 };
+	if (!opts.Checkpoint.empty() && !loadCheckpoint(opts.Checkpoint, hasher, saved)) return -4;
+
+	// Standard input is taken to be just the appended bytes, as there is no way to skip ahead in it (or to tell which file
+	// they were appended to, so the checkpoint keeps the identity it had)
+	auto resumed = hasher.Length();
+	char identity[CHECKPOINT_IDENTITY_BYTES];
+	memcpy(identity, saved, sizeof(identity));
+	if(!opts.Checkpoint.empty() && path != "-")
+	{
+		if(!identify(path, identity))
+		{
+			std::cerr << "Unable to open file for read: " << path << std::endl;
+			return -2;
+		}
+
+		if(resumed > 0 && memcmp(identity, saved, sizeof(identity)) != 0)
+		{
+			std::cerr << "The checkpoint " << opts.Checkpoint << " was saved for another file than " << path << " (was it rotated or replaced?)" << std::endl;
+			return -4;
+		}
+	}
+
+	auto input = Input::Open(path, path == "-" ? 0 : resumed, opts.Unbuffered);
+	if(!input)
 	{
-		std::cerr << "Unable to open file for read: " << argv[1] << std::endl;
+		if (resumed > 0) std::cerr << "Unable to open " << path << " past the " << resumed << " bytes in the checkpoint (was it truncated?)" << std::endl;
+		else std::cerr << "Unable to open file for read: " << path << std::endl;
 		return -2;
 	}
 
 	auto start = std::chrono::high_resolution_clock::now();
 
-	auto buff = new char[BUFFER_SIZE];
+	// The input is read on another thread while we hash, so only the time spent hashing is counted here
+	std::chrono::duration<double> hashing(0);
 
-	// Process the file in BUFFER_SIZE chunks
-	auto firstBlock = true;
-	auto digest = new char[SHA512_DIGEST_SIZE_BYTES];
-	size_t totalLength = 0;
-	while(!reader.eof())
+	char digest[SHA512_DIGEST_SIZE_BYTES];
+	char checkpoint[CHECKPOINT_FILE_SIZE_BYTES];
+	auto ok = opts.Hash == SHA512_ALGORITHM ? hashInput(*input, opts, opts.Threads, hasher, digest, hashing, checkpoint)
+		: hashInput(*input, opts, opts.Threads, digest, hashing);
+	if(!ok)
 	{
-		// Try to read BUFFER_SIZE bytes and get the actual number of bytes read
-		auto len = reader.read(buff, BUFFER_SIZE).gcount();
-		totalLength += len;
+		std::cerr << "Unable to read " << path << std::endl;
+		return -3;
+	}
 
-		// Compute the partial has for the block
-		libcrypto::hashing::SHA512::ComputePartialHash(digest, buff, len, firstBlock, len != BUFFER_SIZE ? &totalLength : nullptr);
-		firstBlock = false;
+	memcpy(checkpoint + SHA512_CHECKPOINT_SIZE_BYTES, identity, sizeof(identity));
+	if(!opts.Checkpoint.empty() && !WriteAtomically(opts.Checkpoint, checkpoint, sizeof(checkpoint)))
+	{
+		std::cerr << "Unable to write the checkpoint to " << opts.Checkpoint << std::endl;
+		return -4;
 	}
 
 	std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
 
-	// Print the hash and statistics
+	// Print the hash and statistics. I/O overlaps hashing, so the time spent waiting is the I/O that was not hidden
 	printHash(digest);
-	std::cout << " - " << argv[1] << " (" << std::fixed << std::setprecision(3) << duration.count() << "s)" << std::endl;
+	std::cout << " - " << path << " (";
+	if (opts.Hash != SHA512_ALGORITHM) std::cout << opts.AlgorithmName() << ", ";
+	if (opts.Tree) std::cout << "tree, " << opts.LeafSize / 1024 << " KiB leaves, ";
+	if (resumed > 0) std::cout << "resumed after " << resumed << " bytes, ";
+	std::cout << std::fixed << std::setprecision(3) << duration.count() << "s: " << input->Kind() << " i/o " << input->IoSeconds()
+		<< "s, hashing " << hashing.count() << "s, waited " << input->WaitSeconds() << "s)" << std::endl;
+
+	return 0;
+}
+
+/** The outcome of hashing one of many files */
+typedef struct Result
+{
+	/** The digest in hex, or empty if the file could not be read */
+	std::string Digest;
+	/** Whether or not the file has been hashed (or failed), guarded by Batch::Lock */
+	bool Done = false;
+	/** What identifies the file and its contents in the digest cache, if it could be identified */
+	CacheKey Key;
+	bool Identified = false;
+} Result;
+
+/** The state shared by the threads hashing many files */
+typedef struct Batch
+{
+	std::vector<FileEntry> Files;
+	std::vector<Result> Results;
+	std::unique_ptr<WorkQueue> Queue;
+	/** The digests of files hashed before, if a cache is kept */
+	std::unique_ptr<DigestCache> Cache;
+
+	/** Guards Result::Done, and is signalled whenever a file is finished */
+	std::mutex Lock;
+	std::condition_variable Finished;
+} Batch;
+
+/** Record the digest (nullptr on failure) of the specified file, remember it in the cache and wake the printer */
+void finish(Batch& batch, size_t item, const char* digest)
+{
+	auto& result = batch.Results[item];
+	if (digest != nullptr && result.Identified) batch.Cache->Store(result.Key, digest);
+
+	auto hex = digest != nullptr ? toHex(digest) : "";
+
+	std::lock_guard<std::mutex> lock(batch.Lock);
+	result.Digest = std::move(hex);
+	result.Done = true;
+	batch.Finished.notify_all();
+}
+
+/**
+ * Hash the small files read so far together, a file per SIMD lane (or a single-threaded tree each in tree mode)
+ */
+void flushSmall(Batch& batch, const Options& opts, std::vector<size_t>& items, std::vector<std::vector<char>>& contents, size_t& bytes)
+{
+	if (items.empty()) return;
 
-	// Cleanup
-	delete[] digest;
-	delete[] buff;
+	std::vector<const char*> messages(items.size());
+	std::vector<size_t> lengths(items.size());
+	std::vector<char> digests(items.size() * SHA512_DIGEST_SIZE_BYTES);
+	for(size_t i = 0; i < items.size(); i++)
+	{
+		messages[i] = contents[i].data();
+		lengths[i] = contents[i].size();
+	}
+
+	if(opts.Tree)
+	{
+		for(size_t i = 0; i < items.size(); i++)
+		{
+			libcrypto::hashing::MerkleTree tree(opts.LeafSize, 1);
+			tree.Update(messages[i], lengths[i]);
+			tree.Final(&digests[i * SHA512_DIGEST_SIZE_BYTES]);
+		}
+	}
+	else if(opts.Hash == SHA512_ALGORITHM)
+	{
+		libcrypto::hashing::SHA512::ComputeHashes(messages.data(), lengths.data(), digests.data(), items.size());
+	}
+	else
+	{
+		// BLAKE2b has no multi-buffer implementation, so they are hashed one at a time
+		for(size_t i = 0; i < items.size(); i++)
+		{
+			if (opts.Hash == BLAKE2BP_ALGORITHM) libcrypto::hashing::BLAKE2b::ComputeParallelHash(messages[i], lengths[i], &digests[i * SHA512_DIGEST_SIZE_BYTES]);
+			else libcrypto::hashing::BLAKE2b::ComputeHash(messages[i], lengths[i], &digests[i * SHA512_DIGEST_SIZE_BYTES]);
+		}
+	}
+
+	for(size_t i = 0; i < items.size(); i++)
+	{
+		finish(batch, items[i], &digests[i * SHA512_DIGEST_SIZE_BYTES]);
+	}
+
+	items.clear();
+	bytes = 0;
+}
+
+/**
+ * Hash files taken from the queue until it is empty. Small files are held back and hashed together, big files and
+ * pipes are streamed through Input like a single file (with the tree on one thread, as the files are the parallelism)
+ */
+void hashFiles(Batch& batch, const Options& opts, size_t worker)
+{
+	std::vector<size_t> items;
+	std::vector<std::vector<char>> contents(SMALL_BATCH_FILES);
+	size_t bytes = 0;
+
+	std::chrono::duration<double> hashing(0);
+	char digest[SHA512_DIGEST_SIZE_BYTES];
+
+	size_t item;
+	while(batch.Queue->Take(worker, item))
+	{
+		auto& path = batch.Files[item].Path;
+
+		// Unchanged files are served from the cache without reading them. The file is identified before it is read, so
+		// if it changes while it is being hashed, the digest is stored under the old time and hashed again next time
+		auto& result = batch.Results[item];
+		if(batch.Cache && path != "-" && DigestCache::Identify(path, opts.Tree ? opts.LeafSize : 0, result.Key))
+		{
+			if(batch.Cache->Lookup(result.Key, digest))
+			{
+				finish(batch, item, digest);
+				continue;
+			}
+
+			result.Identified = true;
+		}
+
+		auto small = false;
+		if(path != "-")
+		{
+			if(!ReadSmall(path, SMALL_FILE_SIZE_BYTES, contents[items.size()], small))
+			{
+				finish(batch, item, nullptr);
+				continue;
+			}
+
+			if(small)
+			{
+				bytes += contents[items.size()].size();
+				items.push_back(item);
+				if (items.size() == SMALL_BATCH_FILES || bytes >= SMALL_BATCH_BYTES) flushSmall(batch, opts, items, contents, bytes);
+				continue;
+			}
+		}
+
+		// Don't hold the small files back while a big one is hashed, so they can be printed
+		flushSmall(batch, opts, items, contents, bytes);
+
+		auto input = Input::Open(path, 0, opts.Unbuffered);
+		auto ok = input && hashInput(*input, opts, 1, digest, hashing);
+		finish(batch, item, ok ? digest : nullptr);
+	}
+
+	flushSmall(batch, opts, items, contents, bytes);
+}
+
+/**
+ * Hash every file found in the inputs (or listed in the manifest in check mode) on the worker threads, and print
+ * the results in order as they finish
+ */
+int hashMany(const Options& opts)
+{
+	Batch batch;
+	auto check = !opts.Manifest.empty();
+	if(check ? !ReadManifest(opts.Manifest, SHA512_DIGEST_SIZE_BYTES, batch.Files) : !CollectFiles(opts.Inputs, opts.Recursive, batch.Files))
+	{
+		return -2;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!opts.Cache.empty()) batch.Cache.reset(new DigestCache(opts.Cache));
+
+	auto workers = std::max<size_t>(1, std::min<size_t>(opts.Threads, batch.Files.size()));
+	batch.Results.resize(batch.Files.size());
+	batch.Queue.reset(new WorkQueue(batch.Files.size(), workers));
+
+	std::vector<std::thread> threads;
+	for(size_t w = 0; w < workers; w++)
+	{
+		threads.emplace_back(hashFiles, std::ref(batch), std::cref(opts), w);
+	}
+
+	size_t unreadable = 0, mismatched = 0;
+	for(size_t i = 0; i < batch.Files.size(); i++)
+	{
+		{
+			std::unique_lock<std::mutex> lock(batch.Lock);
+			batch.Finished.wait(lock, [&] { return batch.Results[i].Done; });
+		}
+
+		auto& file = batch.Files[i];
+		auto& digest = batch.Results[i].Digest;
+		if(digest.empty())
+		{
+			unreadable++;
+			if (check) std::cout << file.Path << ": FAILED open or read" << std::endl;
+			else std::cerr << "Unable to open file for read: " << file.Path << std::endl;
+		}
+		else if(check)
+		{
+			auto ok = digest == file.Expected;
+			if (!ok) mismatched++;
+			std::cout << file.Path << (ok ? ": OK" : ": FAILED") << std::endl;
+		}
+		else
+		{
+			std::cout << digest << "  " << file.Path << std::endl;
+		}
+	}
+
+	for(auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	// The scan still succeeded if the cache can't be updated (e.g. the file system can't replace it while another scan has it mapped), it is just slower next time
+	if(batch.Cache && !batch.Cache->Save(opts.Purge))
+	{
+		std::cerr << "Unable to update the digest cache " << opts.Cache << std::endl;
+	}
+
+	std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+
+	// Statistics go to stderr so the output stays a manifest that -c (and coreutils sha512sum -c) can read back
+	if (unreadable > 0) std::cerr << unreadable << " of " << batch.Files.size() << " files could not be read" << std::endl;
+	if (mismatched > 0) std::cerr << mismatched << " of " << batch.Files.size() << " computed digests did NOT match" << std::endl;
+	std::cerr << "Hashed " << batch.Files.size() << " files in " << std::fixed << std::setprecision(3) << duration.count()
+		<< "s on " << workers << " threads";
+	if (batch.Cache) std::cerr << " (" << batch.Cache->Hits() << " from the cache, " << batch.Cache->Purged() << " stale entries purged)";
+	std::cerr << std::endl;
+
+	if (unreadable > 0) return -2;
+	return mismatched > 0 ? 1 : 0;
+}
+
+/**
+ * Split every file found in the inputs into content-defined chunks and print a manifest of their digests, one file at a
+ * time with the chunks found and hashed across the threads
+ */
+int hashChunks(const Options& opts)
+{
+	std::vector<FileEntry> files;
+	if (!CollectFiles(opts.Inputs, opts.Recursive, files)) return -2;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Count the chunks that were already seen, to show how much deduplicating the files would save
+	std::unordered_set<std::string> seen;
+	uint64_t bytes = 0, duplicateBytes = 0, count = 0;
+	auto unreadable = 0;
+
+	libcrypto::hashing::FastCdc chunker(opts.ChunkSize, opts.Threads);
+	std::vector<libcrypto::hashing::Chunk> chunks;
+	for(auto& file : files)
+	{
+		auto input = Input::Open(file.Path, 0, opts.Unbuffered);
+		if(!input)
+		{
+			std::cerr << "Unable to open file for read: " << file.Path << std::endl;
+			unreadable++;
+			continue;
+		}
+
+		// Each file is listed as "# <path>" followed by a "<digest> <offset> <length>" line for each of its chunks
+		std::cout << "# " << file.Path << std::endl;
+
+		const char* data;
+		size_t len;
+		auto finished = false;
+		while(!finished)
+		{
+			finished = !input->Next(data, len);
+			if (finished) chunker.Final(chunks);
+			else chunker.Update(data, len, chunks);
+
+			for(auto& chunk : chunks)
+			{
+				std::string digest(chunk.Digest, SHA512_DIGEST_SIZE_BYTES);
+				if (!seen.insert(digest).second) duplicateBytes += chunk.Length;
+
+				bytes += chunk.Length;
+				std::cout << toHex(chunk.Digest) << " " << chunk.Offset << " " << chunk.Length << std::endl;
+			}
+
+			count += chunks.size();
+			chunks.clear();
+		}
+
+		if(input->Failed())
+		{
+			std::cerr << "Unable to read " << file.Path << std::endl;
+			unreadable++;
+		}
+	}
+
+	std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+
+	std::cerr << "Split " << files.size() << " files (" << bytes << " bytes) into " << count << " chunks, " << seen.size() << " unique ("
+		<< std::fixed << std::setprecision(1) << (bytes > 0 ? 100.0 * duplicateBytes / bytes : 0.0) << "% of the bytes are duplicates) in "
+		<< std::setprecision(3) << duration.count() << "s" << std::endl;
+
+	return unreadable > 0 ? -2 : 0;
+}
+
+/**
+ * Prints the syntax and help for the program
+ */
+void printHelp()
+{
+	std::cout << "sha512sum <file|dir|-> ... [-a algorithm] [-r] [-c manifest] [-d cache [-p]] [-k checkpoint] [-s avgKiB] [-t] [-l leafKiB] [-u] [-j threads]" << std::endl << std::endl;
 
-    return 0;
+	std::cout << "\tFile:   The paths to the files to hash, or - for standard input" << std::endl;
+	std::cout << "\t        A single file is printed with timing statistics, many are printed as a manifest" << std::endl;
+	std::cout << "\t-a:     The hash function: sha512 (default), or blake2b or blake2bp (faster, but not FIPS approved)" << std::endl;
+	std::cout << "\t        BLAKE2bp hashes four interleaved BLAKE2b leaves side by side, so it is fastest on large files" << std::endl;
+	std::cout << "\t-r:     Hash the files in directories and their subdirectories (not following junctions or directory symlinks)" << std::endl;
+	std::cout << "\t-c:     Check the files listed in the manifest against their digests instead" << std::endl;
+	std::cout << "\t-d:     Keep the digests in the cache file, and only read files that changed since they were cached" << std::endl;
+	std::cout << "\t-p:     Drop the cache entries of files that were deleted or changed since they were cached, scanned or not" << std::endl;
+	std::cout << "\t-k:     Resume a single file from the hash state saved in the checkpoint, and save the new state back" << std::endl;
+	std::cout << "\t        Only the bytes appended since are read, so logs that only grow are rehashed in no time" << std::endl;
+	std::cout << "\t        A checkpoint only resumes the file it was saved for, not one that has since replaced it" << std::endl;
+	std::cout << "\t-s:     Split the files into content-defined chunks of about avgKiB and print the digest of each chunk" << std::endl;
+	std::cout << "\t        Chunk boundaries follow the content, so unchanged runs of a file keep their chunks" << std::endl;
+	std::cout << "\t-t:     Print the root of the SHA512 hash tree instead of the SHA512 digest" << std::endl;
+	std::cout << "\t        Leaves are hashed in parallel, so this is much faster on large files" << std::endl;
+	std::cout << "\t-l:     The size of each leaf of the tree in KiB (default " << MERKLE_DEFAULT_LEAF_SIZE_BYTES / 1024 << ")" << std::endl;
+	std::cout << "\t-u:     Read files unbuffered, straight from the disk with several reads in flight, instead of mapping them" << std::endl;
+	std::cout << "\t        Nothing is kept in the file cache, so this suits files much bigger than memory" << std::endl;
+	std::cout << "\t-j:     The number of threads to hash files (or leaves) on (default: one per core)" << std::endl;
 }
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2016 Nathan Lowe
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * opts.h - Command Line Options
+ */
+
+#pragma once
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <thread>
+#include "../libcrypto/Hashing/MerkleTree.h"
+#include "../libcrypto/Hashing/FastCDC.h"
+
+/** The largest leaf size accepted for tree hashing, in KiB (64 MiB) */
+#define MAX_LEAF_SIZE_KIB (64 * 1024)
+
+/**
+ * The hash functions files can be digested with. All of them have 64-byte digests, so manifests look the same
+ */
+enum Algorithm
+{
+	SHA512_ALGORITHM,
+	BLAKE2B_ALGORITHM,
+	BLAKE2BP_ALGORITHM
+};
+
+/**
+ * A class for parsing command-line options
+ */
+class Options
+{
+public:
+	/** The files and directories to hash, in the order given ("-" is standard input) */
+	std::vector<std::string> Inputs;
+	/** Whether or not to hash the files in directories (and their subdirectories) */
+	bool Recursive = false;
+	/** The manifest to check the files against, if in check mode */
+	std::string Manifest;
+	/** The digest cache, which the digests of unchanged files are served from */
+	std::string Cache;
+	/** Whether or not to drop cache entries for files that have been deleted or changed since they were hashed */
+	bool Purge = false;
+	/** The file the hash state is resumed from (if it exists) and saved back to, so only appended bytes are hashed */
+	std::string Checkpoint;
+
+	/** The hash function to digest files with */
+	Algorithm Hash = SHA512_ALGORITHM;
+	/** Whether or not to compute the tree hash (root of a MerkleTree) instead of the plain SHA512 digest */
+	bool Tree = false;
+	/** The number of bytes covered by each leaf in tree mode */
+	size_t LeafSize = MERKLE_DEFAULT_LEAF_SIZE_BYTES;
+	/** The average size of content-defined chunks to split files into and hash separately, or 0 to hash whole files */
+	size_t ChunkSize = 0;
+	/** Whether or not to read files unbuffered, bypassing the file cache, instead of mapping them */
+	bool Unbuffered = false;
+	/** The number of threads to hash files (or the leaves of a single file in tree mode) on */
+	unsigned int Threads = std::thread::hardware_concurrency();
+
+	/** Whether or not errors were encountered */
+	bool Errors = false;
+
+	/**
+	 * Construct the options using the specified arguments
+	 */
+	Options(int argc, char* argv[])
+	{
+		for(auto i = 1; i < argc; i++)
+		{
+			std::string flag(argv[i]);
+
+			// Anything that isn't a flag is a file to hash
+			if(flag == "-" || flag[0] != '-')
+			{
+				Inputs.push_back(flag);
+				continue;
+			}
+
+			if(flag == "-t")
+			{
+				Tree = true;
+				continue;
+			}
+
+			if(flag == "-r")
+			{
+				Recursive = true;
+				continue;
+			}
+
+			if(flag == "-p")
+			{
+				Purge = true;
+				continue;
+			}
+
+			if(flag == "-u")
+			{
+				Unbuffered = true;
+				continue;
+			}
+
+			// Everything else takes a value
+			if(i + 1 >= argc)
+			{
+				std::cerr << "Missing value for " << flag << std::endl;
+				Errors = true;
+				return;
+			}
+
+			std::string value(argv[++i]);
+			if(flag == "-l")
+			{
+				auto kib = strtoul(value.c_str(), nullptr, 10);
+				if(kib == 0 || kib > MAX_LEAF_SIZE_KIB)
+				{
+					std::cerr << "The leaf size must be between 1 and " << MAX_LEAF_SIZE_KIB << " KiB" << std::endl;
+					Errors = true;
+				}
+
+				LeafSize = kib * 1024;
+			}
+			else if(flag == "-s")
+			{
+				auto kib = strtoul(value.c_str(), nullptr, 10);
+				ChunkSize = kib * 1024;
+				if(kib == 0 || (kib & (kib - 1)) != 0 || ChunkSize > FASTCDC_MAX_AVERAGE_SIZE_BYTES)
+				{
+					std::cerr << "The average chunk size must be a power of two from 1 to " << FASTCDC_MAX_AVERAGE_SIZE_BYTES / 1024 << " KiB" << std::endl;
+					Errors = true;
+				}
+			}
+			else if(flag == "-a")
+			{
+				if (value == "sha512") Hash = SHA512_ALGORITHM;
+				else if (value == "blake2b") Hash = BLAKE2B_ALGORITHM;
+				else if (value == "blake2bp") Hash = BLAKE2BP_ALGORITHM;
+				else
+				{
+					std::cerr << "Unknown algorithm " << value << std::endl;
+					Errors = true;
+				}
+			}
+			else if(flag == "-c")
+			{
+				Manifest = value;
+			}
+			else if(flag == "-d")
+			{
+				Cache = value;
+			}
+			else if(flag == "-k")
+			{
+				Checkpoint = value;
+			}
+			else if(flag == "-j")
+			{
+				Threads = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+			}
+			else
+			{
+				std::cerr << "Unknown option " << flag << std::endl;
+				Errors = true;
+			}
+
+			if(Errors) return;
+		}
+
+		if(Threads == 0) Threads = 1;
+
+		// The manifest says which files to check
+		if(Manifest.empty() == Inputs.empty())
+		{
+			std::cerr << (Manifest.empty() ? "No files to hash" : "Files cannot be given with -c") << std::endl;
+			Errors = true;
+		}
+		else if(!Checkpoint.empty() && (Tree || !Single()))
+		{
+			std::cerr << "A checkpoint can only be kept for a single file, without -t or -d" << std::endl;
+			Errors = true;
+		}
+		else if(ChunkSize > 0 && (Tree || !Manifest.empty() || !Cache.empty() || !Checkpoint.empty()))
+		{
+			std::cerr << "Chunking cannot be combined with -t, -c, -d or -k" << std::endl;
+			Errors = true;
+		}
+		else if(Hash != SHA512_ALGORITHM && (Tree || !Cache.empty() || !Checkpoint.empty() || ChunkSize > 0))
+		{
+			std::cerr << "BLAKE2b cannot be combined with -t, -d, -k or -s" << std::endl;
+			Errors = true;
+		}
+		else if(Purge && Cache.empty())
+		{
+			std::cerr << "Purging needs a cache (-d)" << std::endl;
+			Errors = true;
+		}
+	}
+
+	/** The name of the hash function, as given to -a */
+	const char* AlgorithmName() const
+	{
+		switch(Hash)
+		{
+		case BLAKE2B_ALGORITHM:
+			return "blake2b";
+		case BLAKE2BP_ALGORITHM:
+			return "blake2bp";
+		default:
+			return "sha512";
+		}
+	}
+
+	/** True iff there is a single file to hash (without a cache), which gets its digest printed with timing statistics */
+	bool Single() const
+	{
+		return Inputs.size() == 1 && !Recursive && Manifest.empty() && Cache.empty();
+	}
+};